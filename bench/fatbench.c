@@ -0,0 +1,548 @@
+#ifdef __unix__
+/* Needed for clock_gettime. */
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/fat.h"
+#include "../include/fathost.h"
+
+/* Microbenchmarks of the library on a disk image made by fatmkimg.
+ *
+ * The image is loaded into memory and accessed through a device that
+ * counts the sectors read and written, so the results do not depend on the
+ * host's disk. The optional features enabled in fat_conf.h are set up the
+ * way fatdump does, and the partition is reopened before every benchmark,
+ * so each one starts with empty caches.
+ *
+ * The write benchmarks modify the image in memory only.
+ */
+
+/* The directory searched and extended by the directory benchmarks. */
+#define FAT_BENCH_DIRECTORY "/D0"
+
+/* The file followed and read by the cluster chain and read benchmarks. */
+#define FAT_BENCH_FILE "/BIG.DAT"
+
+/* The size of a read of the sequential read benchmark. */
+#define FAT_BENCH_READ_SIZE (4096)
+
+/* Forwards to the image and counts the transferred sectors. */
+typedef struct {
+  TFatDevice        Device;                /* The device of the partition. */
+  TFatMemoryDevice  Memory;                /* The image. */
+  unsigned long     Reads;                 /* Sectors read. */
+  unsigned long     Writes;                /* Sectors written. */
+} TFatBenchDevice;
+
+typedef unsigned long (*TFatBenchFunction)(TFatPartition* pPartition, unsigned long Count);
+
+static TFatBenchDevice FAT_Device;
+static TFatPartition FAT_Partition;
+static uint8_t FAT_Buffer[FAT_BYTES_PER_SECTOR];
+static unsigned long FAT_Random = 1;
+
+#ifdef FAT_CACHE_SECTORS
+static TFatCache FAT_Cache;
+static uint8_t FAT_CacheData[FAT_CACHE_SECTORS * FAT_BYTES_PER_SECTOR];
+#endif
+
+#ifdef FAT_ENABLE_FAT_TABLE
+/* Sized to hold the whole FAT once the partition is open. */
+static TFatTable FAT_Table;
+#endif
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+static TFatNameIndex FAT_NameIndex;
+static TFatNameEntry FAT_NameIndexData[FAT_DIR_INDEX_DIRECTORIES * FAT_DIR_INDEX_ENTRIES];
+#endif
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+static TFatPathCache FAT_PathCache;
+#endif
+
+#ifdef FAT_DIR_HINT_ENTRIES
+static TFatDirHints FAT_DirHints;
+#endif
+
+#ifdef FAT_ENABLE_STATS
+static TFatStats FAT_Stats;
+#endif
+
+#ifdef FAT_ENABLE_TRACE
+/* The size of the buffer of the trace recorder. */
+#define FAT_BENCH_TRACE_BUFFER_SIZE (4096)
+
+static TFatTraceRecorder FAT_Recorder;
+static uint8_t FAT_TraceBuffer[FAT_BENCH_TRACE_BUFFER_SIZE];
+#endif
+
+/* The file names found in FAT_BENCH_DIRECTORY, 11 characters each. */
+static char* FAT_Names;
+static unsigned long FAT_NameCount;
+
+static void FAT_BenchReadSector(TFatDevice* pDevice, uint32_t SectorNr, uint8_t* pDest)
+{
+  TFatBenchDevice* const pBenchDevice = (TFatBenchDevice*)pDevice->pContext;
+
+  pBenchDevice->Reads++;
+  pBenchDevice->Memory.Device.ReadSector(&pBenchDevice->Memory.Device, SectorNr, pDest);
+}
+
+static void FAT_BenchWriteSector(TFatDevice* pDevice, uint32_t SectorNr, const uint8_t* pSource)
+{
+  TFatBenchDevice* const pBenchDevice = (TFatBenchDevice*)pDevice->pContext;
+
+  pBenchDevice->Writes++;
+  pBenchDevice->Memory.Device.WriteSector(&pBenchDevice->Memory.Device, SectorNr, pSource);
+}
+
+static void FAT_BenchReadSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, uint8_t* pDest)
+{
+  TFatBenchDevice* const pBenchDevice = (TFatBenchDevice*)pDevice->pContext;
+
+  pBenchDevice->Reads += Count;
+  pBenchDevice->Memory.Device.ReadSectors(&pBenchDevice->Memory.Device, SectorNr, Count, pDest);
+}
+
+static void FAT_BenchWriteSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource)
+{
+  TFatBenchDevice* const pBenchDevice = (TFatBenchDevice*)pDevice->pContext;
+
+  pBenchDevice->Writes += Count;
+  pBenchDevice->Memory.Device.WriteSectors(&pBenchDevice->Memory.Device, SectorNr, Count, pSource);
+}
+
+static void FAT_OpenBenchDevice(TFatBenchDevice* pBenchDevice, uint8_t* pData, uint32_t SectorCount)
+{
+  FAT_OpenMemoryDevice(&pBenchDevice->Memory, pData, SectorCount);
+  pBenchDevice->Device.ReadSector   = FAT_BenchReadSector;
+  pBenchDevice->Device.WriteSector  = FAT_BenchWriteSector;
+  pBenchDevice->Device.ReadSectors  = (pBenchDevice->Memory.Device.ReadSectors != NULL) ? FAT_BenchReadSectors : NULL;
+  pBenchDevice->Device.WriteSectors = (pBenchDevice->Memory.Device.WriteSectors != NULL) ? FAT_BenchWriteSectors : NULL;
+  pBenchDevice->Device.Flush        = NULL;
+  pBenchDevice->Device.MapSector    = NULL;
+  pBenchDevice->Device.pContext     = pBenchDevice;
+  pBenchDevice->Reads = 0;
+  pBenchDevice->Writes = 0;
+}
+
+/* Returns a monotonic time in seconds. */
+static double FAT_GetTime(void)
+{
+#if defined(__unix__) && defined(CLOCK_MONOTONIC)
+  struct timespec Now;
+
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (double)Now.tv_sec + (double)Now.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+#ifdef FAT_ENABLE_STATS
+/* TFatStats::GetTime, in nanoseconds. */
+static uint32_t FAT_GetStatsTime(void* pContext)
+{
+  (void)pContext;
+  return (uint32_t)(FAT_GetTime() * 1e9);
+}
+
+/* Prints the sectors transferred per region, the sector loads and the
+ * latency histogram of the device calls.
+ */
+static void FAT_PrintStats(const TFatStats* pStats)
+{
+  static const char* const Regions[FAT_REGION_COUNT] = { "boot", "fat", "root", "data" };
+  uint8_t I;
+
+  printf("  sectors read/written:");
+  for (I = 0; I < FAT_REGION_COUNT; I++)
+  {
+    printf(" %s %lu/%lu", Regions[I], (unsigned long)pStats->Reads[I], (unsigned long)pStats->Writes[I]);
+  }
+  printf(", loads: %lu hits, %lu misses\n", (unsigned long)pStats->Hits, (unsigned long)pStats->Misses);
+
+  printf("  device calls by ns:");
+  for (I = 0; I < FAT_STATS_LATENCY_BUCKETS; I++)
+  {
+    if (pStats->Latency[I] != 0)
+    {
+      printf(" <%lu: %lu", 1UL << I, (unsigned long)pStats->Latency[I]);
+    }
+  }
+  printf("\n");
+}
+#endif
+
+/* xorshift32, so every run makes the same accesses. */
+static unsigned long FAT_NextRandom(void)
+{
+  FAT_Random ^= (FAT_Random << 13) & 0xFFFFFFFFUL;
+  FAT_Random ^= FAT_Random >> 17;
+  FAT_Random ^= (FAT_Random << 5) & 0xFFFFFFFFUL;
+  return FAT_Random;
+}
+
+/* Returns the first cluster of the entry at pPath, or zero (0) if it does not exist. */
+static TFatClusterNr FAT_GetBenchCluster(TFatPartition* pPartition, const char* pPath)
+{
+  TFatDirectoryLocation DirLocation;
+  const TFatDirEntry* const pDirEntry = FAT_OpenPath(pPartition, pPath, &DirLocation);
+
+  return (pDirEntry != NULL) ? FAT_GetStartCluster(pDirEntry) : 0;
+}
+
+/* Follows the cluster chain of FAT_BENCH_FILE. */
+static unsigned long FAT_BenchGetNextCluster(TFatPartition* pPartition, unsigned long Count)
+{
+  const TFatClusterNr StartCluster = FAT_GetBenchCluster(pPartition, FAT_BENCH_FILE);
+  unsigned long Ops = 0;
+
+  if (StartCluster == 0) return 0;
+
+  /* The chain is followed as often as needed for Count links. */
+  while (Ops < Count)
+  {
+    TFatClusterNr Cluster = StartCluster;
+
+    while (!FAT_IsEndOfChain(pPartition, Cluster) && (Cluster >= 2) && (Cluster <= pPartition->ClusterCount + 1))
+    {
+      Cluster = FAT_GetNextCluster(pPartition, Cluster);
+      Ops++;
+    }
+  }
+  return Ops;
+}
+
+/* Looks up randomly chosen files of FAT_BENCH_DIRECTORY. */
+static unsigned long FAT_BenchFindDirEntry(TFatPartition* pPartition, unsigned long Count)
+{
+  const TFatClusterNr DirectoryCluster = FAT_GetBenchCluster(pPartition, FAT_BENCH_DIRECTORY);
+  TFatDirectoryLocation DirLocation;
+  unsigned long Ops;
+
+  if ((DirectoryCluster == 0) || (FAT_NameCount == 0)) return 0;
+
+  for (Ops = 0; Ops < Count; Ops++)
+  {
+    char* const pName = FAT_Names + 11 * (FAT_NextRandom() % FAT_NameCount);
+
+    if (FAT_FindDirEntry(pPartition, DirectoryCluster, pName, &DirLocation) == NULL)
+    {
+      printf("FATAL: %.11s was not found\n", pName);
+      exit(EXIT_FAILURE);
+    }
+  }
+  return Ops;
+}
+
+#ifdef FAT_ENABLE_WRITE
+/* Searches the FAT for a free cluster from random clusters. */
+static unsigned long FAT_BenchFindFreeCluster(TFatPartition* pPartition, unsigned long Count)
+{
+  unsigned long Ops;
+
+  for (Ops = 0; Ops < Count; Ops++)
+  {
+    const TFatClusterNr FirstCluster = (TFatClusterNr)(2 + FAT_NextRandom() % pPartition->ClusterCount);
+
+    (void)FAT_Cond(pPartition, FAT16_FindFreeCluster(pPartition, FirstCluster), FAT32_FindFreeCluster(pPartition, FirstCluster));
+  }
+  return Ops;
+}
+
+/* Adds entries to FAT_BENCH_DIRECTORY. */
+static unsigned long FAT_BenchCreateDirEntry(TFatPartition* pPartition, unsigned long Count)
+{
+  const TFatClusterNr DirectoryCluster = FAT_GetBenchCluster(pPartition, FAT_BENCH_DIRECTORY);
+  TFatDirectoryLocation DirLocation;
+  unsigned long Ops;
+  char Name[12];
+
+  if (DirectoryCluster == 0) return 0;
+
+  for (Ops = 0; Ops < Count; Ops++)
+  {
+    if (FAT_CreateDirEntry(pPartition, DirectoryCluster, &DirLocation) == NULL) break;
+
+    sprintf(Name, "B%05lu  TMP", Ops % 100000);
+    FAT_InitDirEntry(pPartition, &DirLocation, Name);
+  }
+  /* Deferred writes are part of the cost. */
+  FAT_Flush(pPartition);
+  return Ops;
+}
+#endif
+
+/* Reads FAT_BENCH_FILE from start to end. */
+static unsigned long FAT_BenchFileRead(TFatPartition* pPartition, unsigned long Count)
+{
+  static uint8_t Data[FAT_BENCH_READ_SIZE];
+  unsigned long Ops = 0;
+  TFatFile File;
+
+  (void)Count;
+  if (!FAT_FileOpen(pPartition, FAT_BENCH_FILE, 0, &File)) return 0;
+
+  while (FAT_FileRead(&File, Data, sizeof(Data)) != 0)
+  {
+    Ops++;
+  }
+  FAT_FileClose(&File);
+  return Ops;
+}
+
+/* Collects the file names of FAT_BENCH_DIRECTORY for FAT_BenchFindDirEntry. */
+static void FAT_CollectNames(TFatPartition* pPartition)
+{
+  const TFatClusterNr DirectoryCluster = FAT_GetBenchCluster(pPartition, FAT_BENCH_DIRECTORY);
+  TFatDirectoryLocation DirLocation;
+  unsigned long Size = 0;
+
+  if (DirectoryCluster == 0) return;
+
+  FAT_GetFirstDirectoryEntry(pPartition, DirectoryCluster, &DirLocation);
+  for (;;)
+  {
+    const TFatDirEntry* const pDirEntry = FAT_GetDirEntry(pPartition, &DirLocation);
+
+    if (FAT_IsLastDirEntry(pPartition, pDirEntry, &DirLocation)) break;
+
+    if (!FAT_IsDirEntryDeleted(pDirEntry) && !FAT_IsDirectory(pDirEntry))
+    {
+      if (FAT_NameCount == Size)
+      {
+        Size = 2 * Size + 64;
+        FAT_Names = (char*)realloc(FAT_Names, 11 * Size);
+        if (FAT_Names == NULL)
+        {
+          printf("FATAL: Out of memory\n");
+          exit(EXIT_FAILURE);
+        }
+      }
+      memcpy(FAT_Names + 11 * FAT_NameCount++, pDirEntry->Name, 11);
+    }
+    FAT_GetNextDirectoryEntry(pPartition, &DirLocation);
+  }
+}
+
+static void FAT_RunBenchmark(TFatPartition* pPartition, const char* pName, TFatBenchFunction Function, unsigned long Count)
+{
+  unsigned long Ops;
+  double Time;
+
+  /* Start with empty caches. */
+  FAT_OpenPartition(pPartition, 0);
+  FAT_Device.Reads = 0;
+  FAT_Device.Writes = 0;
+#ifdef FAT_ENABLE_STATS
+  FAT_ResetStats(&FAT_Stats);
+#endif
+
+  Time = FAT_GetTime();
+  Ops = Function(pPartition, Count);
+  Time = FAT_GetTime() - Time;
+
+  if (Ops == 0)
+  {
+    printf("%-16s %8s\n", pName, "skipped");
+    return;
+  }
+  printf("%-16s %8lu %10.3f %10.3f %10.3f\n", pName, Ops, Time * 1e6 / Ops,
+         (double)FAT_Device.Reads / Ops, (double)FAT_Device.Writes / Ops);
+#ifdef FAT_ENABLE_STATS
+  FAT_PrintStats(&FAT_Stats);
+#endif
+}
+
+#ifdef FAT_ENABLE_TRACE
+static void FAT_WriteTrace(void* pContext, const uint8_t* pData, uint16_t Length)
+{
+  fwrite(pData, 1, Length, (FILE*)pContext);
+}
+#endif
+
+static uint8_t* FAT_LoadImage(const char* pPath, uint32_t* pSectorCount)
+{
+  FILE* const pFile = fopen(pPath, "rb");
+  uint8_t* pData = NULL;
+  long Size;
+
+  if (pFile == NULL) return NULL;
+
+  if ((fseek(pFile, 0, SEEK_END) == 0) && ((Size = ftell(pFile)) > 0) && (fseek(pFile, 0, SEEK_SET) == 0))
+  {
+    pData = (uint8_t*)malloc((size_t)Size);
+    if ((pData != NULL) && (fread(pData, 1, (size_t)Size, pFile) != (size_t)Size))
+    {
+      free(pData);
+      pData = NULL;
+    }
+    *pSectorCount = (uint32_t)(Size / FAT_BYTES_PER_SECTOR);
+  }
+  fclose(pFile);
+  return pData;
+}
+
+int main(int argc, char* argv[])
+{
+  TFatPartition* const pPartition = &FAT_Partition;
+  unsigned long Count = 1000;
+  uint32_t SectorCount = 0;
+  uint8_t* pImage;
+  const char* pTracePath = NULL;
+#ifdef FAT_ENABLE_TRACE
+  FILE* pTrace = NULL;
+#endif
+#if defined(FAT_ENABLE_WRITE) && defined(FAT_ENABLE_FREE_MAP)
+  uint8_t* pFreeMap = NULL;
+#endif
+
+  while ((argc > 3) && (argv[1][0] == '-'))
+  {
+    if (strcmp(argv[1], "-n") == 0)
+    {
+      Count = strtoul(argv[2], NULL, 0);
+    }
+    else if (strcmp(argv[1], "-t") == 0)
+    {
+      pTracePath = argv[2];
+    }
+    else
+    {
+      break;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  if ((argc != 2) || (Count == 0))
+  {
+    printf("Usage: fatbench [-n operations] [-t trace] <disk_image>\n");
+    return EXIT_FAILURE;
+  }
+#ifdef FAT_ENABLE_TRACE
+  if (pTracePath != NULL)
+  {
+    pTrace = fopen(pTracePath, "wb");
+    if (pTrace == NULL)
+    {
+      printf("FATAL: Could not create %s\n", pTracePath);
+      return EXIT_FAILURE;
+    }
+    FAT_Recorder.pBuffer = FAT_TraceBuffer;
+    FAT_Recorder.BufferSize = FAT_BENCH_TRACE_BUFFER_SIZE;
+    FAT_Recorder.Write = FAT_WriteTrace;
+    FAT_Recorder.pContext = pTrace;
+    FAT_InitTrace(&FAT_Recorder);
+    FAT_Stats.Trace = FAT_RecordTrace;
+    FAT_Stats.pContext = &FAT_Recorder;
+  }
+#else
+  if (pTracePath != NULL)
+  {
+    printf("FATAL: Built without FAT_ENABLE_TRACE, can not record %s\n", pTracePath);
+    return EXIT_FAILURE;
+  }
+#endif
+
+  pImage = FAT_LoadImage(argv[1], &SectorCount);
+  if (pImage == NULL)
+  {
+    printf("FATAL: Could not load %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  FAT_OpenBenchDevice(&FAT_Device, pImage, SectorCount);
+
+  pPartition->pDevice = &FAT_Device.Device;
+  pPartition->pBuffer = FAT_Buffer;
+#ifdef FAT_CACHE_SECTORS
+  /* A trace should hold every sector load, for fatcachesim to replay. */
+  if (pTracePath == NULL)
+  {
+    FAT_Cache.pData = FAT_CacheData;
+    pPartition->pCache = &FAT_Cache;
+  }
+#endif
+#ifdef FAT_DIR_INDEX_ENTRIES
+  FAT_NameIndex.pData = FAT_NameIndexData;
+  pPartition->pNameIndex = &FAT_NameIndex;
+#endif
+#ifdef FAT_PATH_CACHE_ENTRIES
+  pPartition->pPathCache = &FAT_PathCache;
+#endif
+#ifdef FAT_DIR_HINT_ENTRIES
+  pPartition->pDirHints = &FAT_DirHints;
+#endif
+#ifdef FAT_ENABLE_STATS
+  FAT_Stats.GetTime = FAT_GetStatsTime;
+  pPartition->pStats = &FAT_Stats;
+#endif
+
+  if (!FAT_OpenPartition(pPartition, 0))
+  {
+    printf("FATAL: The disk is either corrupt, or has an invalid partition type.\n");
+    return EXIT_FAILURE;
+  }
+
+#ifdef FAT_ENABLE_FAT_TABLE
+  FAT_Table.SectorCount = pPartition->SectorsPerFAT;
+  FAT_Table.pData = (uint8_t*)malloc((size_t)FAT_Table.SectorCount * FAT_BYTES_PER_SECTOR);
+  FAT_Table.pDirty = (uint8_t*)malloc(FAT_TABLE_DIRTY_SIZE(FAT_Table.SectorCount));
+  if ((FAT_Table.pData != NULL) && (FAT_Table.pDirty != NULL) && (pTracePath == NULL))
+  {
+    pPartition->pTable = &FAT_Table;
+  }
+#endif
+#if defined(FAT_ENABLE_WRITE) && defined(FAT_ENABLE_FREE_MAP)
+  pFreeMap = (uint8_t*)malloc(FAT_FREE_MAP_SIZE(pPartition->ClusterCount));
+  if (pFreeMap != NULL)
+  {
+    pPartition->pFreeMap = pFreeMap;
+    pPartition->FreeMapSize = FAT_FREE_MAP_SIZE(pPartition->ClusterCount);
+  }
+#endif
+  FAT_CollectNames(pPartition);
+
+  printf("%s: FAT%d, %lu clusters of %u bytes, %lu files in %s\n", argv[1], FAT_IsFAT32(pPartition) ? 32 : 16,
+         (unsigned long)pPartition->ClusterCount, (unsigned int)(pPartition->SectorsPerCluster * FAT_BYTES_PER_SECTOR),
+         FAT_NameCount, FAT_BENCH_DIRECTORY);
+#ifdef FAT_DEBUG
+  printf("Built with FAT_DEBUG, the times include the debug output\n");
+#endif
+  printf("%-16s %8s %10s %10s %10s\n", "benchmark", "ops", "us/op", "reads/op", "writes/op");
+
+  FAT_RunBenchmark(pPartition, "GetNextCluster", FAT_BenchGetNextCluster, 100 * Count);
+  FAT_RunBenchmark(pPartition, "FindDirEntry", FAT_BenchFindDirEntry, Count);
+#ifdef FAT_ENABLE_WRITE
+  FAT_RunBenchmark(pPartition, "FindFreeCluster", FAT_BenchFindFreeCluster, Count);
+#endif
+  FAT_RunBenchmark(pPartition, "FileRead", FAT_BenchFileRead, Count);
+#ifdef FAT_ENABLE_WRITE
+  /* Last, since it modifies the directory the others use. */
+  FAT_RunBenchmark(pPartition, "CreateDirEntry", FAT_BenchCreateDirEntry, Count);
+#endif
+
+#ifdef FAT_ENABLE_FAT_TABLE
+  free(FAT_Table.pData);
+  free(FAT_Table.pDirty);
+#endif
+#if defined(FAT_ENABLE_WRITE) && defined(FAT_ENABLE_FREE_MAP)
+  free(pFreeMap);
+#endif
+#ifdef FAT_ENABLE_TRACE
+  if (pTrace != NULL)
+  {
+    FAT_FlushTrace(&FAT_Recorder);
+    printf("%lu requests recorded in %s\n", (unsigned long)FAT_Recorder.Records, pTracePath);
+    fclose(pTrace);
+  }
+#endif
+  free(FAT_Names);
+  free(pImage);
+  return 0;
+}
@@ -0,0 +1,364 @@
+/* Replays a trace recorded with FAT_RecordTrace against sector caches of
+ * several sizes and replacement policies, and reports the hit ratio and the
+ * device requests each would make.
+ *
+ * The cache is simulated the way fatcache.c works. Single sector reads are
+ * sector loads, which go through the cache. Reads of more sectors bypass
+ * it. Single sector writes update a cached copy (write-through) or are
+ * kept in the cache until evicted (write-back, -w). Writes of more sectors
+ * go to the device and update cached copies. The trace should be recorded
+ * without a sector cache, so that it holds every sector load.
+ *
+ * Policies:
+ *   LRU         replaces the least recently used sector, like fatcache.c.
+ *   CLOCK       replaces the first sector the clock hand finds that has not
+ *               been used since the hand last passed it.
+ *   FAT-pinned  LRU, but a sector outside the FAT only replaces FAT sectors
+ *               if no other sector is cached.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_HEADER_SIZE (8)
+#define TRACE_RECORD_SIZE (6)
+#define TRACE_VERSION (1)
+#define TRACE_WRITE (0x80)
+#define TRACE_REGION_MASK (0x03)
+#define REGION_FAT (1)
+#define REGION_COUNT (4)
+#define MAX_SIZES (16)
+#define MAX_CACHE_SECTORS (4096)
+
+typedef enum { POLICY_LRU, POLICY_CLOCK, POLICY_FAT_PINNED, POLICY_COUNT } TPolicy;
+
+typedef struct {
+  unsigned long Sector;
+  unsigned long LastUsed;
+  unsigned char Valid;
+  unsigned char Dirty;
+  unsigned char Referenced;                /* CLOCK */
+  unsigned char Fat;                       /* The sector is in the FAT. */
+} TEntry;
+
+typedef struct {
+  unsigned long Sector;
+  unsigned int  Count;
+  unsigned char Flags;
+} TRecord;
+
+typedef struct {
+  unsigned long Loads;
+  unsigned long Hits;
+  unsigned long DeviceReads;               /* Sectors */
+  unsigned long DeviceWrites;              /* Sectors */
+  unsigned long ReadRequests;
+  unsigned long WriteRequests;
+} TResult;
+
+static const char* const PolicyNames[POLICY_COUNT] = { "LRU", "CLOCK", "FAT-pinned" };
+static const char* const RegionNames[REGION_COUNT] = { "boot", "fat", "root", "data" };
+
+static TRecord* pRecords;
+static unsigned long RecordCount;
+static TEntry Entries[MAX_CACHE_SECTORS];
+static unsigned int Hand;
+static unsigned long Tick;
+static int WriteBack;
+
+static void Fail(const char* pMessage, const char* pArgument)
+{
+  fprintf(stderr, pMessage, pArgument);
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+static void LoadTrace(const char* pPath)
+{
+  FILE* const pFile = fopen(pPath, "rb");
+  unsigned char Header[TRACE_HEADER_SIZE];
+  unsigned char Record[TRACE_RECORD_SIZE];
+  unsigned long Size = 0;
+
+  if (pFile == NULL) Fail("Can not open %s.", pPath);
+  if ((fread(Header, 1, sizeof(Header), pFile) != sizeof(Header)) || (memcmp(Header, "FATT", 4) != 0))
+  {
+    Fail("%s is not a trace.", pPath);
+  }
+  if (Header[4] != TRACE_VERSION) Fail("%s has an unknown version.", pPath);
+
+  while (fread(Record, 1, sizeof(Record), pFile) == sizeof(Record))
+  {
+    if (RecordCount == Size)
+    {
+      Size = 2 * Size + 4096;
+      pRecords = (TRecord*)realloc(pRecords, Size * sizeof(TRecord));
+      if (pRecords == NULL) Fail("Out of memory.%s", "");
+    }
+    pRecords[RecordCount].Sector = (unsigned long)Record[0] | ((unsigned long)Record[1] << 8) |
+                                   ((unsigned long)Record[2] << 16) | ((unsigned long)Record[3] << 24);
+    pRecords[RecordCount].Count = Record[4];
+    pRecords[RecordCount].Flags = Record[5];
+    RecordCount++;
+  }
+  fclose(pFile);
+}
+
+/* Returns the entry holding Sector, or Size if it is not cached. */
+static unsigned int FindEntry(unsigned int Size, unsigned long Sector)
+{
+  unsigned int I;
+
+  for (I = 0; I < Size; I++)
+  {
+    if (Entries[I].Valid && (Entries[I].Sector == Sector)) return I;
+  }
+  return Size;
+}
+
+static unsigned int FindVictim(unsigned int Size, TPolicy Policy, int Fat)
+{
+  unsigned int I;
+  unsigned int Victim = Size;
+
+  for (I = 0; I < Size; I++)
+  {
+    if (!Entries[I].Valid) return I;
+  }
+
+  switch (Policy)
+  {
+    case POLICY_CLOCK:
+      for (;;)
+      {
+        I = Hand;
+        Hand = (Hand + 1) % Size;
+        if (!Entries[I].Referenced) return I;
+        Entries[I].Referenced = 0;
+      }
+
+    case POLICY_FAT_PINNED:
+      if (!Fat)
+      {
+        for (I = 0; I < Size; I++)
+        {
+          if (!Entries[I].Fat && ((Victim == Size) || (Entries[I].LastUsed < Entries[Victim].LastUsed))) Victim = I;
+        }
+        if (Victim != Size) return Victim;
+      }
+      /* Fall through */
+
+    default:
+      Victim = 0;
+      for (I = 1; I < Size; I++)
+      {
+        if (Entries[I].LastUsed < Entries[Victim].LastUsed) Victim = I;
+      }
+      return Victim;
+  }
+}
+
+static void Touch(unsigned int Index)
+{
+  Entries[Index].LastUsed = ++Tick;
+  Entries[Index].Referenced = 1;
+}
+
+/* Makes room for Sector and returns its entry. */
+static unsigned int Insert(unsigned int Size, TPolicy Policy, unsigned long Sector, int Fat, TResult* pResult)
+{
+  const unsigned int Index = FindVictim(Size, Policy, Fat);
+
+  if (Entries[Index].Valid && Entries[Index].Dirty)
+  {
+    pResult->DeviceWrites++;
+    pResult->WriteRequests++;
+  }
+  Entries[Index].Sector = Sector;
+  Entries[Index].Valid = 1;
+  Entries[Index].Dirty = 0;
+  Entries[Index].Fat = (unsigned char)Fat;
+  Touch(Index);
+  return Index;
+}
+
+static void Simulate(unsigned int Size, TPolicy Policy, TResult* pResult)
+{
+  unsigned long R;
+  unsigned int I;
+
+  memset(pResult, 0, sizeof(*pResult));
+  memset(Entries, 0, sizeof(Entries));
+  Hand = 0;
+  Tick = 0;
+
+  for (R = 0; R < RecordCount; R++)
+  {
+    const TRecord* const pRecord = &pRecords[R];
+    const int Fat = ((pRecord->Flags & TRACE_REGION_MASK) == REGION_FAT);
+    const unsigned int Index = (Size != 0) ? FindEntry(Size, pRecord->Sector) : 0;
+
+    if (pRecord->Flags & TRACE_WRITE)
+    {
+      if ((pRecord->Count == 1) && (Size != 0) && WriteBack)
+      {
+        if (Index != Size)
+        {
+          Entries[Index].Dirty = 1;
+          Touch(Index);
+        }
+        else
+        {
+          Entries[Insert(Size, Policy, pRecord->Sector, Fat, pResult)].Dirty = 1;
+        }
+        continue;
+      }
+      /* Cached copies are updated, and become clean. */
+      for (I = 0; I < Size; I++)
+      {
+        if (Entries[I].Valid && (Entries[I].Sector - pRecord->Sector < pRecord->Count))
+        {
+          Entries[I].Dirty = 0;
+          if (pRecord->Count == 1) Touch(I);
+        }
+      }
+      pResult->DeviceWrites += pRecord->Count;
+      pResult->WriteRequests++;
+    }
+    else if (pRecord->Count == 1)
+    {
+      pResult->Loads++;
+      if ((Size != 0) && (Index != Size))
+      {
+        pResult->Hits++;
+        Touch(Index);
+        continue;
+      }
+      if (Size != 0) Insert(Size, Policy, pRecord->Sector, Fat, pResult);
+      pResult->DeviceReads++;
+      pResult->ReadRequests++;
+    }
+    else
+    {
+      pResult->DeviceReads += pRecord->Count;
+      pResult->ReadRequests++;
+    }
+  }
+
+  /* FAT_Flush writes the modified sectors. */
+  for (I = 0; I < Size; I++)
+  {
+    if (Entries[I].Valid && Entries[I].Dirty)
+    {
+      pResult->DeviceWrites++;
+      pResult->WriteRequests++;
+    }
+  }
+}
+
+/* Parses a comma separated list of cache sizes, returns the number of sizes
+ * or 0 if the list is invalid.
+ */
+static unsigned int ParseSizes(const char* pList, unsigned int* pSizes)
+{
+  unsigned int Count = 0;
+  char* pEnd;
+
+  for (;;)
+  {
+    const unsigned long Size = strtoul(pList, &pEnd, 0);
+
+    if ((pEnd == pList) || (Size == 0) || (Size > MAX_CACHE_SECTORS) || (Count == MAX_SIZES)) return 0;
+    pSizes[Count++] = (unsigned int)Size;
+    if (*pEnd == '\0') return Count;
+    if (*pEnd != ',') return 0;
+    pList = pEnd + 1;
+  }
+}
+
+static void PrintResult(const char* pPolicy, unsigned int Size, const TResult* pResult)
+{
+  printf("%-10s %7u %7.2f%% %12lu %12lu %12lu %12lu\n", pPolicy, Size,
+         (pResult->Loads != 0) ? 100.0 * pResult->Hits / pResult->Loads : 0.0,
+         pResult->ReadRequests, pResult->DeviceReads, pResult->WriteRequests, pResult->DeviceWrites);
+}
+
+static void PrintSummary(void)
+{
+  unsigned long Reads[REGION_COUNT] = { 0, 0, 0, 0 };
+  unsigned long Writes[REGION_COUNT] = { 0, 0, 0, 0 };
+  unsigned long R;
+  int I;
+
+  for (R = 0; R < RecordCount; R++)
+  {
+    unsigned long* const pSectors = (pRecords[R].Flags & TRACE_WRITE) ? Writes : Reads;
+
+    pSectors[pRecords[R].Flags & TRACE_REGION_MASK] += pRecords[R].Count;
+  }
+  printf("%lu requests, sectors read/written:", RecordCount);
+  for (I = 0; I < REGION_COUNT; I++)
+  {
+    printf(" %s %lu/%lu", RegionNames[I], Reads[I], Writes[I]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned int Sizes[MAX_SIZES] = { 1, 2, 4, 8, 16, 32, 64 };
+  unsigned int SizeCount = 7;
+  const char* pPath = NULL;
+  TResult Result;
+  unsigned int S;
+  int Arg;
+  int P;
+
+  for (Arg = 1; Arg < argc; Arg++)
+  {
+    if (strcmp(argv[Arg], "-w") == 0)
+    {
+      WriteBack = 1;
+    }
+    else if ((strcmp(argv[Arg], "-s") == 0) && (Arg + 1 < argc))
+    {
+      SizeCount = ParseSizes(argv[++Arg], Sizes);
+      if (SizeCount == 0) break;
+    }
+    else if ((argv[Arg][0] != '-') && (pPath == NULL))
+    {
+      pPath = argv[Arg];
+    }
+    else
+    {
+      pPath = NULL;
+      break;
+    }
+  }
+  if ((pPath == NULL) || (SizeCount == 0))
+  {
+    fprintf(stderr, "Usage: %s [-w] [-s sectors,sectors,...] <trace>\n"
+                    "  -w  simulate a write-back cache (FAT_CACHE_WRITE_BACK)\n"
+                    "  -s  the cache sizes to simulate, at most %d values of 1-%d sectors\n",
+            argv[0], MAX_SIZES, MAX_CACHE_SECTORS);
+    return EXIT_FAILURE;
+  }
+
+  LoadTrace(pPath);
+  PrintSummary();
+
+  printf("%-10s %7s %8s %12s %12s %12s %12s\n", "policy", "sectors", "hits", "read reqs", "read sectors", "write reqs", "write sectors");
+  Simulate(0, POLICY_LRU, &Result);
+  PrintResult("none", 0, &Result);
+  for (P = 0; P < POLICY_COUNT; P++)
+  {
+    for (S = 0; S < SizeCount; S++)
+    {
+      Simulate(Sizes[S], (TPolicy)P, &Result);
+      PrintResult(PolicyNames[P], Sizes[S], &Result);
+    }
+  }
+
+  free(pRecords);
+  return EXIT_SUCCESS;
+}
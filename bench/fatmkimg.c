@@ -0,0 +1,435 @@
+/* Generates reproducible FAT16 and FAT32 disk images for the benchmarks.
+ *
+ * The image has an MBR with one partition. The root directory holds a
+ * large file, BIG.DAT, and a tree of directories: every directory below
+ * the root directory has the same number of files (Fnnnnn.DAT) and
+ * subdirectories (Dn), down to a given depth. File sizes and fragmentation
+ * come from a seeded pseudo-random generator, so the same options always
+ * give the same image.
+ *
+ * Fragmentation is the chance, in percent, that a free gap of one to
+ * three clusters is left after an allocated cluster. It fragments the
+ * files as well as the free space.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SECTOR_SIZE (512)
+#define PARTITION_LBA (63)
+#define ENTRY_SIZE (32)
+#define FAT16_ROOT_ENTRIES (512)
+#define END_OF_CHAIN (0x0FFFFFFFUL)
+
+typedef struct {
+  unsigned int  FatType;                   /* 16 or 32. */
+  unsigned long SizeMB;
+  unsigned int  SectorsPerCluster;
+  unsigned int  Fragmentation;             /* Percent. */
+  unsigned int  FanOut;                    /* Subdirectories per directory. */
+  unsigned int  Depth;                     /* Levels of directories below the root directory. */
+  unsigned int  FilesPerDirectory;
+  unsigned long MaxFileSize;
+  unsigned long BigFileMB;
+  unsigned long Seed;
+} TOptions;
+
+static TOptions Options = { 32, 128, 8, 10, 4, 3, 64, 8192, 8, 1 };
+
+static unsigned char* pImage;
+static unsigned long* pFat;                /* The FAT, one entry per cluster number. */
+static unsigned long ClusterCount;
+static unsigned long ClusterSize;
+static unsigned long NextCluster = 2;
+static unsigned long DataSector;           /* The first sector of cluster 2. */
+static unsigned long Random;
+static unsigned long Directories;
+static unsigned long Files;
+static unsigned long Fragments;
+
+static void OutOfMemory(void)
+{
+  fprintf(stderr, "Out of memory.\n");
+  exit(EXIT_FAILURE);
+}
+
+/* xorshift32, which gives the same sequence on every platform. */
+static unsigned long NextRandom(void)
+{
+  Random ^= (Random << 13) & 0xFFFFFFFFUL;
+  Random ^= Random >> 17;
+  Random ^= (Random << 5) & 0xFFFFFFFFUL;
+  return Random;
+}
+
+static void Put16(unsigned char* p, unsigned long Value)
+{
+  p[0] = (unsigned char)Value;
+  p[1] = (unsigned char)(Value >> 8);
+}
+
+static void Put32(unsigned char* p, unsigned long Value)
+{
+  Put16(p, Value & 0xFFFF);
+  Put16(p + 2, (Value >> 16) & 0xFFFF);
+}
+
+static unsigned char* GetCluster(unsigned long Cluster)
+{
+  return pImage + (DataSector + (Cluster - 2) * Options.SectorsPerCluster) * SECTOR_SIZE;
+}
+
+static unsigned long GetClusters(unsigned long Bytes)
+{
+  return (Bytes + ClusterSize - 1) / ClusterSize;
+}
+
+/* Allocates a chain of Count clusters and returns its first cluster. */
+static unsigned long Allocate(unsigned long Count)
+{
+  unsigned long First = 0;
+  unsigned long Prev = 0;
+  unsigned long I;
+
+  for (I = 0; I < Count; I++)
+  {
+    while ((NextCluster < ClusterCount + 2) && (pFat[NextCluster] != 0)) NextCluster++;
+    if (NextCluster >= ClusterCount + 2)
+    {
+      fprintf(stderr, "The image is full. Use a larger size or fewer files.\n");
+      exit(EXIT_FAILURE);
+    }
+    pFat[NextCluster] = END_OF_CHAIN;
+    if (Prev == 0)
+    {
+      First = NextCluster;
+    }
+    else
+    {
+      pFat[Prev] = NextCluster;
+      if (NextCluster != Prev + 1) Fragments++;
+    }
+    Prev = NextCluster++;
+
+    if (NextRandom() % 100 < Options.Fragmentation)
+    {
+      NextCluster += 1 + NextRandom() % 3;
+    }
+  }
+  return First;
+}
+
+/* Copies Size bytes to a cluster chain. */
+static void WriteChain(unsigned long Cluster, const unsigned char* pData, unsigned long Size)
+{
+  for (; Size > 0; Cluster = pFat[Cluster])
+  {
+    const unsigned long Length = (Size < ClusterSize) ? Size : ClusterSize;
+
+    memcpy(GetCluster(Cluster), pData, Length);
+    pData += Length;
+    Size -= Length;
+  }
+}
+
+/* Fills the clusters of a file with a pattern that depends on the file. */
+static void WriteFile(unsigned long Cluster, unsigned long Size, unsigned long Tag)
+{
+  unsigned long Offset;
+
+  for (Offset = 0; Offset < Size; Offset += ClusterSize, Cluster = pFat[Cluster])
+  {
+    unsigned char* const pData = GetCluster(Cluster);
+    unsigned long I;
+
+    for (I = 0; (I < ClusterSize) && (Offset + I < Size); I++)
+    {
+      pData[I] = (unsigned char)((Offset + I) * 7 + Tag);
+    }
+  }
+}
+
+/* pName holds the 11 characters of an 8.3 name. */
+static void SetEntry(unsigned char* pEntry, const char* pName, unsigned char Attributes, unsigned long Cluster, unsigned long Size)
+{
+  memcpy(pEntry, pName, 11);
+  pEntry[11] = Attributes;
+  Put16(pEntry + 20, (Cluster >> 16) & 0xFFFF);
+  Put16(pEntry + 26, Cluster & 0xFFFF);
+  Put32(pEntry + 28, Size);
+}
+
+/* The number of entries of a directory at the given level. */
+static unsigned long GetEntryCount(unsigned int Level)
+{
+  const unsigned long SubDirectories = (Level < Options.Depth) ? Options.FanOut : 0;
+
+  return (Level == 0) ? (2 + SubDirectories) : (2 + Options.FilesPerDirectory + SubDirectories);
+}
+
+/* Fills the entries of a directory and creates its files and
+ * subdirectories. The root directory, at level zero, has a volume label and
+ * BIG.DAT instead of dot entries and files.
+ */
+static void FillDirectory(unsigned char* pEntries, unsigned long Cluster, unsigned long ParentCluster, unsigned int Level)
+{
+  unsigned int I;
+  char Name[12];
+
+  if (Level == 0)
+  {
+    const unsigned long BigSize = Options.BigFileMB * 1024 * 1024;
+    const unsigned long BigCluster = (BigSize != 0) ? Allocate(GetClusters(BigSize)) : 0;
+
+    WriteFile(BigCluster, BigSize, 0);
+    SetEntry(pEntries, "BENCH      ", 0x08, 0, 0);
+    SetEntry(pEntries + ENTRY_SIZE, "BIG     DAT", 0x20, BigCluster, BigSize);
+  }
+  else
+  {
+    SetEntry(pEntries, ".          ", 0x10, Cluster, 0);
+    SetEntry(pEntries + ENTRY_SIZE, "..         ", 0x10, ParentCluster, 0);
+
+    for (I = 0; I < Options.FilesPerDirectory; I++)
+    {
+      const unsigned long Size = NextRandom() % (Options.MaxFileSize + 1);
+      const unsigned long FileCluster = (Size != 0) ? Allocate(GetClusters(Size)) : 0;
+
+      WriteFile(FileCluster, Size, Files);
+      sprintf(Name, "F%05u  DAT", I % 100000);
+      SetEntry(pEntries + (2 + I) * ENTRY_SIZE, Name, 0x20, FileCluster, Size);
+      Files++;
+    }
+  }
+  pEntries += (2 + ((Level == 0) ? 0 : Options.FilesPerDirectory)) * ENTRY_SIZE;
+
+  if (Level >= Options.Depth) return;
+
+  for (I = 0; I < Options.FanOut; I++)
+  {
+    const unsigned long Size = GetClusters(GetEntryCount(Level + 1) * ENTRY_SIZE) * ClusterSize;
+    const unsigned long SubCluster = Allocate(Size / ClusterSize);
+    unsigned char* const pSubEntries = (unsigned char*)calloc(1, Size);
+
+    if (pSubEntries == NULL) OutOfMemory();
+
+    /* ".." of a directory in the root directory holds cluster zero. */
+    FillDirectory(pSubEntries, SubCluster, (Level == 0) ? 0 : Cluster, Level + 1);
+    WriteChain(SubCluster, pSubEntries, Size);
+    free(pSubEntries);
+
+    sprintf(Name, "D%-7u   ", I % 10000);
+    SetEntry(pEntries + I * ENTRY_SIZE, Name, 0x10, SubCluster, 0);
+    Directories++;
+  }
+}
+
+static void Usage(const char* pProgram)
+{
+  fprintf(stderr,
+          "Usage: %s [options] <image>\n"
+          "  -t 16|32   FAT type (%u)\n"
+          "  -s MB      image size (%lu)\n"
+          "  -c N       sectors per cluster (%u)\n"
+          "  -f N       fragmentation, in percent (%u)\n"
+          "  -d N       subdirectories per directory (%u)\n"
+          "  -l N       levels of directories (%u)\n"
+          "  -n N       files per directory (%u)\n"
+          "  -z N       maximum file size, in bytes (%lu)\n"
+          "  -b MB      size of BIG.DAT (%lu)\n"
+          "  -r N       random seed (%lu)\n",
+          pProgram, Options.FatType, Options.SizeMB, Options.SectorsPerCluster, Options.Fragmentation,
+          Options.FanOut, Options.Depth, Options.FilesPerDirectory, Options.MaxFileSize, Options.BigFileMB, Options.Seed);
+  exit(EXIT_FAILURE);
+}
+
+static void ParseOptions(int argc, char* argv[], const char** ppPath)
+{
+  int Arg;
+
+  *ppPath = NULL;
+  for (Arg = 1; Arg < argc; Arg++)
+  {
+    unsigned long Value;
+
+    if (argv[Arg][0] != '-')
+    {
+      if (*ppPath != NULL) Usage(argv[0]);
+      *ppPath = argv[Arg];
+      continue;
+    }
+    if ((argv[Arg][1] == '\0') || (argv[Arg][2] != '\0') || (Arg + 1 >= argc)) Usage(argv[0]);
+
+    Value = strtoul(argv[Arg + 1], NULL, 0);
+    switch (argv[Arg][1])
+    {
+      case 't': Options.FatType = (unsigned int)Value; break;
+      case 's': Options.SizeMB = Value; break;
+      case 'c': Options.SectorsPerCluster = (unsigned int)Value; break;
+      case 'f': Options.Fragmentation = (unsigned int)Value; break;
+      case 'd': Options.FanOut = (unsigned int)Value; break;
+      case 'l': Options.Depth = (unsigned int)Value; break;
+      case 'n': Options.FilesPerDirectory = (unsigned int)Value; break;
+      case 'z': Options.MaxFileSize = Value; break;
+      case 'b': Options.BigFileMB = Value; break;
+      case 'r': Options.Seed = Value; break;
+      default: Usage(argv[0]);
+    }
+    Arg++;
+  }
+
+  if ((*ppPath == NULL) || ((Options.FatType != 16) && (Options.FatType != 32)) ||
+      (Options.SizeMB < 1) || (Options.SizeMB > 2047) ||
+      (Options.SectorsPerCluster == 0) || (Options.SectorsPerCluster > 128) ||
+      ((Options.SectorsPerCluster & (Options.SectorsPerCluster - 1)) != 0) ||
+      (Options.Fragmentation > 100) || (Options.FilesPerDirectory > 100000) ||
+      (Options.FanOut > 10000) || (Options.BigFileMB > 1024))
+  {
+    Usage(argv[0]);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  const char* pPath;
+  unsigned long TotalSectors, PartitionSectors, ReservedSectors, RootSectors, SectorsPerFAT;
+  unsigned long RootSize;
+  unsigned long FreeClusters = 0;
+  unsigned long I;
+  unsigned char* pVolumeID;
+  unsigned char* pRoot;
+  unsigned int Copy;
+  FILE* pFile;
+
+  ParseOptions(argc, argv, &pPath);
+  Random = (Options.Seed & 0xFFFFFFFFUL) ? (Options.Seed & 0xFFFFFFFFUL) : 1;
+  ClusterSize = (unsigned long)Options.SectorsPerCluster * SECTOR_SIZE;
+
+  /* Size the FAT for the clusters that remain after it. */
+  TotalSectors = Options.SizeMB * 2048;
+  PartitionSectors = TotalSectors - PARTITION_LBA;
+  ReservedSectors = (Options.FatType == 32) ? 32 : 1;
+  RootSectors = (Options.FatType == 32) ? 0 : FAT16_ROOT_ENTRIES * ENTRY_SIZE / SECTOR_SIZE;
+  SectorsPerFAT = 1;
+  for (;;)
+  {
+    const unsigned long EntriesPerSector = SECTOR_SIZE / (Options.FatType / 8);
+    unsigned long Needed;
+
+    ClusterCount = (PartitionSectors - ReservedSectors - 2 * SectorsPerFAT - RootSectors) / Options.SectorsPerCluster;
+    Needed = (ClusterCount + 2 + EntriesPerSector - 1) / EntriesPerSector;
+    if (Needed <= SectorsPerFAT) break;
+    SectorsPerFAT = Needed;
+  }
+  if ((Options.FatType == 16) ? ((ClusterCount < 4085) || (ClusterCount > 65524)) : (ClusterCount < 65525))
+  {
+    fprintf(stderr, "%lu clusters is not valid for FAT%u. Change the size or the cluster size.\n", ClusterCount, Options.FatType);
+    return EXIT_FAILURE;
+  }
+
+  RootSize = GetEntryCount(0) * ENTRY_SIZE;
+  if ((Options.FatType == 16) && (RootSize > FAT16_ROOT_ENTRIES * ENTRY_SIZE))
+  {
+    fprintf(stderr, "The FAT16 root directory holds at most %u subdirectories.\n", FAT16_ROOT_ENTRIES - 2);
+    return EXIT_FAILURE;
+  }
+  RootSize = (Options.FatType == 16) ? (FAT16_ROOT_ENTRIES * ENTRY_SIZE) : (GetClusters(RootSize) * ClusterSize);
+
+  pImage = (unsigned char*)calloc(TotalSectors, SECTOR_SIZE);
+  pFat = (unsigned long*)calloc(ClusterCount + 2, sizeof(unsigned long));
+  pRoot = (unsigned char*)calloc(1, RootSize);
+  if ((pImage == NULL) || (pFat == NULL) || (pRoot == NULL)) OutOfMemory();
+
+  pFat[0] = 0x0FFFFFF8UL;
+  pFat[1] = END_OF_CHAIN;
+  DataSector = PARTITION_LBA + ReservedSectors + 2 * SectorsPerFAT + RootSectors;
+
+  /* MBR */
+  pImage[446 + 4] = (unsigned char)((Options.FatType == 32) ? 0x0C : 0x06);
+  Put32(pImage + 446 + 8, PARTITION_LBA);
+  Put32(pImage + 446 + 12, PartitionSectors);
+  Put16(pImage + 510, 0xAA55);
+
+  /* Volume ID */
+  pVolumeID = pImage + PARTITION_LBA * SECTOR_SIZE;
+  memcpy(pVolumeID, "\xEB\x58\x90MSWIN4.1", 11);
+  Put16(pVolumeID + 11, SECTOR_SIZE);
+  pVolumeID[13] = (unsigned char)Options.SectorsPerCluster;
+  Put16(pVolumeID + 14, ReservedSectors);
+  pVolumeID[16] = 2;
+  Put16(pVolumeID + 17, (Options.FatType == 32) ? 0 : FAT16_ROOT_ENTRIES);
+  Put16(pVolumeID + 19, (PartitionSectors < 65536) ? PartitionSectors : 0);
+  pVolumeID[21] = 0xF8;
+  Put16(pVolumeID + 22, (Options.FatType == 32) ? 0 : SectorsPerFAT);
+  Put16(pVolumeID + 24, 63);
+  Put16(pVolumeID + 26, 255);
+  Put32(pVolumeID + 28, PARTITION_LBA);
+  Put32(pVolumeID + 32, (PartitionSectors < 65536) ? 0 : PartitionSectors);
+  Put16(pVolumeID + 510, 0xAA55);
+
+  /* The directory tree */
+  if (Options.FatType == 32)
+  {
+    const unsigned long RootCluster = Allocate(RootSize / ClusterSize);
+
+    FillDirectory(pRoot, RootCluster, 0, 0);
+    WriteChain(RootCluster, pRoot, RootSize);
+
+    Put32(pVolumeID + 36, SectorsPerFAT);
+    Put32(pVolumeID + 44, RootCluster);
+    Put16(pVolumeID + 48, 1);
+    Put16(pVolumeID + 50, 6);
+    memcpy(pVolumeID + 6 * SECTOR_SIZE, pVolumeID, SECTOR_SIZE);
+  }
+  else
+  {
+    FillDirectory(pRoot, 0, 0, 0);
+    memcpy(pImage + (DataSector - RootSectors) * SECTOR_SIZE, pRoot, RootSize);
+  }
+  free(pRoot);
+
+  /* Both FATs */
+  for (I = 0; I < ClusterCount + 2; I++)
+  {
+    for (Copy = 0; Copy < 2; Copy++)
+    {
+      unsigned char* const pFatSector = pImage + (PARTITION_LBA + ReservedSectors + Copy * SectorsPerFAT) * SECTOR_SIZE;
+
+      if (Options.FatType == 32)
+      {
+        Put32(pFatSector + I * 4, pFat[I]);
+      }
+      else
+      {
+        Put16(pFatSector + I * 2, pFat[I] & 0xFFFF);
+      }
+    }
+    if (pFat[I] == 0) FreeClusters++;
+  }
+
+  /* FSInfo */
+  if (Options.FatType == 32)
+  {
+    unsigned char* const pFSInfo = pVolumeID + SECTOR_SIZE;
+
+    Put32(pFSInfo, 0x41615252UL);
+    Put32(pFSInfo + 484, 0x61417272UL);
+    Put32(pFSInfo + 488, FreeClusters);
+    Put32(pFSInfo + 492, (NextCluster < ClusterCount + 2) ? NextCluster : 2);
+    Put16(pFSInfo + 510, 0xAA55);
+  }
+
+  pFile = fopen(pPath, "wb");
+  if ((pFile == NULL) || (fwrite(pImage, SECTOR_SIZE, TotalSectors, pFile) != TotalSectors) || (fclose(pFile) != 0))
+  {
+    fprintf(stderr, "Can not write %s.\n", pPath);
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: FAT%u, %lu clusters of %lu bytes, %lu free, %lu directories, %lu files, %lu fragments\n",
+         pPath, Options.FatType, ClusterCount, ClusterSize, FreeClusters, Directories, Files, Fragments);
+
+  free(pFat);
+  free(pImage);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,77 @@
+/* Enables support for FAT32 */
+#define FAT_ENABLE_FAT32
+
+/* Enables support for FAT16 */
+#define FAT_ENABLE_FAT16
+
+/* Enables write support */
+#define FAT_ENABLE_WRITE
+
+/* Enables the sector cache and sets the number of sectors it can hold 
+ * (1-254). The memory for the cached sectors is supplied by the 
+ * application, see TFatCache. */
+/* #define FAT_CACHE_SECTORS 8 */
+
+/* Makes the sector cache write-back instead of write-through. Modified
+ * sectors are then kept in the cache until they are evicted or until
+ * FAT_Flush is called. Requires FAT_CACHE_SECTORS. */
+/* #define FAT_CACHE_WRITE_BACK */
+
+/* Enables the in-memory FAT table, which holds all or part of the first
+ * FAT in memory supplied by the application, see TFatTable. Following a
+ * cluster chain then normally needs no disk access. */
+/* #define FAT_ENABLE_FAT_TABLE */
+
+/* Enables extent maps, which store a cluster chain as runs of consecutive
+ * clusters for fast seeking within large files, see FAT_BuildExtentMap. */
+/* #define FAT_ENABLE_EXTENTS */
+
+/* Enables the free-cluster bitmap, which is built from the FAT on the 
+ * first allocation and then searched instead of the FAT. The memory is 
+ * supplied by the application, see FAT_FindFreeCluster. Requires 
+ * FAT_ENABLE_WRITE. */
+/* #define FAT_ENABLE_FREE_MAP */
+
+/* Enables the directory name index and sets the number of names it can
+ * hold per directory (a power of two). FAT_DIR_INDEX_DIRECTORIES sets the
+ * number of directories that are indexed at the same time. The memory is
+ * supplied by the application, see TFatNameIndex. */
+/* #define FAT_DIR_INDEX_ENTRIES 1024 */
+/* #define FAT_DIR_INDEX_DIRECTORIES 4 */
+
+/* Enables the path lookup cache used by FAT_OpenPath and sets the number
+ * of directory entries it remembers (1-254), see TFatPathCache. */
+/* #define FAT_PATH_CACHE_ENTRIES 16 */
+
+/* Enables the free directory entry hints used by FAT_CreateDirEntry and
+ * sets the number of directories they are kept for, see TFatDirHints. 
+ * Requires FAT_ENABLE_WRITE. */
+/* #define FAT_DIR_HINT_ENTRIES 4 */
+
+/* Enables the locks for sharing a volume between threads, see TFatLock
+ * and FAT_ClonePartition. */
+/* #define FAT_ENABLE_THREADS */
+
+/* Enables the I/O statistics: the sectors read and written per disk
+ * region, the sector loads served without reading the device, a latency
+ * histogram of the device calls and a trace hook, see TFatStats. Without
+ * it, the statistics code is left out entirely. */
+/* #define FAT_ENABLE_STATS */
+
+/* Enables the trace recorder, which writes the device requests to a 
+ * compact binary trace through the trace hook of the I/O statistics, see
+ * FAT_RecordTrace. Requires FAT_ENABLE_STATS. */
+/* #define FAT_ENABLE_TRACE */
+
+/* Disables the SSE2/AVX2 versions of the FAT scanning functions, which 
+ * are otherwise used when the compiler targets these instruction sets. */
+/* #define FAT_DISABLE_SIMD */
+
+/* Enables debug printouts. */
+#define FAT_DEBUG
+
+/* Set this if you have a single "source code file" project and
+ * include "fat.c" in a .c-file. Recommended for embedded
+ * systems since it will decrease the code size. */
+/* #define FAT_SINGLE_FILE */
+
@@ -1,688 +1,1456 @@
-#ifndef FAT_H_INCLUSION_GUARD
-#define FAT_H_INCLUSION_GUARD
-
-/**
- * @defgroup Partition Partition handling.
- * @defgroup Dir Directory handling.
- * @defgroup FAT File Allocation Table handling.
- * @defgroup General General.
- */
-
-#if defined(__GNUC__)
-#include <stdint.h>
-#elif defined(_MSC_VER)
-typedef signed char 	int8_t;
-typedef unsigned char 	uint8_t;
-typedef signed short 	int16_t;
-typedef unsigned short 	uint16_t;
-typedef signed long int 	int32_t;
-typedef unsigned long int 	uint32_t;
-#endif
-
-#include "../fat_conf.h"
-
-#if !defined(FAT_ENABLE_FAT32) && !defined(FAT_ENABLE_FAT16)
-#error Neither FAT16 nor FAT32 support is enabled!
-#endif
-
-#if defined(FAT_ENABLE_FAT16) && defined(FAT_ENABLE_FAT32)
-/**
- * @brief This identifier is defined if both FAT16 and FAT32 support is enabled.
- */
-#define FAT_ENABLE_BOTH
-#endif
-
-#ifdef FAT_ENABLE_FAT32
-/** 
- * @brief Identifies a cluster number.
- * @ingroup General
- */
-typedef uint32_t TFatClusterNr;
-#else
-typedef uint16_t TFatClusterNr;
-#endif
-
-/**
- * @brief The partition type
- * @see FAT_IsFAT16, FAT_IsFAT32, FAT_GetPartitionType
- * @ingroup Partition
- */
-typedef enum {
-  FAT_16,  /**< A FAT16 Partition */
-  FAT_32   /**< A FAT32 Partition */
-} TFatPartitionType;
-
-/**
- * @brief Partition information
- * @see FAT_OpenPartition
- * @ingroup Partition
- */
-typedef struct {
-  uint8_t*          pBuffer;               /**< A pointer to a buffer large enough for a disk sector. Must be specified by the application. */
-  uint32_t          PartitionLBA;          /**< The offset where the partition data begins - in clusters. */
-#ifdef FAT_ENABLE_BOTH
-  TFatPartitionType Type;                  /**< The partition type (FAT_16 or FAT_32). */ 
-#endif
-  uint8_t           SectorsPerCluster;     /**< The number of sectors per cluster. */
-  uint16_t          ReservedSectors;       /**< The number of reserved sectors. */
-  uint32_t          SectorsPerFAT;         /**< The number of sectors per FAT table. */
-  uint16_t          RootDirectoryEntries;  /**< The number of root directory entries. Will be zero (0) for a  FAT32 partition. */
-} TFatPartition;
-
-/**
- * @brief Identifies a sector location on the disk
- * @ingroup Partition
- */
-typedef struct {
-  uint32_t          Sector;                /**< The current sector. */
-  TFatClusterNr     Cluster;               /**< The current cluster. */
-  uint8_t           SectorsLeftInCluster;  /**< The number of sectors left in the cluster, excluding the one in this structure. */
-} TFatLocation;
-
-/**
- * @brief Identifies a directory entry location on the disk
- * @see FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR
- * @ingroup Dir
- */
-typedef struct {
-  TFatLocation Location;                   /**< The sector it is located in. */
-  uint8_t      EntryOffset;                /**< The entry offset, ranging from 0 to FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR. */
-} TFatDirectoryLocation;
-
-/**
- * @brief Directory entry information.
- * @see FAT_CreateDirEntry, FAT_CreateRootDirEntry, FAT_FindDirEntry, FAT_FindRootDirEntry
- * @see Dir
- */
-typedef struct {
-  uint8_t Name[11];             /**< The directory entry name. */
-  uint8_t Attributes;           /**< Attributes */
-  uint8_t ReservedNT;           /**< Reserved. */
-  uint8_t CreationTimeTenth;    /**< The creation time, in 10ms units. Valid values are 0-199*/           
-  uint16_t CreationTime;        /**< The creation time. */
-  uint16_t CreationDate;        /**< The creation date. */
-  uint16_t LastAccessDate;      /**< Last access date. */
-  uint16_t StartClusterHigh;    /**< The upper 16 bits of the start cluster address. Will be zero for FAT16. */
-  uint16_t ModicationTime;      /**< Modification time. */
-  uint16_t ModificationDate;    /**< Modification date. */
-  uint16_t StartClusterLow;     /**< The lower 16 bits of teh start cluster address. */
-  uint32_t FileSize;            /**< The size of the file, in bytes. */
-} TFatDirEntry;
-
-/**
- * @brief The number of FAT tables.
- * @ingroup Partition
- */
-#define FAT_NUMBER_OF_FATS (2)
-
-/**
- * @brief The number of bytes per sector.
- * @ingroup Partition
- */
-#define FAT_BYTES_PER_SECTOR (512)
-
-/**
- * @brief The size of a directory entry.
- * @ingroup Dir
- */
-#define FAT_DIRECTORY_ENTRY_SIZE (sizeof(TFatDirEntry))
-
-/**
- * @brief The number of directory entries per sector.
- * @ingroup Dir
- */
-#define FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR (FAT_BYTES_PER_SECTOR / FAT_DIRECTORY_ENTRY_SIZE)
-
-/**
- * @brief The number of FAT entries per sector for FAT16.
- * @ingroup FAT
- */
-#define FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR (FAT_BYTES_PER_SECTOR / sizeof(uint16_t))
-
-/**
- * @brief The number of FAT entries per sector for FAT32.
- * @ingroup FAT
- */
-#define FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR (FAT_BYTES_PER_SECTOR / sizeof(uint32_t))
-
-#if defined(FAT_ENABLE_FAT16) && !defined(FAT_ENABLE_FAT32)
-#define FAT_IsFAT16(pPartition) (1)
-#define FAT_IsFAT32(pPartition) (0)
-#define FAT_Cond(pPartition, Fat16Expr,Fat32Expr) (Fat16Expr)
-#elif !defined(FAT_ENABLE_FAT16) && defined(FAT_ENABLE_FAT32)
-#define FAT_IsFAT16(pPartition) (0)
-#define FAT_IsFAT32(pPartition) (1)
-#define FAT_Cond(pPartition, Fat16Expr,Fat32Expr) (Fat32Expr)
-#else
-
-/**
- * @brief Indicates if the current partition is a FAT16 partition.
- * @param pPartition The current partition.
- * @return TRUE of the partition is a FAT16 partition. FALSE otherwise.
- * @ingroup Partition
- */
-#define FAT_IsFAT16(pPartition) ((pPartition)->Type == FAT_16)
-
-/**
- * @brief Indicates if the current partition is a FAT32 partition.
- * @param pPartition The current partition.
- * @return TRUE of the partition is a FAT32 partition. FALSE otherwise.
- * @ingroup Partition
- */
-#define FAT_IsFAT32(pPartition) ((pPartition)->Type != FAT_16)
-
-#define FAT_Cond(pPartition, Fat16Expr,Fat32Expr) (FAT_IsFAT16(pPartition) ? (Fat16Expr) : (Fat32Expr))
-#endif
-
-#ifdef FAT_SINGLE_FILE
-#define FAT_API static
-#else
-#define FAT_API
-#endif
-
-#ifdef FAT_ENABLE_FAT16
-#include "fat16.h"
-#endif
-
-#ifdef FAT_ENABLE_FAT32
-#include "fat32.h"
-#endif
-
-/* These are valid when the MBR is in the buffer */
-
-/**
- * @brief Returns the logical block address of the partition's first sector.
- * @param pMBR A pointer to the contents of the master boot record.
- * @param PartitionNr The partition number, ranging from 0 to 3.
- * @return The logical block address of the first sector in the partition.
- * @ingroup Partition
- */
-#define FAT_GetPartitionLBA(pMBR, PartitionNr) *(uint32_t*)(pMBR + 446 + PartitionNr*16 + 8)
-
-/**
- * @brief Returns the partition type.
- * @param pMBR A pointer to the contents of the master boot record.
- * @param PartitionNr The partition number, ranging from 0 to 3.
- * @return The partition type.
- * @ingroup Partition
- */
-#define FAT_GetPartitionType(pMBR, PartitionNr) *(pMBR + 446 + PartitionNr*16 + 4)
-
-/**
- * @brief Returns the partition length, in sectors.
- * @param pMBR A pointer to the contents of the master boot record.
- * @param PartitionNr The partition number, ranging from 0 to 3.
- * @return The number of sectors in the partition.
- * @ingroup Partition
- */
-#define FAT_GetPartitionLength(pMBR, PartitionNr) *(uint32_t*)(pMBR + 446 + PartitionNr*16 + 12)
-
-/**
- * @brief Indicates if the partition is bootable.
- * @param pMBR A pointer to the contents of the master boot record.
- * @param PartitionNr The partition number, ranging from 0 to 3.
- * @return TRUE if the partition is bootable. FALSE otherwise.
- * @ingroup Partition
- */
-#define FAT_IsPartitionBootable(pMBR, PartitionNr) (*(pMBR + 446 + PartitionNr*16 + 0) == 0x80)
-
-/**
- * @brief Indicates if the master boot record is valid.
- * @param pMBR A pointer to the contents of the master boot record.
- * @return TRUE if the master boot record is valid. FALSE otherwise.
- * @ingroup Partition
- */
-#define FAT_IsMBRValid(pMBR) (*(uint16_t*)(pMBR + 510) == 0xAA55)
-
-/**
- * @brief Returns the number of sectors per cluster.
- * @param pVolumeID A pointer to the contents of the Volume ID sector.
- * @return The number of sectors per cluster.
- * @ingroup Partition
- */
-#define FAT_GetSectorsPerCluster(pVolumeID) *(pVolumeID + 0xd)
-
-/**
- * @brief Returns the number of reserved sectors.
- * @param pVolumeID A pointer to the contents of the Volume ID sector.
- * @return The number of reserved sectors.
- * @ingroup Partition
- */
-#define FAT_GetReservedSectors(pVolumeID) *(uint16_t*)(pVolumeID + 0xe)
-
-/**
- * @note The rest of the implementation only supports two (2) tables. According to
- *       the specification, no other value should ever be used.
- * @brief Returns the number of FAT tables.
- * @param pVolumeID A pointer to the contents of the Volume ID sector.
- * @return The number of FAT tables.
- * @ingroup FAT
- */
-#define FAT_GetNrOfFATs(pVolumeID) *(pVolumeID + 0x10)
-
-/**
- * @note This value is only used for FAT16. For FAT32, this will always be zero (0).
- * @brief Returns the number of root directory entries.
- * @param pVolumeID A pointer to the contents of the Volume ID sector.
- * @return The number of root directory entries.
- * @ingroup Dir
- */
-#define FAT_GetRootDirectoryEntries(pVolumeID) *(uint16_t*)(pVolumeID + 0x11)
-
-/**
- * @brief Returns the number of sectors per FAT table.
- * @param pPartition The current partition
- * @return The number of sectors per FAT table.
- * @ingroup FAT
- */
-#define FAT_GetSectorsPerFAT(pPartition) (FAT_Cond(pPartition, (uint32_t)FAT16_GetSectorsPerFAT(pPartition->pBuffer), FAT32_GetSectorsPerFAT(pPartition->pBuffer)))
-
-/**
- * @brief Returns the sector number where the FAT table is located.
- * @param pPartition The current partition.
- * @return The sector number where the FAT table is located
- * @ingroup FAT
- */
-#define FAT_GetFATSector(pPartition) (pPartition->PartitionLBA + pPartition->ReservedSectors)
-
-#define ATTR_READ_ONLY 0x01
-#define ATTR_HIDDEN    0x02
-#define ATTR_SYSTEM    0x04
-#define ATTR_VOLUME_ID 0x08
-#define ATTR_DIRECTORY 0x10
-#define ATTR_ARCHIVE   0x20
-#define ATTR_LONG_NAME (ATTR_READ_ONLY | ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID)
-
-/**
- * @brief Returns a pointer to the directory entry information
- * @param pPartition   The current partition.
- * @param pDirLocation The directory entry location information.
- * @return A pointer to the directory entry information.
- * @ingroup Dir
- *
- * @see TFatDirEntry
- */
-#define FAT_GetDirEntry(pPartition, pDirLocation) ((TFatDirEntry*)((pPartition)->pBuffer + ((pDirLocation)->EntryOffset * FAT_DIRECTORY_ENTRY_SIZE)))
-
-/**
- * @note Long file name entries should be ignored, since they are not supported.
- * @brief Indicates if the directory entry is a long file name entry.
- * @param pDirEntry The directory entry information.
- * @return TRUE if the entry is a long file name entry. FALSE otherwise.
- * @ingroup Dir
- */
-#define FAT_IsLongFileName(pDirEntry) ((uint8_t)(pDirEntry->Attributes & 0x0F) == (uint8_t)ATTR_LONG_NAME)
-
-/* To use these, you'll first have to make sure the entry is not a long file name. */
-/**
- * @note This function can only be called when it is determined 
- *       that the entry is not a long file name entry.
- * @brief Indicates if the directory entry represents a file.
- * @param pDirEntry The directory entry information.
- * @return TRUE if the entry is a file. FALSE otherwise.
- * @ingroup Dir
- */
-#define FAT_IsFile(pDirEntry) (((uint8_t)(pDirEntry->Attributes & (ATTR_VOLUME_ID | ATTR_DIRECTORY))) == 0)
-
-/**
- * @note This function can only be called when it is determined 
- *       that the entry is not a long file name entry.
- * @brief Indicates if the directory entry represents a directory.
- * @param pDirEntry The directory entry information.
- * @return TRUE if the entry is a directroy. FALSE otherwise.
- * @ingroup Dir
- */
-#define FAT_IsDirectory(pDirEntry) (uint8_t)(pDirEntry->Attributes & ATTR_DIRECTORY)
-
-/**
- * @note This function can only be called when it is determined 
- *       that the entry is not a long file name entry.
- * @brief Indicates if the directory entry represents a volume identifier.
- * @param pDirEntry The directory entry information.
- * @return TRUE if the entry is a volume identifier. FALSE otherwise.
- * @ingroup Dir
- */
-#define FAT_IsVolumeID(pDirEntry) (uint8_t)(pDirEntry->Attributes & ATTR_VOLUME_ID)
-
-/**
- * @note This function can only be called when it is determined 
- *       that the entry is not a long file name entry.
- * @brief Indicates if the directory entry is write protected.
- * @param pDirEntry The directory entry information.
- * @return TRUE if the entry is write protected. FALSE otherwise.
- * @ingroup Dir
- */
-#define FAT_IsReadOnly(pDirEntry) (uint8_t)(pDirEntry->Attributes & ATTR_READ_ONLY)
-
-
-#ifdef FAT_ENABLE_FAT32
-/* The FAT32 variant works for FAT16 as well */
-/**
- * @note This function can only be called when it is determined 
- *       that the entry is not a long file name entry.
- * @brief Returns the start address, in clusters, of the directory entry.
- * @param pDirEntry The directory entry information.
- * @return The cluster start address of the entry.
- * @ingroup Dir
- */
-#define FAT_GetStartCluster(pDirEntry) FAT32_GetStartCluster(pDirEntry)
-#else
-#define FAT_GetStartCluster(pDirEntry) FAT16_GetStartCluster(pDirEntry)
-#endif
-
-/**
- * @note This function can only be called when it is determined 
- *       that the entry is not a long file name entry.
- * @brief Indicates if the directory entry has been deleted.
- * @param pDirEntry The directory entry information.
- * @return TRUE if the entry has been deleted. FALSE otherwise.
- * @ingroup Dir
- */
-#define FAT_IsDirEntryDeleted(pDirEntry) (pDirEntry->Name[0] == 0xE5)
-
-/**
- * @note If this function returns TRUE, the entry must not be examined
- *       further, since it is not valid.
- * @brief Indicates if the directory entry is the last entry.
- * @param pPartition    The current partition.
- * @param pDirEntry     The directory entry information.
- * @param pDirLocation  The directory entry location.
- * @return TRUE if the entry is the last entry in the directory.
- * @ingroup Dir
- */
-#define FAT_IsLastDirEntry(pPartition, pDirEntry, pDirLocation) ((pDirEntry->Name[0] == 0x00) || !FAT_IsCurrentClusterValid(pPartition, &(pDirLocation)->Location))
-#define FAT_IsCurrentClusterValid(pPartition, pLocation) (FAT_Cond(pPartition, FAT16_IsCurrentClusterValid(pPartition, pLocation), FAT32_IsCurrentClusterValid(pPartition, pLocation)))
-
-/**
- * Seeks to the cluster specified. After this call, FAT_ReadSector
- * or FAT_WriteSector may be called with pLocation->Sector as the sector
- * to operate on. 
- *
- * @note Only pLocation will be updated - the sector buffer will not be touched.
- *
- * @brief Returns the first sector of the specified cluster.
- * @param pPartition The current partition.
- * @param pLocation The information about the new location.
- * @param ClusterNr The cluster number to seek to.
- * @return Nothing.
- * @ingroup General
- *
- * @see FAT_ReadSector, FAT_WriteSector
- */
-FAT_API void FAT_Seek(const TFatPartition* pPartition, TFatLocation* pLocation, TFatClusterNr ClusterNr);
-
-/**
- * @brief Returns the cluster number that follows the given cluster number in the FAT table.
- * @param pPartition The current partition.
- * @param CurrentCluster The current cluster.
- * @return The cluster following the given cluster.
- * @ingroup FAT
- * 
- * @see FAT_ReadNextCluster
- */
-#define FAT_GetNextCluster(pPartition, CurrentCluster) (FAT_Cond(pPartition, FAT16_GetNextCluster(pPartition, CurrentCluster), FAT32_GetNextCluster(pPartition, CurrentCluster)))
-
-/**
- * Opens a FAT partition.
- *
- * If the function indicates a failure, this can be due to an invalid master boot
- * record, an invalid partition type (Only FAT16 and FAT32 is supported, depending 
- * on configuration) or other problems.
- *
- * Only partitions 0-3 are valid.
- *
- * pPartition->pBuffer must be set prior to calling this function and should
- * point to a buffer, large enough for a disk sector (512 bytes). Other 
- * members in this structure will be written by this function and their original
- * values are ignored.
- *
- * This function must be called before using any other function.
- *
- * @brief Opens a FAT partition.
- * @param pPartition The current partition. 
- * @param PartitionNr The partition number to open.
- * @return 1 on success, 0 on failure.
- * @ingroup Partition
- */
-FAT_API uint8_t FAT_OpenPartition(TFatPartition* pPartition, uint8_t PartitionNr);
-
-/**
- * @note The next clusters in the cluster chain can be read
- *       using FAT_ReadNextSector
- *
- * @brief Reads the first cluster of a cluster chain.
- * @param pPartition The current partition.
- * @param pLocation The current location.
- * @return Nothing.
- * @ingroup General
- */
-#define FAT_ReadFirstSector(pPartition, pLocation) FAT_ReadSector(pPartition, pLocation->Sector)
-
-/**
- * @note After a call to FAT_Seek, the first sector in the cluster
- * must be read by calling FAT_ReadFirstSector.
- * The following sectors can be read using this function.
- *
- * @brief Reads the next sector, following the cluster chain. 
- * @param pPartition The currently active partition.
- * @param pLocation The current location.
- * @return Nothing.
- * @ingroup General
- *
- * @see FAT_Seek, FAT_ReadFirstSector
- */ 
-FAT_API void FAT_ReadNextSector(TFatPartition* pPartition, TFatLocation* pLocation);
-
-/**
- * On exit, FAT_IsLastDirectoryEntry should be called to see if
- * an entry is found. To see if the entry is valid, FAT_IsDirEntryDeleted
- * should be called.
- *
- * To iterate to the next directory entry, FAT_GetNextDirectoryEntry should 
- * be used. Note that it's important to preserve pDirLocation 
- * between these calls.
- *
- * To find the first directory of the root directory, use
- * FAT_GetFirstRootDirectory instead.
- *
- * @brief Finds the first directory entry in the directory that starts at 'StartCluster'.
- * @param pPartition   The current partition.
- * @param StartCluster The cluster where the directory starts.
- * @param pDirLocation Contains information about the currently examined directory entry. The initial values are ignored.
- * @return Nothing.
- * @ingroup Dir
- *
- * @see FAT_GetNextDirectoryEntry, FAT_IsLastDirectoryEntry, FAT_IsDirEntryDeleted FAT_GetFirstRootDirEntry
- */
-FAT_API void FAT_GetFirstDirectoryEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation);
-
-/**
- * Iterates to the next Directory Entry. FAT_GetFirstDirectoryEntry
- * must have been called prior to calling this function. 
- *
- * To iterate a root directory, use FAT_GetNextRootDirEntry
- * instead. 
- *
- * It is important to preserve the contents of pDirLocation between calls
- * to this function.
- *
- * On exit, FAT_IsLastDirectoryEntry should be called to see if
- * an entry is found. To see if the entry is valid, FAT_IsDirEntryDeleted
- * should be called.
- *
- * @brief Iterates to the next directory entry.
- * @param pPartition The current partition.
- * @param pDirLocation Contains information about the currently examined directory entry. The initial values are ignored.
- * @return Nothing.
- * @ingroup Dir
- *
- * @see FAT_GetFirstDirectoryEntry, FAT_IsLastDirectoryEntry, FAT_IsDirEntryDeleted FAT_GetNextRootDirEntry
- */
-FAT_API void FAT_GetNextDirectoryEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
-
-/**
- * Only valid (i.e. not deleted) entries will be searched for and long file names are not supported.
- *
- * pDirLocation will contain the information where the entry is located on success. On failure,
- * its contents will be overwritten. The initial values are ignored.
- *
- * The name specified should be in 8.3 format. Example: "README  TXT". 
- *
- * To find a root directory entry, use FAT_FindRootDirEntry.
- *
- * @brief Finds the directory entry specified.
- * @param pPartition       The current partition.
- * @param DirectoryCluster The first cluster of the directory to be searched.
- * @param pName            The name of the directory entry to match. The name should be in 8.3 format and
- *                         does not have to be null-terminated.
- * @param pDirLocation     Information where the directory entry is located.
- * @return A pointer to the entry information on success. Will be NULL if the entry was not found.
- * @ingroup Dir
- */
-FAT_API TFatDirEntry* FAT_FindDirEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, char* pName, TFatDirectoryLocation* pDirLocation);
-
-
-/**
- * On exit, FAT_IsLastDirectoryEntry should be called to see if
- * an entry is found. To see if the entry is valid, FAT_IsDirEntryDeleted
- * should be called.
- *
- * To iterate to the next directory entry, FAT_GetNextRootDirectoryEntry should 
- * be used. Note that it's important to preserve pDirLocation 
- * between these calls.
- *
- * @brief Finds the first root directory entry
- * @param pPartition   The current partition.
- * @param pDirLocation Contains information about the currently examined directory entry. The initial values are ignored.
- * @return Nothing.
- * @ingroup Dir
- *
- * @see FAT_GetNextRootDirEntry, FAT_IsLastDirectoryEntry, FAT_IsDirEntryDeleted 
- */
-#define FAT_GetFirstRootDirEntry(pPartition, pDirLocation) \
-  (FAT_Cond(pPartition, \
-            FAT16_GetFirstRootDirEntry(pPartition, pDirLocation), \
-            FAT32_GetFirstRootDirEntry(pPartition, pDirLocation)))
-
-/**
- * Only valid (i.e. not deleted) entries will be searched for and long file names are not supported.
- *
- * pDirLocation will contain the information where the entry is located on success. On failure,
- * its contents will be overwritten. The initial values are ignored.
- *
- * The name specified should be in 8.3 format. Example: "README  TXT". 
- *
- * @brief Finds the root directory entry specified.
- * @param pPartition       The current partition.
- * @param pName            The name of the directory entry to match. The name should be in 8.3 format and
- *                         does not have to be null-terminated.
- * @param pDirLocation     Information where the directory entry is located.
- * @return A pointer to the entry information on success. Will be NULL if the entry was not found.
- * @ingroup Dir
- */
-#define FAT_FindRootDirEntry(pPartition, pName, pDirLocation) \
-  (FAT_Cond(pPartition, \
-            FAT16_FindRootDirEntry(pPartition, pName, pDirLocation), \
-            FAT32_FindRootDirEntry(pPartition, pName, pDirLocation)))
-
-#ifdef FAT_ENABLE_WRITE
-/**
- * On success, pDirLocation will contain location information of the new entry. A pointer to the 
- * directory entry structure will also be returned and can be filled out. FAT_WriteSector must
- * be called with pDirLocation->Location.Sector as parameter to finally store the information.
- *
- * On failure, NULL is returned.
- *
- * @brief Create a new Directory Entry to the directory that starts at StartCluster.
- * @param pPartition   The current partition.
- * @param StartCluster The cluster which the directory starts at.
- * @param pDirLocation The location information to the directory entry.
- * @return A pointer to where the directory entry information can be stored, or NULL on failure.
- * @ingroup Dir
- *
- * @see FAT_WriteSector
- */
-FAT_API TFatDirEntry* FAT_CreateDirEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation);
-
-/**
- * On success, the FirstCluster specified will link to the newly allocated
- * cluster, continuing the cluster chain. 
- *
- * If FirstCluster is zero (0), the created cluster will not continue 
- * a cluster chain and will be the first cluster in a new cluster chain.
- *
- * On success, pLocation will be updated with the new cluster.
- *
- * If 0 is returned, the disk is full and a new cluster can not be allocated.
- *
- * @brief Creates a new cluster.
- * @param pPartition   The current partition.
- * @param FirstCluster The cluster number that will link to this cluster. 
- *                     May be zero (0) to not link to the new cluster.
- * @param pLocation    Location information about the new cluster on success. 
- * @return 1 on success, 0 on failure.
- * @ingroup FAT
- */
-FAT_API uint8_t FAT_CreateCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatLocation* pLocation);
-
-#define FAT_FindFreeCluster(pPartition) (FAT_Cond(pPartition, FAT16_FindFreeCluster(pPartition), FAT16_FindFreeCluster(pPartition)))
-
-/**
- * Initialises the Directory Entry to all zeros
- * except the filename specified.
- * 
- * @brief Initialises the current Directory Entry
- * @param pPartition The current partition.
- * @param pDirLocation The location information to the directory entry.
- * @param pDirEntryName The name of the directory entry.
- * @return Nothing.
- * @ingroup Dir
- */
-void FAT_InitDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation, const char* pDirEntryName);
-#endif
-
-/**
- * Since there is no way of recovering from a read error, it is up to the host application
- * to react to disk failures. 
- *
- * @note This function should be implemented by the host application.
- * @brief Reads a sector on the disk.
- * @param pPartition The partition to read. Note that only the pBuffer member should be considered to be valid,
- *                   and it is to this buffer that the sector should be written to.
- * @param SectorNr   The sector number to read.
- * @return Nothing.
- * @ingroup General
- */
-FAT_API void FAT_ReadSector(TFatPartition* pPartition, uint32_t SectorNr);
-
-#ifdef FAT_ENABLE_WRITE
-/**
- * Since there is no way of recovering from a write error, it is up to the host application
- * to react to disk failures. 
- *
- * @note This function should be implemented by the host application.
- * @brief Reads a sector on the disk.
- * @param pPartition The partition to write. Note that only the pBuffer member should be considered to be valid,
- *                   and it is from this buffer that the sector contents should be read from.
- * @param SectorNr   The sector number to write.
- * @return Nothing.
- * @ingroup General
- */
-FAT_API void FAT_WriteSector(TFatPartition* pPartition, uint32_t SectorNr);
-#endif
-
-FAT_API uint32_t FAT_GetRootOffset(const TFatPartition* pPartition);
-
-
-#define FAT_LinkClusters(pPartition, SourceCluster, SecondCluster) (FAT_Cond(pPartition, FAT16_LinkClusters(pPartition, SourceCluster, SecondCluster), FAT16_LinkClusters(pPartition, SourceCluster, SecondCluster)))
-
-#ifdef FAT_DEBUG
-/** @brief A debug macro. Whatever is encapsulated with this macro will only be present when debugging. 
- */
-#define D_(stmt) stmt
-#else
-#define D_(stmt) 
-#endif
-
-#endif /* FAT_H_INCLUSION_GUARD */
-
+#ifndef FAT_H_INCLUSION_GUARD
+#define FAT_H_INCLUSION_GUARD
+
+/**
+ * @defgroup Partition Partition handling.
+ * @defgroup Dir Directory handling.
+ * @defgroup File File handling.
+ * @defgroup FAT File Allocation Table handling.
+ * @defgroup Device Block device interface.
+ * @defgroup Cache Sector cache.
+ * @defgroup General General.
+ */
+
+#if defined(__GNUC__)
+#include <stdint.h>
+#elif defined(_MSC_VER)
+typedef signed char 	int8_t;
+typedef unsigned char 	uint8_t;
+typedef signed short 	int16_t;
+typedef unsigned short 	uint16_t;
+typedef signed long int 	int32_t;
+typedef unsigned long int 	uint32_t;
+#endif
+
+#include "../fat_conf.h"
+
+#if !defined(FAT_ENABLE_FAT32) && !defined(FAT_ENABLE_FAT16)
+#error Neither FAT16 nor FAT32 support is enabled!
+#endif
+
+#if defined(FAT_ENABLE_FAT16) && defined(FAT_ENABLE_FAT32)
+/**
+ * @brief This identifier is defined if both FAT16 and FAT32 support is enabled.
+ */
+#define FAT_ENABLE_BOTH
+#endif
+
+#ifdef FAT_ENABLE_FAT32
+/** 
+ * @brief Identifies a cluster number.
+ * @ingroup General
+ */
+typedef uint32_t TFatClusterNr;
+#else
+typedef uint16_t TFatClusterNr;
+#endif
+
+/**
+ * @brief The partition type
+ * @see FAT_IsFAT16, FAT_IsFAT32, FAT_GetPartitionType
+ * @ingroup Partition
+ */
+typedef enum {
+  FAT_16,  /**< A FAT16 Partition */
+  FAT_32   /**< A FAT32 Partition */
+} TFatPartitionType;
+
+/**
+ * @brief The block device interface.
+ * @see TFatDevice
+ * @ingroup Device
+ */
+typedef struct TFatDevice TFatDevice;
+
+/**
+ * The library accesses the disk through these functions, so each partition
+ * can use its own backend (a disk, an image file, memory etc.) and several 
+ * partitions can be open at the same time. 
+ *
+ * Since there is no way of recovering from a read or write error, it is up
+ * to the host application to react to disk failures.
+ *
+ * Backends that hold the whole disk in addressable memory (e.g. a memory 
+ * mapped image) may provide MapSector. FAT_LoadSector then points 
+ * TFatPartition::pBuffer directly at the sector instead of copying it, so
+ * the application's sector buffer is no longer used after the first load.
+ * Since the library writes to pBuffer when modifying the disk, a device 
+ * providing MapSector must not be used for write operations.
+ *
+ * @brief Block device operations, implemented by the host application.
+ * @see TFatPartition, FAT_ReadSectors, FAT_WriteSectors
+ * @ingroup Device
+ */
+struct TFatDevice {
+  void (*ReadSector)(TFatDevice* pDevice, uint32_t SectorNr, uint8_t* pDest);                         /**< Reads one sector into pDest. Mandatory. */
+  void (*WriteSector)(TFatDevice* pDevice, uint32_t SectorNr, const uint8_t* pSource);                /**< Writes one sector from pSource. Mandatory if write support is enabled. */
+  void (*ReadSectors)(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, uint8_t* pDest);        /**< Reads Count consecutive sectors into pDest. May be NULL. */
+  void (*WriteSectors)(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource); /**< Writes Count consecutive sectors from pSource. May be NULL. */
+  void (*Flush)(TFatDevice* pDevice);                                                                 /**< Makes previous writes persistent. May be NULL. */
+  uint8_t* (*MapSector)(TFatDevice* pDevice, uint32_t SectorNr);                                      /**< Returns a pointer to the sector in device memory. May be NULL. */
+  void* pContext;                                                                                     /**< Backend specific data, not used by the library. */
+};
+
+#ifdef FAT_ENABLE_THREADS
+/**
+ * @brief TFatLock type: shared access to the FAT and directory metadata.
+ * @ingroup Partition
+ */
+#define FAT_LOCK_READ (0x01)
+
+/**
+ * @brief TFatLock type: exclusive access to the FAT and directory metadata.
+ * @ingroup Partition
+ */
+#define FAT_LOCK_WRITE (0x02)
+
+/**
+ * @brief TFatLock type: exclusive access to the sector cache.
+ * @ingroup Partition
+ */
+#define FAT_LOCK_CACHE (0x03)
+
+/**
+ * @brief The locks of a volume shared by several threads.
+ * @see TFatLock
+ * @ingroup Partition
+ */
+typedef struct TFatLock TFatLock;
+
+/**
+ * FAT_LOCK_READ and FAT_LOCK_WRITE are the shared and exclusive modes of
+ * one reader-writer lock that protects the FAT and the directories.
+ * FAT_LOCK_CACHE is a separate mutex that protects the sector cache, which
+ * readers modify as well. It is only taken for short periods, never while
+ * waiting for the reader-writer lock. None of them are taken recursively.
+ *
+ * @brief Lock operations, implemented by the host application.
+ * @see TFatPartition, FAT_ClonePartition
+ * @ingroup Partition
+ */
+struct TFatLock {
+  void (*Lock)(TFatLock* pLock, uint8_t Type);                                                       /**< Acquires the lock of the given type. Mandatory. */
+  void (*Unlock)(TFatLock* pLock, uint8_t Type);                                                     /**< Releases the lock of the given type. Mandatory. */
+  void* pContext;                                                                                     /**< Backend specific data, not used by the library. */
+};
+
+/**
+ * @brief Acquires a lock of a partition, if it has one.
+ * @param pPartition The current partition.
+ * @param Type       FAT_LOCK_READ, FAT_LOCK_WRITE or FAT_LOCK_CACHE.
+ * @ingroup Partition
+ */
+#define FAT_Lock(pPartition, Type) do { if ((pPartition)->pLock != NULL) (pPartition)->pLock->Lock((pPartition)->pLock, Type); } while (0)
+
+/**
+ * @brief Releases a lock of a partition, if it has one.
+ * @param pPartition The current partition.
+ * @param Type       FAT_LOCK_READ, FAT_LOCK_WRITE or FAT_LOCK_CACHE.
+ * @ingroup Partition
+ */
+#define FAT_Unlock(pPartition, Type) do { if ((pPartition)->pLock != NULL) (pPartition)->pLock->Unlock((pPartition)->pLock, Type); } while (0)
+#else
+#define FAT_Lock(pPartition, Type)
+#define FAT_Unlock(pPartition, Type)
+#endif
+
+#ifdef FAT_ENABLE_STATS
+/**
+ * @brief Disk region: the sectors before the first FAT (MBR, volume ID, FSInfo and the other reserved sectors).
+ * @see FAT_GetSectorRegion
+ * @ingroup Device
+ */
+#define FAT_REGION_BOOT (0)
+
+/**
+ * @brief Disk region: the FAT tables.
+ * @ingroup Device
+ */
+#define FAT_REGION_FAT (1)
+
+/**
+ * @brief Disk region: the fixed root directory of a FAT16 partition. The FAT32 root directory is in the data region.
+ * @ingroup Device
+ */
+#define FAT_REGION_ROOT (2)
+
+/**
+ * @brief Disk region: the clusters.
+ * @ingroup Device
+ */
+#define FAT_REGION_DATA (3)
+
+/**
+ * @brief The number of disk regions.
+ * @ingroup Device
+ */
+#define FAT_REGION_COUNT (4)
+
+/**
+ * @brief TFatStats::Trace operation: sectors are read from the device.
+ * @ingroup Device
+ */
+#define FAT_STATS_READ (0)
+
+/**
+ * @brief TFatStats::Trace operation: sectors are written to the device.
+ * @ingroup Device
+ */
+#define FAT_STATS_WRITE (1)
+
+/**
+ * @brief The number of buckets of TFatStats::Latency.
+ * @ingroup Device
+ */
+#define FAT_STATS_LATENCY_BUCKETS (16)
+
+/**
+ * The counters are updated by FAT_ReadSectors and FAT_WriteSectors, which
+ * all disk accesses go through, and by FAT_LoadSector. They are not reset
+ * by FAT_OpenPartition, see FAT_ResetStats. All of them wrap around.
+ *
+ * If GetTime is set, every call of a TFatDevice read or write function is
+ * timed with it, in whatever unit it returns, and counted in Latency:
+ * bucket 0 counts the calls that took no time, bucket N the ones that
+ * took from 2^(N-1) to 2^N - 1 units, and the last bucket all longer ones.
+ *
+ * If Trace is set, it is called for every read and write request before
+ * the device is accessed. Region is the region of the first sector.
+ *
+ * @brief I/O statistics of a partition.
+ * @see TFatPartition, FAT_ENABLE_STATS
+ * @ingroup Device
+ */
+typedef struct {
+  uint32_t          Reads[FAT_REGION_COUNT];  /**< The number of sectors read, per region. */
+  uint32_t          Writes[FAT_REGION_COUNT]; /**< The number of sectors written, per region. */
+  uint32_t          ReadRequests;          /**< The number of FAT_ReadSectors calls. */
+  uint32_t          WriteRequests;         /**< The number of FAT_WriteSectors calls. */
+  uint32_t          BytesRead;             /**< The number of bytes read from the device. */
+  uint32_t          BytesWritten;          /**< The number of bytes written to the device. */
+  uint32_t          Hits;                  /**< The number of FAT_LoadSector calls that did not read the device (sector cache hits and mapped sectors). */
+  uint32_t          Misses;                /**< The number of FAT_LoadSector calls that read the device. */
+  uint32_t          Latency[FAT_STATS_LATENCY_BUCKETS]; /**< The number of device calls by duration. Only counted if GetTime is set. */
+  uint32_t        (*GetTime)(void* pContext); /**< Returns the current time in any unit, or NULL. Must be specified by the application. */
+  void            (*Trace)(void* pContext, uint8_t Operation, uint8_t Region, uint32_t SectorNr, uint16_t Count); /**< Called for every request (FAT_STATS_READ or FAT_STATS_WRITE), or NULL. Must be specified by the application. */
+  void*             pContext;              /**< Passed to GetTime and Trace, not used by the library. */
+} TFatStats;
+#endif
+
+#if defined(FAT_ENABLE_TRACE) && !defined(FAT_ENABLE_STATS)
+#error FAT_ENABLE_TRACE requires FAT_ENABLE_STATS to be set!
+#endif
+
+#ifdef FAT_ENABLE_TRACE
+/**
+ * @brief Records the device requests of a partition to a binary trace.
+ * @see FAT_InitTrace, FAT_RecordTrace
+ * @ingroup Device
+ */
+typedef struct {
+  uint8_t*          pBuffer;               /**< A pointer to a buffer for the records that have not been written yet. Must be specified by the application. */
+  uint16_t          BufferSize;            /**< The size of pBuffer in bytes, at least FAT_TRACE_HEADER_SIZE. Must be specified by the application. */
+  uint16_t          Length;                /**< The number of bytes in pBuffer. */
+  uint32_t          Records;               /**< The number of records made. */
+  void            (*Write)(void* pContext, const uint8_t* pData, uint16_t Length); /**< Stores the next part of the trace. Mandatory. */
+  void*             pContext;              /**< Passed to Write, not used by the library. */
+} TFatTraceRecorder;
+#endif
+
+#if defined(FAT_CACHE_WRITE_BACK) && !defined(FAT_CACHE_SECTORS)
+#error FAT_CACHE_WRITE_BACK requires FAT_CACHE_SECTORS to be set!
+#endif
+
+#ifdef FAT_CACHE_SECTORS
+/**
+ * @brief Set in TFatCacheEntry::Flags when the entry holds a sector.
+ * @ingroup Cache
+ */
+#define FAT_CACHE_VALID (0x01)
+
+/**
+ * @brief Set in TFatCacheEntry::Flags when the entry has been modified but not yet written to the disk.
+ * @see FAT_CACHE_WRITE_BACK, FAT_Flush
+ * @ingroup Cache
+ */
+#define FAT_CACHE_DIRTY (0x02)
+
+/**
+ * @brief Describes one sector held in the sector cache.
+ * @see TFatCache
+ * @ingroup Cache
+ */
+typedef struct {
+  uint32_t          Sector;                /**< The sector number held by this entry. */
+  uint32_t          LastUsed;              /**< The value of TFatCache::Tick when the entry was last accessed. */
+  uint8_t           Flags;                 /**< Entry state (FAT_CACHE_VALID and FAT_CACHE_DIRTY). */
+} TFatCacheEntry;
+
+/**
+ * @brief Sector cache information
+ * @see FAT_OpenPartition, FAT_LoadSector, FAT_CACHE_SECTORS
+ * @ingroup Cache
+ */
+typedef struct {
+  uint8_t*          pData;                 /**< A pointer to a buffer large enough for FAT_CACHE_SECTORS disk sectors. Must be specified by the application. */
+  TFatCacheEntry    Entries[FAT_CACHE_SECTORS]; /**< The cache entries. Entry N is stored at pData + N * FAT_BYTES_PER_SECTOR. */
+  uint32_t          Tick;                  /**< Incremented on every access. Used to find the least recently used entry. */
+  uint32_t          Hits;                  /**< The number of sector loads that were served from the cache. */
+  uint32_t          Misses;                /**< The number of sector loads that had to be read from the disk. */
+  uint32_t          Evictions;             /**< The number of valid entries that were replaced by another sector. */
+} TFatCache;
+#endif
+
+#if defined(FAT_DIR_INDEX_ENTRIES) && !defined(FAT_DIR_INDEX_DIRECTORIES)
+#error FAT_DIR_INDEX_ENTRIES requires FAT_DIR_INDEX_DIRECTORIES to be set!
+#endif
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+/**
+ * @brief The directory name index.
+ * @see TFatNameIndex
+ * @ingroup Dir
+ */
+typedef struct TFatNameIndex TFatNameIndex;
+#endif
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+/**
+ * @brief The path lookup cache.
+ * @see TFatPathCache
+ * @ingroup Dir
+ */
+typedef struct TFatPathCache TFatPathCache;
+#endif
+
+#ifdef FAT_DIR_HINT_ENTRIES
+/**
+ * @brief The free directory entry hints.
+ * @see TFatDirHints
+ * @ingroup Dir
+ */
+typedef struct TFatDirHints TFatDirHints;
+#endif
+
+#ifdef FAT_ENABLE_FAT_TABLE
+/**
+ * @brief Returns the size of the dirty bitmap needed for a FAT table window.
+ * @param Sectors The window size, in sectors.
+ * @return The size of TFatTable::pDirty, in bytes.
+ * @ingroup FAT
+ */
+#define FAT_TABLE_DIRTY_SIZE(Sectors) (((Sectors) + 7) / 8)
+
+/**
+ * A window of consecutive FAT sectors held in memory. If the window is 
+ * at least as large as the FAT, the whole FAT is loaded by 
+ * FAT_OpenPartition and cluster chains are followed without any disk 
+ * access. Otherwise, the window is moved to the requested part of the
+ * FAT when needed.
+ *
+ * @brief In-memory copy of the file allocation table
+ * @see FAT_OpenPartition, FAT_ENABLE_FAT_TABLE
+ * @ingroup FAT
+ */
+typedef struct {
+  uint8_t*          pData;                 /**< A pointer to a buffer large enough for SectorCount disk sectors. Must be specified by the application. */
+  uint8_t*          pDirty;                /**< A pointer to a buffer of FAT_TABLE_DIRTY_SIZE(SectorCount) bytes. Must be specified by the application. */
+  uint32_t          SectorCount;           /**< The window size, in sectors. Must be specified by the application. */
+  uint32_t          FirstSector;           /**< The first FAT sector in the window, relative to the start of the FAT. */
+  uint32_t          LoadedSectors;         /**< The number of FAT sectors currently held in the window. */
+  uint32_t          Loads;                 /**< The number of times the window has been loaded. */
+} TFatTable;
+#endif
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * @brief The number of modified FAT sectors that are remembered one by one for FAT_MirrorFAT.
+ * @see TFatPartition::DirtyFATSectors
+ * @ingroup FAT
+ */
+#define FAT_DIRTY_FAT_SECTORS (8)
+#endif
+
+/**
+ * @brief Partition information
+ * @see FAT_OpenPartition
+ * @ingroup Partition
+ */
+typedef struct {
+  TFatDevice*       pDevice;               /**< The block device that holds the partition. Must be specified by the application. */
+  uint8_t*          pBuffer;               /**< A pointer to a buffer large enough for a disk sector. Must be specified by the application. */
+#ifdef FAT_CACHE_SECTORS
+  TFatCache*        pCache;                /**< A pointer to the sector cache, or NULL to disable caching. Must be specified by the application. */
+#endif
+#ifdef FAT_ENABLE_FAT_TABLE
+  TFatTable*        pTable;                /**< A pointer to the in-memory FAT table, or NULL to access the FAT on the disk. Must be specified by the application. */
+#endif
+#ifdef FAT_DIR_INDEX_ENTRIES
+  TFatNameIndex*    pNameIndex;            /**< A pointer to the directory name index, or NULL to search directories sector by sector. Must be specified by the application. */
+#endif
+#ifdef FAT_PATH_CACHE_ENTRIES
+  TFatPathCache*    pPathCache;            /**< A pointer to the path lookup cache, or NULL to disable it. Must be specified by the application. */
+#endif
+#ifdef FAT_DIR_HINT_ENTRIES
+  TFatDirHints*     pDirHints;             /**< A pointer to the free directory entry hints, or NULL to always search for free entries from the start of the directory. Must be specified by the application. */
+#endif
+#ifdef FAT_ENABLE_THREADS
+  TFatLock*         pLock;                 /**< A pointer to the locks shared by all partitions of the volume, or NULL if only one thread uses the volume. Must be specified by the application. */
+#endif
+#ifdef FAT_ENABLE_STATS
+  TFatStats*        pStats;                /**< A pointer to the I/O statistics, or NULL to disable them. Must be specified by the application. */
+#endif
+  uint32_t          PartitionLBA;          /**< The offset where the partition data begins - in clusters. */
+#ifdef FAT_ENABLE_BOTH
+  TFatPartitionType Type;                  /**< The partition type (FAT_16 or FAT_32). */ 
+#endif
+  uint8_t           SectorsPerCluster;     /**< The number of sectors per cluster. */
+  uint16_t          ReservedSectors;       /**< The number of reserved sectors. */
+  uint32_t          SectorsPerFAT;         /**< The number of sectors per FAT table. */
+  uint8_t           NumberOfFATs;          /**< The number of FAT tables. */
+  uint16_t          RootDirectoryEntries;  /**< The number of root directory entries. Will be zero (0) for a  FAT32 partition. */
+  TFatClusterNr     ClusterCount;          /**< The number of data clusters. Valid cluster numbers range from 2 to ClusterCount + 1. */
+  uint32_t          FreeClusters;          /**< The number of free clusters, or FAT_UNKNOWN_FREE_CLUSTERS if they have not been counted. */
+#ifdef FAT_ENABLE_FAT32
+  uint16_t          FSInfoSector;          /**< The FSInfo sector, relative to the start of the partition. Zero (0) if there is none, which is always the case for FAT16. */
+#endif
+#ifdef FAT_ENABLE_WRITE
+  TFatClusterNr     NextFreeCluster;       /**< The cluster where the search for a free cluster starts. */
+  uint8_t           MirroredFATs;          /**< The number of FAT tables that modifications are written to. NumberOfFATs, or one (1) if mirroring is disabled on a FAT32 partition. */
+  uint32_t          DirtyFATSectors[FAT_DIRTY_FAT_SECTORS]; /**< The sectors of the first FAT that have been modified since the other FAT tables were updated, in ascending order. */
+  uint8_t           DirtyFATSectorCount;   /**< The number of sectors in DirtyFATSectors, or FAT_DIRTY_FAT_SECTORS + 1 if more sectors have been modified. */
+  uint32_t          FirstDirtyFATSector;   /**< The first modified sector of the first FAT. Only used when DirtyFATSectors has overflowed. */
+  uint32_t          EndDirtyFATSector;     /**< One past the last modified sector of the first FAT, or zero (0) if the other FAT tables are up to date. */
+#ifdef FAT_ENABLE_FAT32
+  uint8_t           FSInfoDirty;           /**< 1 if FreeClusters or NextFreeCluster has changed since the FSInfo sector was last written. */
+#endif
+#ifdef FAT_ENABLE_FREE_MAP
+  uint8_t*          pFreeMap;              /**< A pointer to the free-cluster bitmap, or NULL to search the FAT instead. Must be specified by the application. */
+  uint32_t          FreeMapSize;           /**< The size of pFreeMap in bytes. Must be specified by the application. */
+  uint8_t           FreeMapValid;          /**< 1 if pFreeMap has been built. */
+#endif
+#endif
+} TFatPartition;
+
+/**
+ * @brief Identifies a sector location on the disk
+ * @ingroup Partition
+ */
+typedef struct {
+  uint32_t          Sector;                /**< The current sector. */
+  TFatClusterNr     Cluster;               /**< The current cluster. */
+  uint8_t           SectorsLeftInCluster;  /**< The number of sectors left in the cluster, excluding the one in this structure. */
+} TFatLocation;
+
+/**
+ * @brief Identifies a directory entry location on the disk
+ * @see FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR
+ * @ingroup Dir
+ */
+typedef struct {
+  TFatLocation Location;                   /**< The sector it is located in. */
+  uint8_t      EntryOffset;                /**< The entry offset, ranging from 0 to FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR. */
+} TFatDirectoryLocation;
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+/**
+ * @brief The location of one name held by the directory name index.
+ * @see TFatDirIndex
+ * @ingroup Dir
+ */
+typedef struct {
+  uint32_t          Sector;                /**< The sector holding the directory entry. */
+  TFatClusterNr     Cluster;               /**< The cluster holding the directory entry. */
+  uint16_t          Hash;                  /**< The hash of the 8.3 name. */
+  uint8_t           SectorsLeftInCluster;  /**< The number of sectors left in the cluster. */
+  uint8_t           EntryOffset;           /**< The entry offset within the sector, or one of FAT_NAME_EMPTY and FAT_NAME_REMOVED. */
+} TFatNameEntry;
+
+/**
+ * @brief TFatNameEntry::EntryOffset of a slot that has never been used.
+ * @ingroup Dir
+ */
+#define FAT_NAME_EMPTY (0xFF)
+
+/**
+ * @brief TFatNameEntry::EntryOffset of a slot whose name has been removed.
+ * @ingroup Dir
+ */
+#define FAT_NAME_REMOVED (0xFE)
+
+/**
+ * @brief TFatDirIndex::State of an index slot that holds no directory.
+ * @ingroup Dir
+ */
+#define FAT_DIR_INDEX_UNUSED (0)
+
+/**
+ * @brief TFatDirIndex::State of an index that has not reached the end of the directory yet.
+ * @ingroup Dir
+ */
+#define FAT_DIR_INDEX_PARTIAL (1)
+
+/**
+ * @brief TFatDirIndex::State of an index that holds every name in the directory.
+ * @ingroup Dir
+ */
+#define FAT_DIR_INDEX_COMPLETE (2)
+
+/**
+ * @brief TFatDirIndex::State of an index that ran out of entries before the end of the directory.
+ * @ingroup Dir
+ */
+#define FAT_DIR_INDEX_FULL (3)
+
+/**
+ * A hash table of FAT_DIR_INDEX_ENTRIES names, filled while the directory
+ * is searched. Resume is where the next search continues once the names
+ * already in the table have been checked.
+ *
+ * @brief The name index of one directory.
+ * @see TFatNameIndex
+ * @ingroup Dir
+ */
+typedef struct {
+  TFatNameEntry*    pEntries;              /**< The hash table, FAT_DIR_INDEX_ENTRIES entries within TFatNameIndex::pData. */
+  TFatClusterNr     DirectoryCluster;      /**< The first cluster of the directory, or zero (0) for the FAT16 root directory. */
+  TFatDirectoryLocation Resume;            /**< The first directory entry that has not been added to the table. */
+  uint16_t          Count;                 /**< The number of names in the table. */
+  uint16_t          Used;                  /**< The number of table entries that are not FAT_NAME_EMPTY. */
+  uint8_t           State;                 /**< FAT_DIR_INDEX_UNUSED, FAT_DIR_INDEX_PARTIAL, FAT_DIR_INDEX_COMPLETE or FAT_DIR_INDEX_FULL. */
+  uint32_t          LastUsed;              /**< The value of TFatNameIndex::Tick when the index was last used. */
+} TFatDirIndex;
+
+/**
+ * Maps 8.3 names to directory entry locations for up to 
+ * FAT_DIR_INDEX_DIRECTORIES directories, so that looking up a name 
+ * normally reads only the sector holding the entry. The least recently
+ * used directory is replaced when another directory is searched.
+ *
+ * @brief Directory name index information
+ * @see FAT_InitNameIndex, FAT_FindDirEntry, FAT_DIR_INDEX_ENTRIES
+ * @ingroup Dir
+ */
+struct TFatNameIndex {
+  TFatNameEntry*    pData;                 /**< A pointer to FAT_DIR_INDEX_DIRECTORIES * FAT_DIR_INDEX_ENTRIES entries. Must be specified by the application. */
+  TFatDirIndex      Directories[FAT_DIR_INDEX_DIRECTORIES]; /**< The indexed directories. */
+  TFatClusterNr     CreateCluster;         /**< The directory passed to the last FAT_CreateDirEntry call. */
+  uint32_t          Tick;                  /**< Incremented on every lookup. Used to find the least recently used directory. */
+};
+#endif
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+/**
+ * @brief A directory entry remembered by the path lookup cache.
+ * @see TFatPathCache
+ * @ingroup Dir
+ */
+typedef struct {
+  TFatClusterNr     ParentCluster;         /**< The first cluster of the directory holding the entry, or zero (0) for the root directory. */
+  TFatClusterNr     StartCluster;          /**< The first cluster of the entry. */
+  TFatDirectoryLocation DirLocation;       /**< The location of the entry. */
+  uint32_t          LastUsed;              /**< The value of TFatPathCache::Tick when the entry was last used. */
+  uint8_t           Name[11];              /**< The 8.3 name of the entry. Name[0] is zero (0) for an unused cache entry. */
+  uint8_t           Attributes;            /**< The attributes of the entry. */
+} TFatDentry;
+
+/**
+ * Remembers where the most recently resolved path components are 
+ * located, so that FAT_OpenPath does not have to search the directories
+ * along a path again.
+ *
+ * @brief Path lookup cache information
+ * @see FAT_OpenPath, FAT_InitPathCache, FAT_PATH_CACHE_ENTRIES
+ * @ingroup Dir
+ */
+struct TFatPathCache {
+  TFatDentry        Entries[FAT_PATH_CACHE_ENTRIES]; /**< The cache entries. */
+  uint32_t          Tick;                  /**< Incremented on every access. Used to find the least recently used entry. */
+  uint32_t          Hits;                  /**< The number of path components that were found in the cache. */
+  uint32_t          Misses;                /**< The number of path components that had to be searched for. */
+};
+#endif
+
+#ifdef FAT_DIR_HINT_ENTRIES
+/**
+ * @brief Where to start looking for a free entry in one directory.
+ * @see TFatDirHints
+ * @ingroup Dir
+ */
+typedef struct {
+  TFatClusterNr     DirectoryCluster;      /**< The first cluster of the directory, or zero (0) for the FAT16 root directory. */
+  TFatDirectoryLocation Free;              /**< The first entry that may be free. All entries before it are in use. */
+  uint32_t          LastUsed;              /**< The value of TFatDirHints::Tick when the hint was last used. Zero (0) for an unused hint. */
+} TFatDirHint;
+
+/**
+ * Remembers the first entry that may be free in the directories where
+ * entries were most recently created. This is either the first deleted 
+ * entry or the end of the directory, so that FAT_CreateDirEntry does not
+ * have to search the whole directory again for every new entry.
+ *
+ * @brief Free directory entry hint information
+ * @see FAT_CreateDirEntry, FAT_InitDirHints, FAT_DIR_HINT_ENTRIES
+ * @ingroup Dir
+ */
+struct TFatDirHints {
+  TFatDirHint       Entries[FAT_DIR_HINT_ENTRIES]; /**< The hints. */
+  uint32_t          Tick;                  /**< Incremented on every access. Used to find the least recently used hint. */
+};
+#endif
+
+/**
+ * @brief Directory entry information.
+ * @see FAT_CreateDirEntry, FAT_CreateRootDirEntry, FAT_FindDirEntry, FAT_FindRootDirEntry
+ * @see Dir
+ */
+typedef struct {
+  uint8_t Name[11];             /**< The directory entry name. */
+  uint8_t Attributes;           /**< Attributes */
+  uint8_t ReservedNT;           /**< Reserved. */
+  uint8_t CreationTimeTenth;    /**< The creation time, in 10ms units. Valid values are 0-199*/           
+  uint16_t CreationTime;        /**< The creation time. */
+  uint16_t CreationDate;        /**< The creation date. */
+  uint16_t LastAccessDate;      /**< Last access date. */
+  uint16_t StartClusterHigh;    /**< The upper 16 bits of the start cluster address. Will be zero for FAT16. */
+  uint16_t ModicationTime;      /**< Modification time. */
+  uint16_t ModificationDate;    /**< Modification date. */
+  uint16_t StartClusterLow;     /**< The lower 16 bits of teh start cluster address. */
+  uint32_t FileSize;            /**< The size of the file, in bytes. */
+} TFatDirEntry;
+
+/**
+ * @brief The value of TFatPartition::FreeClusters when the free clusters have not been counted.
+ * @ingroup FAT
+ */
+#define FAT_UNKNOWN_FREE_CLUSTERS (0xFFFFFFFFUL)
+
+/**
+ * @brief The number of bytes per sector.
+ * @ingroup Partition
+ */
+#define FAT_BYTES_PER_SECTOR (512)
+
+/**
+ * @brief The size of a directory entry.
+ * @ingroup Dir
+ */
+#define FAT_DIRECTORY_ENTRY_SIZE (sizeof(TFatDirEntry))
+
+/**
+ * @brief The number of directory entries per sector.
+ * @ingroup Dir
+ */
+#define FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR (FAT_BYTES_PER_SECTOR / FAT_DIRECTORY_ENTRY_SIZE)
+
+/**
+ * @brief The number of FAT entries per sector for FAT16.
+ * @ingroup FAT
+ */
+#define FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR (FAT_BYTES_PER_SECTOR / sizeof(uint16_t))
+
+/**
+ * @brief The number of FAT entries per sector for FAT32.
+ * @ingroup FAT
+ */
+#define FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR (FAT_BYTES_PER_SECTOR / sizeof(uint32_t))
+
+#if defined(FAT_ENABLE_FAT16) && !defined(FAT_ENABLE_FAT32)
+#define FAT_IsFAT16(pPartition) (1)
+#define FAT_IsFAT32(pPartition) (0)
+#define FAT_Cond(pPartition, Fat16Expr,Fat32Expr) (Fat16Expr)
+#elif !defined(FAT_ENABLE_FAT16) && defined(FAT_ENABLE_FAT32)
+#define FAT_IsFAT16(pPartition) (0)
+#define FAT_IsFAT32(pPartition) (1)
+#define FAT_Cond(pPartition, Fat16Expr,Fat32Expr) (Fat32Expr)
+#else
+
+/**
+ * @brief Indicates if the current partition is a FAT16 partition.
+ * @param pPartition The current partition.
+ * @return TRUE of the partition is a FAT16 partition. FALSE otherwise.
+ * @ingroup Partition
+ */
+#define FAT_IsFAT16(pPartition) ((pPartition)->Type == FAT_16)
+
+/**
+ * @brief Indicates if the current partition is a FAT32 partition.
+ * @param pPartition The current partition.
+ * @return TRUE of the partition is a FAT32 partition. FALSE otherwise.
+ * @ingroup Partition
+ */
+#define FAT_IsFAT32(pPartition) ((pPartition)->Type != FAT_16)
+
+#define FAT_Cond(pPartition, Fat16Expr,Fat32Expr) (FAT_IsFAT16(pPartition) ? (Fat16Expr) : (Fat32Expr))
+#endif
+
+#ifdef FAT_SINGLE_FILE
+#define FAT_API static
+#else
+#define FAT_API
+#endif
+
+#ifdef FAT_ENABLE_FAT16
+#include "fat16.h"
+#endif
+
+#ifdef FAT_ENABLE_FAT32
+#include "fat32.h"
+#endif
+
+#include "fatcache.h"
+#include "fattable.h"
+#include "fatextent.h"
+#include "fatalloc.h"
+#include "fatscan.h"
+#include "fatindex.h"
+#include "fatpath.h"
+#include "fatfile.h"
+#include "fattrace.h"
+
+/* These are valid when the MBR is in the buffer */
+
+/**
+ * @brief Returns the logical block address of the partition's first sector.
+ * @param pMBR A pointer to the contents of the master boot record.
+ * @param PartitionNr The partition number, ranging from 0 to 3.
+ * @return The logical block address of the first sector in the partition.
+ * @ingroup Partition
+ */
+#define FAT_GetPartitionLBA(pMBR, PartitionNr) *(uint32_t*)(pMBR + 446 + PartitionNr*16 + 8)
+
+/**
+ * @brief Returns the partition type.
+ * @param pMBR A pointer to the contents of the master boot record.
+ * @param PartitionNr The partition number, ranging from 0 to 3.
+ * @return The partition type.
+ * @ingroup Partition
+ */
+#define FAT_GetPartitionType(pMBR, PartitionNr) *(pMBR + 446 + PartitionNr*16 + 4)
+
+/**
+ * @brief Returns the partition length, in sectors.
+ * @param pMBR A pointer to the contents of the master boot record.
+ * @param PartitionNr The partition number, ranging from 0 to 3.
+ * @return The number of sectors in the partition.
+ * @ingroup Partition
+ */
+#define FAT_GetPartitionLength(pMBR, PartitionNr) *(uint32_t*)(pMBR + 446 + PartitionNr*16 + 12)
+
+/**
+ * @brief Indicates if the partition is bootable.
+ * @param pMBR A pointer to the contents of the master boot record.
+ * @param PartitionNr The partition number, ranging from 0 to 3.
+ * @return TRUE if the partition is bootable. FALSE otherwise.
+ * @ingroup Partition
+ */
+#define FAT_IsPartitionBootable(pMBR, PartitionNr) (*(pMBR + 446 + PartitionNr*16 + 0) == 0x80)
+
+/**
+ * @brief Indicates if the master boot record is valid.
+ * @param pMBR A pointer to the contents of the master boot record.
+ * @return TRUE if the master boot record is valid. FALSE otherwise.
+ * @ingroup Partition
+ */
+#define FAT_IsMBRValid(pMBR) (*(uint16_t*)(pMBR + 510) == 0xAA55)
+
+/**
+ * @brief Returns the number of sectors per cluster.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The number of sectors per cluster.
+ * @ingroup Partition
+ */
+#define FAT_GetSectorsPerCluster(pVolumeID) *(pVolumeID + 0xd)
+
+/**
+ * @brief Returns the number of reserved sectors.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The number of reserved sectors.
+ * @ingroup Partition
+ */
+#define FAT_GetReservedSectors(pVolumeID) *(uint16_t*)(pVolumeID + 0xe)
+
+/**
+ * @note The specification recommends two (2) tables, but any number of 
+ *       tables is supported. All copies are kept identical.
+ * @brief Returns the number of FAT tables.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The number of FAT tables.
+ * @ingroup FAT
+ */
+#define FAT_GetNrOfFATs(pVolumeID) *(pVolumeID + 0x10)
+
+/**
+ * @note Zero (0) if the partition has more than 65535 sectors. 
+ *       FAT_GetTotalSectors32 holds the number of sectors in that case.
+ * @brief Returns the 16-bit number of sectors in the partition.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The number of sectors in the partition.
+ * @ingroup Partition
+ */
+#define FAT_GetTotalSectors16(pVolumeID) *(uint16_t*)(pVolumeID + 0x13)
+
+/**
+ * @brief Returns the 32-bit number of sectors in the partition.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The number of sectors in the partition.
+ * @ingroup Partition
+ */
+#define FAT_GetTotalSectors32(pVolumeID) *(uint32_t*)(pVolumeID + 0x20)
+
+/**
+ * @note This value is only used for FAT16. For FAT32, this will always be zero (0).
+ * @brief Returns the number of root directory entries.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The number of root directory entries.
+ * @ingroup Dir
+ */
+#define FAT_GetRootDirectoryEntries(pVolumeID) *(uint16_t*)(pVolumeID + 0x11)
+
+/**
+ * @brief Returns the number of sectors per FAT table.
+ * @param pPartition The current partition
+ * @return The number of sectors per FAT table.
+ * @ingroup FAT
+ */
+#define FAT_GetSectorsPerFAT(pPartition) (FAT_Cond(pPartition, (uint32_t)FAT16_GetSectorsPerFAT(pPartition->pBuffer), FAT32_GetSectorsPerFAT(pPartition->pBuffer)))
+
+/**
+ * @brief Returns the sector number where the FAT table is located.
+ * @param pPartition The current partition.
+ * @return The sector number where the FAT table is located
+ * @ingroup FAT
+ */
+#define FAT_GetFATSector(pPartition) (pPartition->PartitionLBA + pPartition->ReservedSectors)
+
+#define ATTR_READ_ONLY 0x01
+#define ATTR_HIDDEN    0x02
+#define ATTR_SYSTEM    0x04
+#define ATTR_VOLUME_ID 0x08
+#define ATTR_DIRECTORY 0x10
+#define ATTR_ARCHIVE   0x20
+#define ATTR_LONG_NAME (ATTR_READ_ONLY | ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID)
+
+/**
+ * @brief Returns a pointer to the directory entry information
+ * @param pPartition   The current partition.
+ * @param pDirLocation The directory entry location information.
+ * @return A pointer to the directory entry information.
+ * @ingroup Dir
+ *
+ * @see TFatDirEntry
+ */
+#define FAT_GetDirEntry(pPartition, pDirLocation) ((TFatDirEntry*)((pPartition)->pBuffer + ((pDirLocation)->EntryOffset * FAT_DIRECTORY_ENTRY_SIZE)))
+
+/**
+ * @note Long file name entries should be ignored, since they are not supported.
+ * @brief Indicates if the directory entry is a long file name entry.
+ * @param pDirEntry The directory entry information.
+ * @return TRUE if the entry is a long file name entry. FALSE otherwise.
+ * @ingroup Dir
+ */
+#define FAT_IsLongFileName(pDirEntry) ((uint8_t)(pDirEntry->Attributes & 0x0F) == (uint8_t)ATTR_LONG_NAME)
+
+/* To use these, you'll first have to make sure the entry is not a long file name. */
+/**
+ * @note This function can only be called when it is determined 
+ *       that the entry is not a long file name entry.
+ * @brief Indicates if the directory entry represents a file.
+ * @param pDirEntry The directory entry information.
+ * @return TRUE if the entry is a file. FALSE otherwise.
+ * @ingroup Dir
+ */
+#define FAT_IsFile(pDirEntry) (((uint8_t)(pDirEntry->Attributes & (ATTR_VOLUME_ID | ATTR_DIRECTORY))) == 0)
+
+/**
+ * @note This function can only be called when it is determined 
+ *       that the entry is not a long file name entry.
+ * @brief Indicates if the directory entry represents a directory.
+ * @param pDirEntry The directory entry information.
+ * @return TRUE if the entry is a directroy. FALSE otherwise.
+ * @ingroup Dir
+ */
+#define FAT_IsDirectory(pDirEntry) (uint8_t)(pDirEntry->Attributes & ATTR_DIRECTORY)
+
+/**
+ * @note This function can only be called when it is determined 
+ *       that the entry is not a long file name entry.
+ * @brief Indicates if the directory entry represents a volume identifier.
+ * @param pDirEntry The directory entry information.
+ * @return TRUE if the entry is a volume identifier. FALSE otherwise.
+ * @ingroup Dir
+ */
+#define FAT_IsVolumeID(pDirEntry) (uint8_t)(pDirEntry->Attributes & ATTR_VOLUME_ID)
+
+/**
+ * @note This function can only be called when it is determined 
+ *       that the entry is not a long file name entry.
+ * @brief Indicates if the directory entry is write protected.
+ * @param pDirEntry The directory entry information.
+ * @return TRUE if the entry is write protected. FALSE otherwise.
+ * @ingroup Dir
+ */
+#define FAT_IsReadOnly(pDirEntry) (uint8_t)(pDirEntry->Attributes & ATTR_READ_ONLY)
+
+
+#ifdef FAT_ENABLE_FAT32
+/* The FAT32 variant works for FAT16 as well */
+/**
+ * @note This function can only be called when it is determined 
+ *       that the entry is not a long file name entry.
+ * @brief Returns the start address, in clusters, of the directory entry.
+ * @param pDirEntry The directory entry information.
+ * @return The cluster start address of the entry.
+ * @ingroup Dir
+ */
+#define FAT_GetStartCluster(pDirEntry) FAT32_GetStartCluster(pDirEntry)
+#else
+#define FAT_GetStartCluster(pDirEntry) FAT16_GetStartCluster(pDirEntry)
+#endif
+
+/**
+ * @note This function can only be called when it is determined 
+ *       that the entry is not a long file name entry.
+ * @brief Indicates if the directory entry has been deleted.
+ * @param pDirEntry The directory entry information.
+ * @return TRUE if the entry has been deleted. FALSE otherwise.
+ * @ingroup Dir
+ */
+#define FAT_IsDirEntryDeleted(pDirEntry) (pDirEntry->Name[0] == 0xE5)
+
+/**
+ * @note If this function returns TRUE, the entry must not be examined
+ *       further, since it is not valid.
+ * @brief Indicates if the directory entry is the last entry.
+ * @param pPartition    The current partition.
+ * @param pDirEntry     The directory entry information.
+ * @param pDirLocation  The directory entry location.
+ * @return TRUE if the entry is the last entry in the directory.
+ * @ingroup Dir
+ */
+#define FAT_IsLastDirEntry(pPartition, pDirEntry, pDirLocation) ((pDirEntry->Name[0] == 0x00) || !FAT_IsCurrentClusterValid(pPartition, &(pDirLocation)->Location))
+#define FAT_IsCurrentClusterValid(pPartition, pLocation) (FAT_Cond(pPartition, FAT16_IsCurrentClusterValid(pPartition, pLocation), FAT32_IsCurrentClusterValid(pPartition, pLocation)))
+
+/**
+ * Seeks to the cluster specified. After this call, FAT_LoadSector
+ * or FAT_StoreSector may be called with pLocation->Sector as the sector
+ * to operate on. 
+ *
+ * @note Only pLocation will be updated - the sector buffer will not be touched.
+ *
+ * @brief Returns the first sector of the specified cluster.
+ * @param pPartition The current partition.
+ * @param pLocation The information about the new location.
+ * @param ClusterNr The cluster number to seek to.
+ * @return Nothing.
+ * @ingroup General
+ *
+ * @see FAT_LoadSector, FAT_StoreSector
+ */
+FAT_API void FAT_Seek(const TFatPartition* pPartition, TFatLocation* pLocation, TFatClusterNr ClusterNr);
+
+/**
+ * @brief Returns the cluster number that follows the given cluster number in the FAT table.
+ * @param pPartition The current partition.
+ * @param CurrentCluster The current cluster.
+ * @return The cluster following the given cluster.
+ * @ingroup FAT
+ * 
+ * @see FAT_ReadNextCluster
+ */
+#define FAT_GetNextCluster(pPartition, CurrentCluster) (FAT_Cond(pPartition, FAT16_GetNextCluster(pPartition, CurrentCluster), FAT32_GetNextCluster(pPartition, CurrentCluster)))
+
+/**
+ * @brief Indicates if a value returned by FAT_GetNextCluster marks the end of the cluster chain.
+ * @param pPartition The current partition.
+ * @param ClusterNr  The cluster number to examine.
+ * @return TRUE if ClusterNr is an end of chain marker. FALSE otherwise.
+ * @ingroup FAT
+ *
+ * @see FAT_GetNextCluster
+ */
+#define FAT_IsEndOfChain(pPartition, ClusterNr) (FAT_Cond(pPartition, FAT16_IsEndOfChain(ClusterNr), FAT32_IsEndOfChain(ClusterNr)))
+
+/**
+ * Opens a FAT partition.
+ *
+ * If the function indicates a failure, this can be due to an invalid master boot
+ * record, an invalid partition type (Only FAT16 and FAT32 is supported, depending 
+ * on configuration) or other problems.
+ *
+ * Only partitions 0-3 are valid.
+ *
+ * pPartition->pDevice and pPartition->pBuffer must be set prior to calling this 
+ * function. pBuffer should point to a buffer, large enough for a disk sector 
+ * (512 bytes). If FAT_CACHE_SECTORS is configured, pPartition->pCache must be 
+ * set as well, either to NULL or to a sector cache whose pData member has been
+ * set. The cache will be initialised by this function. Likewise, if 
+ * FAT_ENABLE_FAT_TABLE is configured, pPartition->pTable must be set to NULL 
+ * or to a FAT table whose pData, pDirty and SectorCount members have been set,
+ * and the table is loaded by this function. If FAT_ENABLE_FREE_MAP is 
+ * configured, pPartition->pFreeMap and pPartition->FreeMapSize must be set,
+ * see FAT_FindFreeCluster. Other members in this 
+ * structure will be written by this function and their original values are 
+ * ignored.
+ *
+ * This function must be called before using any other function.
+ *
+ * @brief Opens a FAT partition.
+ * @param pPartition The current partition. 
+ * @param PartitionNr The partition number to open.
+ * @return 1 on success, 0 on failure.
+ * @ingroup Partition
+ */
+FAT_API uint8_t FAT_OpenPartition(TFatPartition* pPartition, uint8_t PartitionNr);
+
+#ifdef FAT_ENABLE_THREADS
+/**
+ * Every thread that uses a volume needs a partition of its own, since
+ * pBuffer and the data returned by the directory functions are per
+ * partition. The clone shares the device, the locks and the sector cache
+ * with pSource, and the FAT table if it holds the whole FAT. The directory
+ * name index, the path lookup cache, the free directory entry hints, the
+ * I/O statistics and the free-cluster bitmap are not shared; they can be
+ * set up for the clone separately.
+ *
+ * The clone is meant for reading. The volume is modified through the
+ * partition opened with FAT_OpenPartition, holding FAT_LOCK_WRITE. If
+ * pSource has a FAT table that only holds part of the FAT, modifications
+ * of the FAT become visible to the clone when pSource is flushed with
+ * FAT_Flush.
+ *
+ * pSource->pDevice must be safe to read from several threads at once, like
+ * the devices of fathost.h, and pSource->pLock must be set.
+ *
+ * @brief Creates another partition for a volume that is already open.
+ * @param pSource The partition opened with FAT_OpenPartition.
+ * @param pClone  The partition to initialise.
+ * @param pBuffer A buffer large enough for a disk sector, used as pClone->pBuffer.
+ * @return Nothing.
+ * @ingroup Partition
+ *
+ * @see TFatLock, FAT_LookupPath
+ */
+FAT_API void FAT_ClonePartition(const TFatPartition* pSource, TFatPartition* pClone, uint8_t* pBuffer);
+#endif
+
+/**
+ * @note The next clusters in the cluster chain can be read
+ *       using FAT_ReadNextSector
+ *
+ * @brief Reads the first cluster of a cluster chain.
+ * @param pPartition The current partition.
+ * @param pLocation The current location.
+ * @return Nothing.
+ * @ingroup General
+ */
+#define FAT_ReadFirstSector(pPartition, pLocation) FAT_LoadSector(pPartition, (pLocation)->Sector)
+
+/**
+ * @note After a call to FAT_Seek, the first sector in the cluster
+ * must be read by calling FAT_ReadFirstSector.
+ * The following sectors can be read using this function.
+ *
+ * When the end of the cluster chain is reached, no sector is read and 
+ * pLocation->Cluster is set to an end of chain marker, which makes
+ * FAT_IsCurrentClusterValid return FALSE.
+ *
+ * @brief Reads the next sector, following the cluster chain. 
+ * @param pPartition The currently active partition.
+ * @param pLocation The current location.
+ * @return Nothing.
+ * @ingroup General
+ *
+ * @see FAT_Seek, FAT_ReadFirstSector, FAT_ReadNextCluster
+ */ 
+FAT_API void FAT_ReadNextSector(TFatPartition* pPartition, TFatLocation* pLocation);
+
+/**
+ * Reads the sectors from pLocation->Sector up to the end of the cluster
+ * with as few device requests as possible. After a call to FAT_Seek, this
+ * is the whole cluster. pDest must be large enough for SectorsPerCluster 
+ * sectors.
+ *
+ * On exit, pLocation refers to the last sector of the cluster, so the
+ * next call to FAT_ReadNextSector or FAT_ReadNextCluster continues in the 
+ * following cluster. pPartition->pBuffer is not touched.
+ *
+ * @brief Reads the remaining sectors of the current cluster into a buffer.
+ * @param pPartition The current partition.
+ * @param pLocation  The current location.
+ * @param pDest      The buffer to read the sectors into.
+ * @return The number of sectors read.
+ * @ingroup General
+ *
+ * @see FAT_Seek, FAT_ReadNextCluster, FAT_ReadSectors
+ */
+FAT_API uint8_t FAT_ReadCluster(TFatPartition* pPartition, TFatLocation* pLocation, uint8_t* pDest);
+
+/**
+ * Follows the cluster chain to the next cluster and reads all of its 
+ * sectors into pDest, which must be large enough for SectorsPerCluster 
+ * sectors.
+ *
+ * If the end of the cluster chain is reached, nothing is read and 
+ * pLocation->Cluster is set to an end of chain marker.
+ *
+ * @brief Reads the next cluster, following the cluster chain.
+ * @param pPartition The current partition.
+ * @param pLocation  The current location.
+ * @param pDest      The buffer to read the sectors into.
+ * @return The number of sectors read, or 0 at the end of the cluster chain.
+ * @ingroup General
+ *
+ * @see FAT_ReadCluster
+ */
+FAT_API uint8_t FAT_ReadNextCluster(TFatPartition* pPartition, TFatLocation* pLocation, uint8_t* pDest);
+
+/**
+ * On exit, FAT_IsLastDirectoryEntry should be called to see if
+ * an entry is found. To see if the entry is valid, FAT_IsDirEntryDeleted
+ * should be called.
+ *
+ * To iterate to the next directory entry, FAT_GetNextDirectoryEntry should 
+ * be used. Note that it's important to preserve pDirLocation 
+ * between these calls.
+ *
+ * To find the first directory of the root directory, use
+ * FAT_GetFirstRootDirectory instead.
+ *
+ * @brief Finds the first directory entry in the directory that starts at 'StartCluster'.
+ * @param pPartition   The current partition.
+ * @param StartCluster The cluster where the directory starts.
+ * @param pDirLocation Contains information about the currently examined directory entry. The initial values are ignored.
+ * @return Nothing.
+ * @ingroup Dir
+ *
+ * @see FAT_GetNextDirectoryEntry, FAT_IsLastDirectoryEntry, FAT_IsDirEntryDeleted FAT_GetFirstRootDirEntry
+ */
+FAT_API void FAT_GetFirstDirectoryEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * Iterates to the next Directory Entry. FAT_GetFirstDirectoryEntry
+ * must have been called prior to calling this function. 
+ *
+ * To iterate a root directory, use FAT_GetNextRootDirEntry
+ * instead. 
+ *
+ * It is important to preserve the contents of pDirLocation between calls
+ * to this function.
+ *
+ * On exit, FAT_IsLastDirectoryEntry should be called to see if
+ * an entry is found. To see if the entry is valid, FAT_IsDirEntryDeleted
+ * should be called.
+ *
+ * @brief Iterates to the next directory entry.
+ * @param pPartition The current partition.
+ * @param pDirLocation Contains information about the currently examined directory entry. The initial values are ignored.
+ * @return Nothing.
+ * @ingroup Dir
+ *
+ * @see FAT_GetFirstDirectoryEntry, FAT_IsLastDirectoryEntry, FAT_IsDirEntryDeleted FAT_GetNextRootDirEntry
+ */
+FAT_API void FAT_GetNextDirectoryEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * Only valid (i.e. not deleted) entries will be searched for and long file names are not supported.
+ *
+ * pDirLocation will contain the information where the entry is located on success. On failure,
+ * its contents will be overwritten. The initial values are ignored.
+ *
+ * The name specified should be in 8.3 format. Example: "README  TXT". 
+ *
+ * To find a root directory entry, use FAT_FindRootDirEntry.
+ *
+ * If pPartition->pNameIndex is not NULL, the directory name index is used,
+ * see FAT_FindIndexedDirEntry.
+ *
+ * @brief Finds the directory entry specified.
+ * @param pPartition       The current partition.
+ * @param DirectoryCluster The first cluster of the directory to be searched.
+ * @param pName            The name of the directory entry to match. The name should be in 8.3 format and
+ *                         does not have to be null-terminated.
+ * @param pDirLocation     Information where the directory entry is located.
+ * @return A pointer to the entry information on success. Will be NULL if the entry was not found.
+ * @ingroup Dir
+ */
+FAT_API TFatDirEntry* FAT_FindDirEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, char* pName, TFatDirectoryLocation* pDirLocation);
+
+
+/**
+ * On exit, FAT_IsLastDirectoryEntry should be called to see if
+ * an entry is found. To see if the entry is valid, FAT_IsDirEntryDeleted
+ * should be called.
+ *
+ * To iterate to the next directory entry, FAT_GetNextRootDirectoryEntry should 
+ * be used. Note that it's important to preserve pDirLocation 
+ * between these calls.
+ *
+ * @brief Finds the first root directory entry
+ * @param pPartition   The current partition.
+ * @param pDirLocation Contains information about the currently examined directory entry. The initial values are ignored.
+ * @return Nothing.
+ * @ingroup Dir
+ *
+ * @see FAT_GetNextRootDirEntry, FAT_IsLastDirectoryEntry, FAT_IsDirEntryDeleted 
+ */
+#define FAT_GetFirstRootDirEntry(pPartition, pDirLocation) \
+  (FAT_Cond(pPartition, \
+            FAT16_GetFirstRootDirEntry(pPartition, pDirLocation), \
+            FAT32_GetFirstRootDirEntry(pPartition, pDirLocation)))
+
+/**
+ * Only valid (i.e. not deleted) entries will be searched for and long file names are not supported.
+ *
+ * pDirLocation will contain the information where the entry is located on success. On failure,
+ * its contents will be overwritten. The initial values are ignored.
+ *
+ * The name specified should be in 8.3 format. Example: "README  TXT". 
+ *
+ * @brief Finds the root directory entry specified.
+ * @param pPartition       The current partition.
+ * @param pName            The name of the directory entry to match. The name should be in 8.3 format and
+ *                         does not have to be null-terminated.
+ * @param pDirLocation     Information where the directory entry is located.
+ * @return A pointer to the entry information on success. Will be NULL if the entry was not found.
+ * @ingroup Dir
+ */
+#define FAT_FindRootDirEntry(pPartition, pName, pDirLocation) \
+  (FAT_Cond(pPartition, \
+            FAT16_FindRootDirEntry(pPartition, pName, pDirLocation), \
+            FAT32_FindRootDirEntry(pPartition, pName, pDirLocation)))
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * On success, pDirLocation will contain location information of the new entry. A pointer to the 
+ * directory entry structure will also be returned and can be filled out. FAT_StoreSector must
+ * be called with pDirLocation->Location.Sector as parameter to finally store the information.
+ *
+ * On failure, NULL is returned.
+ *
+ * If pPartition->pDirHints is not NULL, the search for a free entry starts
+ * where the previous entry of the directory was created.
+ *
+ * @brief Create a new Directory Entry to the directory that starts at StartCluster.
+ * @param pPartition   The current partition.
+ * @param StartCluster The cluster which the directory starts at.
+ * @param pDirLocation The location information to the directory entry.
+ * @return A pointer to where the directory entry information can be stored, or NULL on failure.
+ * @ingroup Dir
+ *
+ * @see FAT_StoreSector, FAT_GetDirHint
+ */
+FAT_API TFatDirEntry* FAT_CreateDirEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * The FAT16 root directory has a fixed number of entries and can not be
+ * extended, so this fails when all of them are in use.
+ *
+ * @brief Creates a new directory entry in the root directory.
+ * @param pPartition   The current partition.
+ * @param pDirLocation The location information to the directory entry.
+ * @return A pointer to where the directory entry information can be stored, or NULL on failure.
+ * @ingroup Dir
+ *
+ * @see FAT_CreateDirEntry
+ */
+#define FAT_CreateRootDirEntry(pPartition, pDirLocation) \
+  (FAT_Cond(pPartition, \
+            FAT16_CreateRootDirEntry(pPartition, pDirLocation), \
+            FAT32_CreateRootDirEntry(pPartition, pDirLocation)))
+
+/**
+ * On success, the FirstCluster specified will link to the newly allocated
+ * cluster, continuing the cluster chain. 
+ *
+ * If FirstCluster is zero (0), the created cluster will not continue 
+ * a cluster chain and will be the first cluster in a new cluster chain.
+ *
+ * On success, pLocation will be updated with the new cluster.
+ *
+ * If 0 is returned, the disk is full and a new cluster can not be allocated.
+ *
+ * @brief Creates a new cluster.
+ * @param pPartition   The current partition.
+ * @param FirstCluster The cluster number that will link to this cluster. 
+ *                     May be zero (0) to not link to the new cluster.
+ * @param pLocation    Location information about the new cluster on success. 
+ * @return 1 on success, 0 on failure.
+ * @ingroup FAT
+ */
+FAT_API uint8_t FAT_CreateCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatLocation* pLocation);
+
+
+/**
+ * Initialises the Directory Entry to all zeros
+ * except the filename specified.
+ * 
+ * @brief Initialises the current Directory Entry
+ * @param pPartition The current partition.
+ * @param pDirLocation The location information to the directory entry.
+ * @param pDirEntryName The name of the directory entry.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+void FAT_InitDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation, const char* pDirEntryName);
+
+/**
+ * The first character of the name is set to 0xE5 and the sector is stored.
+ * The cluster chain of the entry is not freed.
+ *
+ * @brief Marks a directory entry as deleted.
+ * @param pPartition   The current partition.
+ * @param pDirLocation The location of the directory entry, as returned by FAT_FindDirEntry.
+ * @return Nothing.
+ * @ingroup Dir
+ *
+ * @see FAT_IsDirEntryDeleted
+ */
+FAT_API void FAT_DeleteDirEntry(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation);
+#endif
+
+/**
+ * The library itself reads sectors through FAT_LoadSector, which only calls this
+ * function when the sector is not found in the sector cache.
+ *
+ * @brief Reads a sector on the disk into pPartition->pBuffer.
+ * @param pPartition The partition to read. 
+ * @param SectorNr   The sector number to read.
+ * @return Nothing.
+ * @ingroup Device
+ *
+ * @see TFatDevice, FAT_LoadSector
+ */
+#define FAT_ReadSector(pPartition, SectorNr) FAT_ReadSectors(pPartition, SectorNr, 1, (pPartition)->pBuffer)
+
+/**
+ * Reads consecutive sectors in one request. This lets the device do large
+ * transfers and avoids the per-call overhead of FAT_ReadSector.
+ *
+ * If the device does not implement TFatDevice::ReadSectors, the sectors are
+ * read one at a time using TFatDevice::ReadSector.
+ *
+ * @brief Reads consecutive sectors on the disk.
+ * @param pPartition The partition to read. 
+ * @param SectorNr   The first sector number to read.
+ * @param Count      The number of sectors to read.
+ * @param pDest      The buffer to read to, large enough for Count sectors.
+ * @return Nothing.
+ * @ingroup Device
+ *
+ * @see TFatDevice, FAT_LoadSectors
+ */
+FAT_API void FAT_ReadSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, uint8_t* pDest);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * The library itself writes sectors through FAT_StoreSector, which keeps the
+ * sector cache up to date before calling this function.
+ *
+ * @brief Writes the contents of pPartition->pBuffer to a sector on the disk.
+ * @param pPartition The partition to write. 
+ * @param SectorNr   The sector number to write.
+ * @return Nothing.
+ * @ingroup Device
+ *
+ * @see TFatDevice, FAT_StoreSector
+ */
+#define FAT_WriteSector(pPartition, SectorNr) FAT_WriteSectors(pPartition, SectorNr, 1, (pPartition)->pBuffer)
+
+/**
+ * If the device does not implement TFatDevice::WriteSectors, the sectors are
+ * written one at a time using TFatDevice::WriteSector.
+ *
+ * @brief Writes consecutive sectors on the disk.
+ * @param pPartition The partition to write. 
+ * @param SectorNr   The first sector number to write.
+ * @param Count      The number of sectors to write.
+ * @param pSource    The sector contents, Count sectors long.
+ * @return Nothing.
+ * @ingroup Device
+ *
+ * @see TFatDevice, FAT_StoreSectors
+ */
+FAT_API void FAT_WriteSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource);
+
+/**
+ * When FAT_CACHE_WRITE_BACK is configured, FAT_StoreSector only updates the
+ * sector cache and the modified sectors are written when they are evicted or
+ * when this function is called. The application must call this function 
+ * before the disk is removed or powered off. 
+ *
+ * Modifications of the FAT are only made to the first FAT table. They are
+ * copied to the other FAT tables by this function, see FAT_MirrorFAT.
+ *
+ * Finally, TFatDevice::Flush is called if the device implements it.
+ *
+ * @brief Writes all modified sectors to the disk.
+ * @param pPartition The current partition.
+ * @return Nothing.
+ * @ingroup General
+ *
+ * @see FAT_StoreSector
+ */
+FAT_API void FAT_Flush(TFatPartition* pPartition);
+#endif
+
+FAT_API uint32_t FAT_GetRootOffset(const TFatPartition* pPartition);
+
+#ifdef FAT_ENABLE_STATS
+/**
+ * @brief Returns the disk region a sector belongs to.
+ * @param pPartition The current partition.
+ * @param SectorNr   The sector number.
+ * @return FAT_REGION_BOOT, FAT_REGION_FAT, FAT_REGION_ROOT or FAT_REGION_DATA.
+ * @ingroup Device
+ *
+ * @see TFatStats
+ */
+FAT_API uint8_t FAT_GetSectorRegion(const TFatPartition* pPartition, uint32_t SectorNr);
+
+/**
+ * GetTime, Trace and pContext are kept.
+ *
+ * @brief Sets all counters of the I/O statistics to zero (0).
+ * @param pStats The I/O statistics.
+ * @return Nothing.
+ * @ingroup Device
+ */
+FAT_API void FAT_ResetStats(TFatStats* pStats);
+#endif
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * SecondCluster is marked as the last cluster of the chain. If FirstCluster
+ * is zero (0), SecondCluster becomes the first cluster of a new chain.
+ *
+ * @brief Links two clusters in the FAT.
+ * @param pPartition    The current partition.
+ * @param SourceCluster The cluster that will link to SecondCluster, or zero (0).
+ * @param SecondCluster The cluster to append to the chain.
+ * @return Nothing.
+ * @ingroup FAT
+ *
+ * @see FAT_FindFreeCluster, FAT_CreateCluster
+ */
+#define FAT_LinkClusters(pPartition, SourceCluster, SecondCluster) (FAT_Cond(pPartition, FAT16_LinkClusters(pPartition, SourceCluster, SecondCluster), FAT32_LinkClusters(pPartition, SourceCluster, SecondCluster)))
+#endif
+
+#ifdef FAT_DEBUG
+/** @brief A debug macro. Whatever is encapsulated with this macro will only be present when debugging. 
+ */
+#define D_(stmt) stmt
+#else
+#define D_(stmt) 
+#endif
+
+#ifdef FAT_ENABLE_STATS
+/** @brief A statistics macro. Whatever is encapsulated with this macro will only be present when FAT_ENABLE_STATS is configured. 
+ */
+#define S_(stmt) stmt
+#else
+#define S_(stmt) 
+#endif
+
+#endif /* FAT_H_INCLUSION_GUARD */
+
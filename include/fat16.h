@@ -1,53 +1,72 @@
-#ifndef FAT16_H_INCLUSION_GUARD
-#define FAT16_H_INCLUSION_GUARD
-
-#include "../fat_conf.h"
-
-/**
- * @brief The FAT16 specific implementation of FAT_GetSectorsPerFAT
- * @see FAT_GetSectorsPerFat
- * @ingroup FAT
- */
-#define FAT16_GetSectorsPerFAT(pVolumeID) (*(uint16_t*)(pVolumeID + 0x16))
-
-#define FAT16_GetRootDirectorySector(pVolumeID) (FAT_PartitionLBA + FAT_GetReservedSectors(pVolumeID) + FAT_NUMBER_OF_FATS * FAT_GetSectorsPerFAT(pVolumeID))
-
-#define FAT16_GetStartCluster(pDirEntry) (uint16_t)(pDirEntry->StartClusterLow)
-#define FAT16_IsLastDirEntry(pPartition, pDirEntry, pDirLocation) ((pDirEntry->Name[0] == 0x00) || !FAT16_IsCurrentClusterValid(pPartition, &(pDirLocation)->Location))
-#define FAT16_IsCurrentClusterValid(pPartition, pLocation) ((pLocation)->Cluster != 0xFFFF)
-
-/**
- * @brief The FAT16 specific implementation of FAT_GetNextCluster
- * @see FAT_GetNextCluster
- * @ingroup FAT
- */
-FAT_API TFatClusterNr FAT16_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster);
-
-/**
- * @brief The FAT16 specific implementation of FAT_GetFirstRootDirEntry
- * @see FAT_GetFirstRootDirEntry
- * @ingroup Dir
- */
-FAT_API void FAT16_GetFirstRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
-
-/**
- * @brief The FAT16 specific implementation of FAT_GetNextRootDirEntry
- * @see FAT_GetNextRootDirEntry
- * @ingroup Dir
- */
-FAT_API void FAT16_GetNextRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
-
-/**
- * @brief The FAT16 specific implementation of FAT_FindRootDirEntry
- * @see FAT_FindRootDirEntry
- * @ingroup Dir
- */
-FAT_API TFatDirEntry* FAT16_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation);
-
-#ifdef FAT_ENABLE_WRITE
-FAT_API TFatClusterNr FAT16_FindFreeCluster(TFatPartition* pPartition);
-
-FAT_API void FAT16_LinkClusters(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatClusterNr SecondCluster);
-#endif
-
-#endif
+#ifndef FAT16_H_INCLUSION_GUARD
+#define FAT16_H_INCLUSION_GUARD
+
+#include "../fat_conf.h"
+
+/**
+ * @brief The FAT16 specific implementation of FAT_GetSectorsPerFAT
+ * @see FAT_GetSectorsPerFat
+ * @ingroup FAT
+ */
+#define FAT16_GetSectorsPerFAT(pVolumeID) (*(uint16_t*)(pVolumeID + 0x16))
+
+#define FAT16_GetRootDirectorySector(pVolumeID) (FAT_PartitionLBA + FAT_GetReservedSectors(pVolumeID) + FAT_GetNrOfFATs(pVolumeID) * FAT_GetSectorsPerFAT(pVolumeID))
+
+#define FAT16_GetStartCluster(pDirEntry) (uint16_t)(pDirEntry->StartClusterLow)
+#define FAT16_IsLastDirEntry(pPartition, pDirEntry, pDirLocation) ((pDirEntry->Name[0] == 0x00) || !FAT16_IsCurrentClusterValid(pPartition, &(pDirLocation)->Location))
+#define FAT16_IsCurrentClusterValid(pPartition, pLocation) ((pLocation)->Cluster != 0xFFFF)
+
+/**
+ * @brief The FAT16 specific implementation of FAT_IsEndOfChain
+ * @see FAT_IsEndOfChain
+ * @ingroup FAT
+ */
+#define FAT16_IsEndOfChain(ClusterNr) ((uint16_t)(ClusterNr) >= 0xFFF8)
+
+/**
+ * @brief The FAT16 specific implementation of FAT_GetNextCluster
+ * @see FAT_GetNextCluster
+ * @ingroup FAT
+ */
+FAT_API TFatClusterNr FAT16_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster);
+
+/**
+ * @brief The FAT16 specific implementation of FAT_GetFirstRootDirEntry
+ * @see FAT_GetFirstRootDirEntry
+ * @ingroup Dir
+ */
+FAT_API void FAT16_GetFirstRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * @brief The FAT16 specific implementation of FAT_GetNextRootDirEntry
+ * @see FAT_GetNextRootDirEntry
+ * @ingroup Dir
+ */
+FAT_API void FAT16_GetNextRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * @brief The FAT16 specific implementation of FAT_FindRootDirEntry
+ * @see FAT_FindRootDirEntry
+ * @ingroup Dir
+ */
+FAT_API TFatDirEntry* FAT16_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * @brief Returns the first free cluster from FirstCluster to the end of the partition, or zero (0) if there is none.
+ * @see FAT_FindFreeCluster
+ * @ingroup FAT
+ */
+FAT_API TFatClusterNr FAT16_FindFreeCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster);
+
+/**
+ * @brief The FAT16 specific implementation of FAT_CreateRootDirEntry
+ * @see FAT_CreateRootDirEntry
+ * @ingroup Dir
+ */
+FAT_API TFatDirEntry* FAT16_CreateRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
+
+FAT_API void FAT16_LinkClusters(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatClusterNr SecondCluster);
+#endif
+
+#endif
@@ -1,40 +1,147 @@
-#ifndef FAT32_H_INCLUSION_GUARD
-#define FAT32_H_INCLUSION_GUARD
-
-/**
- * @brief The FAT32 specific implementation of FAT_GetSectorsPerFAT
- * @see FAT_GetSectorsPerFat
- * @ingroup FAT
- */
-#define FAT32_GetSectorsPerFAT(pVolumeID) (*(uint32_t*)(pVolumeID + 0x24))
-
-#define FAT32_GetRootDirectoryCluster(pVolumeID) (TFatClusterNr)*(uint32_t*)(pVolumeID + 0x2c)
-
-#define FAT32_GetStartCluster(pDirEntry) (uint32_t)((pDirEntry->StartClusterHigh << 16) + pDirEntry->StartClusterLow)
-
-#define FAT32_IsLastDirEntry(pPartition, pDirEntry, pDirLocation) ((pDirEntry->Name[0] == 0x00) || !FAT32_IsCurrentClusterValid(pPartition, &(pDirLocation)->Location))
-
-#define FAT32_IsCurrentClusterValid(pPartition, pLocation) ((pLocation)->Cluster != 0x0FFFFFFF)
-
-/**
- * @brief The FAT32 specific implementation of FAT_GetNextCluster
- * @see FAT_GetNextCluster
- * @ingroup FAT
- */
-FAT_API TFatClusterNr FAT32_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster);
-
-/**
- * @brief The FAT16 specific implementation of FAT_GetFirstRootDirEntry
- * @see FAT_GetFirstRootDirEntry
- * @ingroup Dir
- */
-FAT_API void FAT32_GetFirstRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
-
-/**
- * @brief The FAT32 specific implementation of FAT_FindRootDirEntry
- * @see FAT_FindRootDirEntry
- * @ingroup Dir
- */
-FAT_API TFatDirEntry* FAT32_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation);
-
-#endif
+#ifndef FAT32_H_INCLUSION_GUARD
+#define FAT32_H_INCLUSION_GUARD
+
+/**
+ * @brief The FAT32 specific implementation of FAT_GetSectorsPerFAT
+ * @see FAT_GetSectorsPerFat
+ * @ingroup FAT
+ */
+#define FAT32_GetSectorsPerFAT(pVolumeID) (*(uint32_t*)(pVolumeID + 0x24))
+
+#define FAT32_GetRootDirectoryCluster(pVolumeID) (TFatClusterNr)*(uint32_t*)(pVolumeID + 0x2c)
+
+/**
+ * @brief Returns the extended flags of a FAT32 partition.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The extended flags. See FAT32_MIRRORING_DISABLED.
+ * @ingroup Partition
+ */
+#define FAT32_GetExtFlags(pVolumeID) *(uint16_t*)(pVolumeID + 0x28)
+
+/**
+ * @brief Set in the extended flags if only the active FAT is used and the other FAT tables are not updated.
+ * @see FAT32_GetExtFlags
+ * @ingroup Partition
+ */
+#define FAT32_MIRRORING_DISABLED (0x0080)
+
+/**
+ * @brief Returns the FSInfo sector number, relative to the start of the partition.
+ * @param pVolumeID A pointer to the contents of the Volume ID sector.
+ * @return The FSInfo sector number. Zero (0) or 0xFFFF if there is none.
+ * @ingroup Partition
+ */
+#define FAT32_GetFSInfoSector(pVolumeID) *(uint16_t*)(pVolumeID + 0x30)
+
+/**
+ * @brief Indicates if the FSInfo sector is valid.
+ * @param pFSInfo A pointer to the contents of the FSInfo sector.
+ * @return TRUE if all three signatures are present. FALSE otherwise.
+ * @ingroup Partition
+ */
+#define FAT32_IsFSInfoValid(pFSInfo) ((*(uint32_t*)(pFSInfo + 0x000) == 0x41615252UL) && \
+                                      (*(uint32_t*)(pFSInfo + 0x1E4) == 0x61417272UL) && \
+                                      (*(uint32_t*)(pFSInfo + 0x1FC) == 0xAA550000UL))
+
+/**
+ * @note The value is only a hint and is 0xFFFFFFFF if unknown.
+ * @brief Returns the free cluster count stored in the FSInfo sector.
+ * @param pFSInfo A pointer to the contents of the FSInfo sector.
+ * @return The last known number of free clusters.
+ * @ingroup Partition
+ */
+#define FAT32_GetFSInfoFreeCount(pFSInfo) *(uint32_t*)(pFSInfo + 0x1E8)
+
+/**
+ * @note The value is only a hint and is 0xFFFFFFFF if unknown.
+ * @brief Returns the cluster where the search for a free cluster should start.
+ * @param pFSInfo A pointer to the contents of the FSInfo sector.
+ * @return The next free cluster hint.
+ * @ingroup Partition
+ */
+#define FAT32_GetFSInfoNextFree(pFSInfo) *(uint32_t*)(pFSInfo + 0x1EC)
+
+#define FAT32_GetStartCluster(pDirEntry) (uint32_t)((pDirEntry->StartClusterHigh << 16) + pDirEntry->StartClusterLow)
+
+#define FAT32_IsLastDirEntry(pPartition, pDirEntry, pDirLocation) ((pDirEntry->Name[0] == 0x00) || !FAT32_IsCurrentClusterValid(pPartition, &(pDirLocation)->Location))
+
+#define FAT32_IsCurrentClusterValid(pPartition, pLocation) ((pLocation)->Cluster != 0x0FFFFFFF)
+
+/**
+ * @brief The FAT32 specific implementation of FAT_IsEndOfChain
+ * @see FAT_IsEndOfChain
+ * @ingroup FAT
+ */
+#define FAT32_IsEndOfChain(ClusterNr) ((uint32_t)(ClusterNr) >= 0x0FFFFFF8)
+
+/**
+ * @brief The FAT32 specific implementation of FAT_GetNextCluster
+ * @see FAT_GetNextCluster
+ * @ingroup FAT
+ */
+FAT_API TFatClusterNr FAT32_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster);
+
+/**
+ * @brief The FAT16 specific implementation of FAT_GetFirstRootDirEntry
+ * @see FAT_GetFirstRootDirEntry
+ * @ingroup Dir
+ */
+FAT_API void FAT32_GetFirstRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * @brief The FAT32 specific implementation of FAT_FindRootDirEntry
+ * @see FAT_FindRootDirEntry
+ * @ingroup Dir
+ */
+FAT_API TFatDirEntry* FAT32_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * If the partition has a valid FSInfo sector, its free cluster count and
+ * next free cluster hint are used to initialise pPartition->FreeClusters
+ * and pPartition->NextFreeCluster, so allocation continues where the last
+ * session stopped without scanning the FAT. Called by FAT_OpenPartition 
+ * while the Volume ID sector is in pPartition->pBuffer.
+ *
+ * @brief Reads the FSInfo sector.
+ * @param pPartition The current partition.
+ * @return Nothing.
+ * @ingroup Partition
+ */
+FAT_API void FAT32_ReadFSInfo(TFatPartition* pPartition);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * @brief The FAT32 specific implementation of FAT_FindFreeCluster
+ * @return The first free cluster from FirstCluster to the end of the partition, or zero (0) if there is none.
+ * @see FAT_FindFreeCluster
+ * @ingroup FAT
+ */
+FAT_API TFatClusterNr FAT32_FindFreeCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster);
+
+/**
+ * @brief The FAT32 specific implementation of FAT_CreateRootDirEntry
+ * @see FAT_CreateRootDirEntry
+ * @ingroup Dir
+ */
+FAT_API TFatDirEntry* FAT32_CreateRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * @brief The FAT32 specific implementation of FAT_LinkClusters
+ * @see FAT_LinkClusters
+ * @ingroup FAT
+ */
+FAT_API void FAT32_LinkClusters(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatClusterNr SecondCluster);
+
+/**
+ * Stores pPartition->FreeClusters and pPartition->NextFreeCluster in the
+ * FSInfo sector if they have changed. Called by FAT_Flush.
+ *
+ * @brief Updates the FSInfo sector.
+ * @param pPartition The current partition.
+ * @return Nothing.
+ * @ingroup Partition
+ */
+FAT_API void FAT32_WriteFSInfo(TFatPartition* pPartition);
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef FATALLOC_H_INCLUSION_GUARD
+#define FATALLOC_H_INCLUSION_GUARD
+
+#ifdef FAT_ENABLE_WRITE
+
+#ifdef FAT_ENABLE_FREE_MAP
+/**
+ * One bit is used per cluster number, including the two reserved ones.
+ *
+ * @brief Returns the size of the free-cluster bitmap needed for a partition.
+ * @param ClusterCount The number of data clusters (TFatPartition::ClusterCount).
+ * @return The minimum value of TFatPartition::FreeMapSize, in bytes.
+ * @ingroup FAT
+ */
+#define FAT_FREE_MAP_SIZE(ClusterCount) (((uint32_t)(ClusterCount) + 2 + 7) / 8)
+#endif
+
+/**
+ * The search is next-fit: it starts at pPartition->NextFreeCluster, 
+ * which is moved past the returned cluster, and wraps around at the end
+ * of the partition. Allocating a sequence of clusters therefore does not
+ * search the already used part of the disk again.
+ *
+ * If FAT_ENABLE_FREE_MAP is configured and pPartition->pFreeMap is large
+ * enough (see FAT_FREE_MAP_SIZE), a bitmap of the used clusters is built
+ * on the first call and searched instead of the FAT. Building the bitmap
+ * also counts the free clusters. Otherwise, the FAT is searched.
+ *
+ * The returned cluster is considered to be in use and should be linked 
+ * using FAT_LinkClusters.
+ *
+ * @brief Finds a free cluster.
+ * @param pPartition The current partition.
+ * @return The free cluster number, or zero (0) if the disk is full.
+ * @ingroup FAT
+ *
+ * @see FAT_CreateCluster, FAT_LinkClusters
+ */
+FAT_API TFatClusterNr FAT_FindFreeCluster(TFatPartition* pPartition);
+
+/**
+ * Allocates a run of consecutive clusters and links it to the end of a
+ * cluster chain. A run of Count clusters is preferred. If the free space is
+ * too fragmented for that, the longest run found is allocated instead, and
+ * the function can be called again with the last allocated cluster as
+ * PrevCluster to allocate the rest.
+ *
+ * The run is searched for like FAT_FindFreeCluster does. The chain is 
+ * written with one read-modify-write per affected FAT sector, instead of
+ * two per cluster when using FAT_CreateCluster.
+ *
+ * @brief Allocates consecutive clusters.
+ * @param pPartition    The current partition.
+ * @param PrevCluster   The last cluster of the chain to extend, or zero (0) to start a new chain.
+ * @param Count         The number of clusters wanted.
+ * @param pStartCluster Receives the first allocated cluster. The allocated 
+ *                      clusters range from *pStartCluster to 
+ *                      *pStartCluster + (return value) - 1.
+ * @return The number of clusters allocated, at most Count. Zero (0) if the disk is full.
+ * @ingroup FAT
+ *
+ * @see FAT_FindFreeCluster, FAT_CreateCluster
+ */
+FAT_API TFatClusterNr FAT_AllocateClusters(TFatPartition* pPartition, TFatClusterNr PrevCluster, TFatClusterNr Count, TFatClusterNr* pStartCluster);
+
+/**
+ * Frees a cluster chain from StartCluster to its end. If PrevCluster is
+ * not zero (0), it is marked as the last cluster of its chain, so the chain
+ * is truncated after PrevCluster.
+ *
+ * The links of the chain that are in the same FAT sector are freed with
+ * one read-modify-write of the sector. pPartition->FreeClusters and the
+ * free-cluster bitmap are updated, and pPartition->NextFreeCluster is moved
+ * back to the lowest freed cluster so that the space is reused first.
+ *
+ * @brief Frees a cluster chain.
+ * @param pPartition   The current partition.
+ * @param PrevCluster  The cluster that links to StartCluster, or zero (0).
+ * @param StartCluster The first cluster to free.
+ * @return The number of clusters freed.
+ * @ingroup FAT
+ *
+ * @see FAT_AllocateClusters
+ */
+FAT_API TFatClusterNr FAT_FreeClusters(TFatPartition* pPartition, TFatClusterNr PrevCluster, TFatClusterNr StartCluster);
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef FATCACHE_H_INCLUSION_GUARD
+#define FATCACHE_H_INCLUSION_GUARD
+
+#ifdef FAT_CACHE_SECTORS
+/**
+ * Invalidates all entries and resets the statistics counters. pCache->pData
+ * must be set prior to calling this function.
+ *
+ * This is done by FAT_OpenPartition and only needs to be called by the
+ * application if the cache is reused for another disk. Modified sectors
+ * are discarded, so FAT_Flush must be called first when using a write-back
+ * cache.
+ *
+ * @brief Initialises a sector cache.
+ * @param pCache The sector cache.
+ * @return Nothing.
+ * @ingroup Cache
+ */
+FAT_API void FAT_InitCache(TFatCache* pCache);
+#endif
+
+/**
+ * If the sector is held by the sector cache, it is copied from the cache.
+ * Otherwise, it is read using FAT_ReadSector and inserted into the cache,
+ * replacing the least recently used entry. If pPartition->pCache is NULL
+ * or the cache is not configured, this is the same as calling 
+ * FAT_ReadSector.
+ *
+ * If the device provides TFatDevice::MapSector, pPartition->pBuffer is 
+ * pointed at the sector in device memory instead, and the sector cache is
+ * not used.
+ *
+ * @brief Loads a sector into pPartition->pBuffer.
+ * @param pPartition The current partition.
+ * @param SectorNr   The sector number to load.
+ * @return Nothing.
+ * @ingroup Cache
+ *
+ * @see FAT_StoreSector, FAT_ReadSector
+ */
+FAT_API void FAT_LoadSector(TFatPartition* pPartition, uint32_t SectorNr);
+
+/**
+ * The sectors are read with a single FAT_ReadSectors request and are not
+ * inserted into the sector cache, since bulk data would evict the more
+ * frequently used FAT and directory sectors. Sectors that are held by the
+ * cache in a modified state are copied from the cache.
+ * If pPartition->pCache is NULL, this is the same as calling FAT_ReadSectors.
+ *
+ * @brief Loads consecutive sectors into a buffer.
+ * @param pPartition The current partition.
+ * @param SectorNr   The first sector number to load.
+ * @param Count      The number of sectors to load.
+ * @param pDest      The buffer to load to, large enough for Count sectors.
+ * @return Nothing.
+ * @ingroup Cache
+ *
+ * @see FAT_ReadSectors
+ */
+FAT_API void FAT_LoadSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, uint8_t* pDest);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * With the default write-through cache, the sector is written using 
+ * FAT_WriteSector. If the sector is held by the sector cache, the cached
+ * copy is updated as well.
+ *
+ * If FAT_CACHE_WRITE_BACK is configured, the sector is only stored in the
+ * sector cache and marked as modified. Repeated stores to the same sector
+ * will then result in a single write, which happens when the entry is 
+ * evicted or when FAT_Flush is called.
+ *
+ * @brief Stores the contents of pPartition->pBuffer to a sector.
+ * @param pPartition The current partition.
+ * @param SectorNr   The sector number to store.
+ * @return Nothing.
+ * @ingroup Cache
+ *
+ * @see FAT_LoadSector, FAT_WriteSector, FAT_Flush
+ */
+FAT_API void FAT_StoreSector(TFatPartition* pPartition, uint32_t SectorNr);
+
+/**
+ * The sectors are written with a single FAT_WriteSectors request. Cached
+ * copies of the sectors are updated and are no longer considered modified.
+ * If pPartition->pCache is NULL, this is the same as calling FAT_WriteSectors.
+ *
+ * @brief Stores consecutive sectors from a buffer.
+ * @param pPartition The current partition.
+ * @param SectorNr   The first sector number to store.
+ * @param Count      The number of sectors to store.
+ * @param pSource    The sector contents, Count sectors long.
+ * @return Nothing.
+ * @ingroup Cache
+ *
+ * @see FAT_WriteSectors
+ */
+FAT_API void FAT_StoreSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource);
+
+#ifdef FAT_CACHE_WRITE_BACK
+/**
+ * The sectors are written in ascending sector order.
+ *
+ * @brief Writes all modified sectors in the sector cache to the disk.
+ * @param pPartition The current partition.
+ * @return Nothing.
+ * @ingroup Cache
+ *
+ * @see FAT_Flush
+ */
+FAT_API void FAT_FlushCache(TFatPartition* pPartition);
+#endif
+#endif
+
+#endif
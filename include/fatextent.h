@@ -0,0 +1,70 @@
+#ifndef FATEXTENT_H_INCLUSION_GUARD
+#define FATEXTENT_H_INCLUSION_GUARD
+
+#ifdef FAT_ENABLE_EXTENTS
+/**
+ * @brief A run of consecutive clusters in a cluster chain.
+ * @see TFatExtentMap
+ * @ingroup FAT
+ */
+typedef struct {
+  TFatClusterNr     StartCluster;          /**< The first cluster of the run. */
+  TFatClusterNr     Length;                /**< The number of clusters in the run. */
+  TFatClusterNr     FileCluster;           /**< The position of StartCluster in the cluster chain, counted from zero. */
+} TFatExtent;
+
+/**
+ * @brief A cluster chain, stored as runs of consecutive clusters.
+ * @see FAT_BuildExtentMap, FAT_SeekFileOffset
+ * @ingroup FAT
+ */
+typedef struct {
+  TFatExtent*       pExtents;              /**< A pointer to an array of Capacity extents. Must be specified by the application. */
+  uint16_t          Capacity;              /**< The number of extents that fit in pExtents. Must be specified by the application. */
+  uint16_t          Count;                 /**< The number of extents in use. */
+  TFatClusterNr     ClusterCount;          /**< The number of clusters described by the extents. */
+  uint8_t           Complete;              /**< 1 if the extents describe the whole cluster chain, 0 if it did not fit. */
+} TFatExtentMap;
+
+/**
+ * Follows the cluster chain once and stores it as runs of consecutive 
+ * clusters. A file that was written to a disk with little fragmentation
+ * is described by a handful of extents, regardless of its size.
+ *
+ * If the chain has more runs than pMap->Capacity, the map describes the
+ * beginning of the chain and FAT_SeekFileOffset follows the cluster chain
+ * from the last mapped cluster when seeking beyond it.
+ *
+ * @brief Builds the extent map of a cluster chain.
+ * @param pPartition   The current partition.
+ * @param StartCluster The first cluster of the chain, or 0 for an empty file.
+ * @param pMap         The extent map to build. pExtents and Capacity must be set.
+ * @return 1 if the whole chain was mapped, 0 if it did not fit.
+ * @ingroup FAT
+ *
+ * @see FAT_SeekFileOffset
+ */
+FAT_API uint8_t FAT_BuildExtentMap(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatExtentMap* pMap);
+
+/**
+ * Finds the sector holding the given byte offset with a binary search 
+ * over the extents, so no FAT sectors have to be read as long as the 
+ * offset is within the mapped part of the chain. On success, the sector
+ * can be read using FAT_ReadFirstSector, and the following sectors using
+ * FAT_ReadNextSector. The byte within the sector is 
+ * Offset % FAT_BYTES_PER_SECTOR.
+ *
+ * @brief Seeks to a byte offset within a file.
+ * @param pPartition The current partition.
+ * @param pMap       The extent map of the file.
+ * @param Offset     The byte offset from the start of the file.
+ * @param pLocation  Receives the location of the sector holding Offset.
+ * @return 1 on success, 0 if Offset is beyond the end of the cluster chain.
+ * @ingroup General
+ *
+ * @see FAT_BuildExtentMap, FAT_Seek
+ */
+FAT_API uint8_t FAT_SeekFileOffset(TFatPartition* pPartition, const TFatExtentMap* pMap, uint32_t Offset, TFatLocation* pLocation);
+#endif
+
+#endif
@@ -0,0 +1,338 @@
+#ifndef FATFILE_H_INCLUSION_GUARD
+#define FATFILE_H_INCLUSION_GUARD
+
+/**
+ * @brief FAT_FileOpen mode: the file may be written to.
+ * @ingroup File
+ */
+#define FAT_FILE_WRITE (0x01)
+
+/**
+ * @brief FAT_FileOpen mode: an empty file is created if it does not exist. Requires FAT_FILE_WRITE.
+ * @ingroup File
+ */
+#define FAT_FILE_CREATE (0x02)
+
+/**
+ * @brief Set in TFatFile::Flags when the size or the first cluster have changed since the directory entry was updated.
+ * @ingroup File
+ */
+#define FAT_FILE_MODIFIED (0x80)
+
+/**
+ * The handle remembers the cluster holding the current position and its
+ * place in the cluster chain, so reading or writing a file from start to
+ * end follows each link of the chain once. Moving backwards starts over
+ * from the first cluster.
+ *
+ * If FAT_ENABLE_THREADS is configured, the file functions hold the locks
+ * of the partition while they access it: FAT_LOCK_READ for opening and
+ * reading, FAT_LOCK_WRITE for creating and modifying files. Every thread
+ * opens its files on a partition of its own (see FAT_ClonePartition), and
+ * a handle is only used by one thread at a time.
+ *
+ * @brief An open file.
+ * @see FAT_FileOpen
+ * @ingroup File
+ */
+typedef struct {
+  TFatPartition*    pPartition;            /**< The partition holding the file. */
+  TFatDirectoryLocation DirLocation;       /**< The location of the directory entry of the file. */
+  TFatClusterNr     StartCluster;          /**< The first cluster of the file, or zero (0) for an empty file. */
+  uint32_t          Size;                  /**< The file size, in bytes. */
+  uint32_t          Position;              /**< The current position, in bytes from the start of the file. */
+  TFatLocation      Location;              /**< The sector holding Position, or Location.Cluster is zero (0) if it has not been looked up yet. */
+  TFatClusterNr     ClusterIndex;          /**< The position of Location.Cluster in the cluster chain, counted from zero. */
+  TFatClusterNr     RunStart;              /**< The first cluster of the last run of consecutive clusters allocated for the file, or zero (0). */
+  TFatClusterNr     RunEnd;                /**< The last cluster of the run starting at RunStart. */
+  uint8_t           Flags;                 /**< FAT_FILE_WRITE and FAT_FILE_MODIFIED. */
+} TFatFile;
+
+/**
+ * The path is resolved with FAT_OpenPath, so it consists of 8.3 names.
+ * The file is positioned at its start.
+ *
+ * If Mode contains FAT_FILE_CREATE and the file does not exist, an empty
+ * file is created in the directory named by the rest of the path.
+ *
+ * @brief Opens a file.
+ * @param pPartition The current partition.
+ * @param pPath      The null-terminated path of the file.
+ * @param Mode       Zero (0) to read the file, or FAT_FILE_WRITE, optionally with FAT_FILE_CREATE.
+ * @param pFile      The file handle to initialise.
+ * @return 1 on success, 0 if the file was not found or could not be
+ *         created, if the path names a directory, or if a read-only file
+ *         was opened for writing.
+ * @ingroup File
+ *
+ * @see FAT_FileClose, FAT_OpenPath
+ */
+FAT_API uint8_t FAT_FileOpen(TFatPartition* pPartition, const char* pPath, uint8_t Mode, TFatFile* pFile);
+
+/**
+ * Whole sectors at a sector boundary are read directly into pDest,
+ * consecutive sectors within a cluster with a single request. The rest is
+ * read through pPartition->pBuffer.
+ *
+ * @brief Reads from a file at the current position.
+ * @param pFile The file handle.
+ * @param pDest The buffer to read to.
+ * @param Count The number of bytes to read.
+ * @return The number of bytes read. Less than Count at the end of the file.
+ * @ingroup File
+ *
+ * @see FAT_FileSeek
+ */
+FAT_API uint32_t FAT_FileRead(TFatFile* pFile, void* pDest, uint32_t Count);
+
+/**
+ * @brief One read of a vectored file read.
+ * @see FAT_FileReadV
+ * @ingroup File
+ */
+typedef struct {
+  uint32_t          Offset;                /**< The position to read from, in bytes from the start of the file. */
+  void*             pDest;                 /**< The buffer to read to. */
+  uint32_t          Length;                /**< The number of bytes to read. Reduced to the number of bytes available if the read extends beyond the end of the file. */
+} TFatFileRequest;
+
+/**
+ * The requests are sorted by offset, which reorders pRequests, and are
+ * then served in a single pass over the cluster chain. Sectors needed by
+ * neighbouring requests are read together: consecutive sectors within a
+ * cluster are read into pScratch with a single FAT_LoadSectors request,
+ * and each sector is read only once even if several requests need it.
+ *
+ * If pScratch is NULL, the sectors are read one at a time through
+ * pPartition->pBuffer, using the sector cache.
+ *
+ * The current position of the file is not changed.
+ *
+ * @brief Reads several parts of a file.
+ * @param pFile          The file handle.
+ * @param pRequests      The reads to do.
+ * @param Count          The number of reads.
+ * @param pScratch       A buffer of ScratchSectors sectors, or NULL.
+ * @param ScratchSectors The size of pScratch, in sectors.
+ * @return The total number of bytes read.
+ * @ingroup File
+ *
+ * @see FAT_FileRead
+ */
+FAT_API uint32_t FAT_FileReadV(TFatFile* pFile, TFatFileRequest* pRequests, uint16_t Count, uint8_t* pScratch, uint16_t ScratchSectors);
+
+/**
+ * Moving beyond the end of the file is not supported. Only the position
+ * is changed; the cluster chain is followed by the next read or write.
+ *
+ * @brief Changes the current position of a file.
+ * @param pFile  The file handle.
+ * @param Offset The new position, in bytes from the start of the file.
+ * @return 1 on success, 0 if Offset is beyond the end of the file.
+ * @ingroup File
+ *
+ * @see FAT_FileTell
+ */
+FAT_API uint8_t FAT_FileSeek(TFatFile* pFile, uint32_t Offset);
+
+/**
+ * @brief Returns the current position of a file, in bytes from the start of the file.
+ * @param pFile The file handle.
+ * @ingroup File
+ */
+#define FAT_FileTell(pFile) ((pFile)->Position)
+
+/**
+ * @brief Returns the size of a file, in bytes.
+ * @param pFile The file handle.
+ * @ingroup File
+ */
+#define FAT_FileSize(pFile) ((pFile)->Size)
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * The file grows when writing beyond its end. Clusters are allocated with
+ * FAT_AllocateClusters, as many at once as the write needs. Whole sectors
+ * at a sector boundary are written directly from pSource, the rest
+ * through pPartition->pBuffer.
+ *
+ * The directory entry is updated by FAT_FileFlush and FAT_FileClose.
+ *
+ * @brief Writes to a file at the current position.
+ * @param pFile   The file handle. Must have been opened with FAT_FILE_WRITE.
+ * @param pSource The data to write.
+ * @param Count   The number of bytes to write.
+ * @return The number of bytes written. Less than Count if the disk is full,
+ *         zero (0) if the file was not opened with FAT_FILE_WRITE.
+ * @ingroup File
+ *
+ * @see FAT_FileFlush
+ */
+FAT_API uint32_t FAT_FileWrite(TFatFile* pFile, const void* pSource, uint32_t Count);
+
+/**
+ * Stores the size and first cluster of the file in its directory entry if
+ * they have changed, and calls FAT_Flush.
+ *
+ * @brief Writes the state of a file to the disk.
+ * @param pFile The file handle.
+ * @return Nothing.
+ * @ingroup File
+ *
+ * @see FAT_Flush
+ */
+FAT_API void FAT_FileFlush(TFatFile* pFile);
+
+/**
+ * Allocates clusters until the cluster chain of the file can hold Bytes
+ * bytes, without changing the file size. The missing clusters are
+ * allocated with FAT_AllocateClusters in a single run where the free space
+ * allows it, so writing the file later does not need to allocate and the
+ * file is not fragmented.
+ *
+ * The reserved clusters stay in the chain beyond the end of the file
+ * until they are used or freed with FAT_FileTruncate.
+ *
+ * @brief Reserves space for a file.
+ * @param pFile The file handle. Must have been opened with FAT_FILE_WRITE.
+ * @param Bytes The number of bytes, from the start of the file, to reserve space for.
+ * @return 1 on success, 0 if the disk is full or the file was not opened
+ *         with FAT_FILE_WRITE. The clusters allocated before the disk was 
+ *         full stay reserved.
+ * @ingroup File
+ *
+ * @see FAT_FileTruncate
+ */
+FAT_API uint8_t FAT_FileReserve(TFatFile* pFile, uint32_t Bytes);
+
+/**
+ * The clusters beyond the one holding the new end of the file, including
+ * those reserved with FAT_FileReserve, are freed with FAT_FreeClusters.
+ * Truncating a file to its own size therefore only frees the reserved
+ * space. If the current position is beyond the new end, it is moved to it.
+ *
+ * The directory entry is updated by FAT_FileFlush and FAT_FileClose.
+ *
+ * @brief Shortens a file.
+ * @param pFile The file handle. Must have been opened with FAT_FILE_WRITE.
+ * @param Size  The new file size, in bytes.
+ * @return 1 on success, 0 if Size is larger than the file or the file was
+ *         not opened with FAT_FILE_WRITE.
+ * @ingroup File
+ *
+ * @see FAT_FileReserve, FAT_FreeClusters
+ */
+FAT_API uint8_t FAT_FileTruncate(TFatFile* pFile, uint32_t Size);
+
+/**
+ * The directory entry is marked as deleted with FAT_DeleteDirEntry before
+ * the cluster chain is freed with FAT_FreeClusters, so the space of the
+ * file is the first to be allocated again. The file must not be open.
+ *
+ * @brief Deletes a file.
+ * @param pPartition The current partition.
+ * @param pPath      The null-terminated path of the file.
+ * @return 1 on success, 0 if the file was not found, if the path names a
+ *         directory or if the file is read-only.
+ * @ingroup File
+ *
+ * @see FAT_DeleteDirEntry, FAT_FreeClusters
+ */
+FAT_API uint8_t FAT_FileDelete(TFatPartition* pPartition, const char* pPath);
+
+/**
+ * Appending to a file through TFatLog writes every sector once: bytes are
+ * collected in pSector until it is full, clusters are allocated
+ * Preallocate at a time ahead of the end of the file, and the directory
+ * entry is only updated every CommitInterval sectors.
+ *
+ * If the device loses power, the data written since the last commit is
+ * lost, and the preallocated clusters stay in the cluster chain beyond
+ * the end of the file until it is opened with FAT_LogOpen and closed again.
+ *
+ * @brief A file opened for appending.
+ * @see FAT_LogOpen
+ * @ingroup File
+ */
+typedef struct {
+  TFatFile          File;                  /**< The file. Its position is always its end. */
+  uint8_t*          pSector;               /**< A buffer of FAT_BYTES_PER_SECTOR bytes for the last, incomplete sector of the file. Must be specified by the application. */
+  TFatClusterNr     Preallocate;           /**< The number of clusters to allocate beyond the one holding the end of the file when the cluster chain is extended. Must be specified by the application. */
+  uint16_t          CommitInterval;        /**< The number of sectors written between commits, or zero (0) to only commit with FAT_LogCommit and FAT_LogClose. Must be specified by the application. */
+  uint16_t          Uncommitted;           /**< The number of sectors written since the last commit. */
+} TFatLog;
+
+/**
+ * The file is created if it does not exist. pLog->pSector,
+ * pLog->Preallocate and pLog->CommitInterval must be set before calling
+ * this function. If the file does not end at a sector boundary, its last
+ * sector is read into pLog->pSector.
+ *
+ * @brief Opens a file for appending.
+ * @param pPartition The current partition.
+ * @param pPath      The null-terminated path of the file.
+ * @param pLog       The log to initialise.
+ * @return 1 on success, 0 if the file could not be opened or created.
+ * @ingroup File
+ *
+ * @see FAT_FileOpen, FAT_LogClose
+ */
+FAT_API uint8_t FAT_LogOpen(TFatPartition* pPartition, const char* pPath, TFatLog* pLog);
+
+/**
+ * Whole sectors at a sector boundary are written directly from pSource,
+ * consecutive sectors within a cluster with a single request. The rest is
+ * collected in pLog->pSector, which is written when it is full.
+ *
+ * @brief Appends data to a file.
+ * @param pLog    The log.
+ * @param pSource The data to append.
+ * @param Count   The number of bytes to append.
+ * @return The number of bytes appended. Less than Count if the disk is full.
+ * @ingroup File
+ *
+ * @see FAT_LogCommit
+ */
+FAT_API uint32_t FAT_LogWrite(TFatLog* pLog, const void* pSource, uint32_t Count);
+
+/**
+ * Writes the incomplete last sector, updates the directory entry with
+ * FAT_FileFlush and calls FAT_Flush. After that, everything appended so far
+ * is on the disk.
+ *
+ * This is done by FAT_LogWrite every pLog->CommitInterval sectors.
+ *
+ * @brief Makes the appended data part of the file on the disk.
+ * @param pLog The log.
+ * @return Nothing.
+ * @ingroup File
+ */
+FAT_API void FAT_LogCommit(TFatLog* pLog);
+
+/**
+ * Frees the preallocated clusters that were not used with
+ * FAT_FileTruncate, and commits the log. The log can not be used
+ * afterwards.
+ *
+ * @brief Closes a log.
+ * @param pLog The log.
+ * @return Nothing.
+ * @ingroup File
+ *
+ * @see FAT_LogCommit, FAT_FileTruncate
+ */
+FAT_API void FAT_LogClose(TFatLog* pLog);
+#endif
+
+/**
+ * A file opened with FAT_FILE_WRITE is flushed using FAT_FileFlush. The
+ * handle can not be used afterwards.
+ *
+ * @brief Closes a file.
+ * @param pFile The file handle.
+ * @return Nothing.
+ * @ingroup File
+ */
+FAT_API void FAT_FileClose(TFatFile* pFile);
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef FATHOST_H_INCLUSION_GUARD
+#define FATHOST_H_INCLUSION_GUARD
+
+/**
+ * @defgroup Host Block devices for host applications.
+ */
+
+#include <stdio.h>
+#include "fat.h"
+
+/**
+ * @brief A block device backed by a disk image file.
+ * @see FAT_OpenFileDevice
+ * @ingroup Host
+ */
+typedef struct {
+  TFatDevice        Device;                /**< The device interface. Assign &Device to TFatPartition::pDevice. */
+  FILE*             pFile;                 /**< The image file. */
+  uint8_t           Error;                 /**< Set to 1 if a read, write or seek has failed. Never cleared by the library. */
+} TFatFileDevice;
+
+/**
+ * @brief A block device backed by a disk image in memory.
+ * @see FAT_OpenMemoryDevice
+ * @ingroup Host
+ */
+typedef struct {
+  TFatDevice        Device;                /**< The device interface. Assign &Device to TFatPartition::pDevice. */
+  uint8_t*          pData;                 /**< The disk image. */
+  uint32_t          SectorCount;           /**< The size of the disk image, in sectors. */
+  uint8_t           Error;                 /**< Set to 1 if a sector outside the image has been accessed. Never cleared by the library. */
+} TFatMemoryDevice;
+
+#ifdef __unix__
+/**
+ * @brief A block device backed by a memory mapped disk image file.
+ * @see FAT_OpenMappedDevice
+ * @ingroup Host
+ */
+typedef struct {
+  TFatMemoryDevice  Memory;                /**< The mapped image. Assign &Memory.Device to TFatPartition::pDevice. */
+  size_t            Size;                  /**< The size of the mapping, in bytes. */
+  uint32_t          FirstDirty;            /**< The first sector written since the last flush. */
+  uint32_t          EndDirty;              /**< The sector after the last one written since the last flush, or 0 if nothing was written. */
+} TFatMappedDevice;
+#endif
+
+/**
+ * Reads beyond the end of the file return zeros and set pFileDevice->Error.
+ *
+ * @brief Opens a disk image file as a block device.
+ * @param pFileDevice The device to initialise.
+ * @param pPath       The path to the image file.
+ * @param Writable    1 to open the image for writing as well, 0 for read-only access.
+ * @return 1 on success, 0 if the file could not be opened.
+ * @ingroup Host
+ */
+uint8_t FAT_OpenFileDevice(TFatFileDevice* pFileDevice, const char* pPath, uint8_t Writable);
+
+/**
+ * @brief Closes a disk image file opened by FAT_OpenFileDevice.
+ * @param pFileDevice The device to close.
+ * @return Nothing.
+ * @ingroup Host
+ */
+void FAT_CloseFileDevice(TFatFileDevice* pFileDevice);
+
+/**
+ * The image is accessed in place and is not copied.
+ *
+ * @brief Initialises a block device backed by a disk image in memory.
+ * @param pMemoryDevice The device to initialise.
+ * @param pData         The disk image.
+ * @param SectorCount   The size of the disk image, in sectors.
+ * @return Nothing.
+ * @ingroup Host
+ */
+void FAT_OpenMemoryDevice(TFatMemoryDevice* pMemoryDevice, uint8_t* pData, uint32_t SectorCount);
+
+#ifdef __unix__
+/**
+ * A read-only image provides TFatDevice::MapSector, so FAT_LoadSector 
+ * points TFatPartition::pBuffer at the mapped sector and metadata is read
+ * without a system call or a copy. Such a partition must not be modified.
+ *
+ * A writable image is read and written by copying to and from the mapping.
+ * The written pages are synchronised with the file by FAT_Flush.
+ *
+ * @brief Maps a disk image file into memory and opens it as a block device.
+ * @param pMappedDevice The device to initialise.
+ * @param pPath         The path to the image file.
+ * @param Writable      1 to map the image for writing as well, 0 for read-only access.
+ * @return 1 on success, 0 if the file could not be opened or mapped.
+ * @ingroup Host
+ */
+uint8_t FAT_OpenMappedDevice(TFatMappedDevice* pMappedDevice, const char* pPath, uint8_t Writable);
+
+/**
+ * @brief Unmaps a disk image file mapped by FAT_OpenMappedDevice.
+ * @param pMappedDevice The device to close.
+ * @return Nothing.
+ * @ingroup Host
+ */
+void FAT_CloseMappedDevice(TFatMappedDevice* pMappedDevice);
+#endif
+
+#if defined(FAT_ENABLE_THREADS) && defined(__unix__)
+/**
+ * FAT_LOCK_READ and FAT_LOCK_WRITE are implemented with a POSIX
+ * reader-writer lock and FAT_LOCK_CACHE with a mutex. A waiting writer
+ * goes before readers that arrive after it. The program must be linked
+ * with -pthread.
+ *
+ * The devices of this file can be read by several threads at once. Disk
+ * image files are locked with flockfile() during each transfer.
+ *
+ * @brief Initialises locks for sharing a volume between threads.
+ * @param pLock The locks to initialise. Assign pLock to TFatPartition::pLock.
+ * @return 1 on success, 0 if the locks could not be created.
+ * @ingroup Host
+ *
+ * @see TFatLock, FAT_ClonePartition
+ */
+uint8_t FAT_OpenHostLock(TFatLock* pLock);
+
+/**
+ * @brief Destroys locks initialised by FAT_OpenHostLock.
+ * @param pLock The locks to destroy. They must not be held.
+ * @return Nothing.
+ * @ingroup Host
+ */
+void FAT_CloseHostLock(TFatLock* pLock);
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef FATINDEX_H_INCLUSION_GUARD
+#define FATINDEX_H_INCLUSION_GUARD
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+/**
+ * Forgets all indexed directories. pNameIndex->pData must be set before
+ * calling this function.
+ *
+ * This is done by FAT_OpenPartition. It must also be done if directory
+ * entries are renamed, created or deleted other than through
+ * FAT_InitDirEntry and FAT_DeleteDirEntry.
+ *
+ * @brief Initialises the directory name index.
+ * @param pNameIndex The directory name index.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_InitNameIndex(TFatNameIndex* pNameIndex);
+
+/**
+ * The names already in the index of the directory are checked first,
+ * reading only the sectors whose entries have the same hash. If the name
+ * is not found there and the index does not yet hold the whole directory,
+ * the search continues sector by sector where the previous search
+ * stopped, adding every name it passes to the index.
+ *
+ * This is done by FAT_FindDirEntry and FAT_FindRootDirEntry when
+ * pPartition->pNameIndex is not NULL.
+ *
+ * @brief Finds a directory entry using the directory name index.
+ * @param pPartition       The current partition.
+ * @param DirectoryCluster The first cluster of the directory, or zero (0) for the FAT16 root directory.
+ * @param pName            The name of the directory entry to match, in 8.3 format.
+ * @param pDirLocation     Information where the directory entry is located.
+ * @return A pointer to the entry information on success. Will be NULL if the entry was not found.
+ * @ingroup Dir
+ *
+ * @see FAT_FindDirEntry
+ */
+FAT_API TFatDirEntry* FAT_FindIndexedDirEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, const char* pName, TFatDirectoryLocation* pDirLocation);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * The name is taken from the directory entry at pDirLocation, which must
+ * be held by pPartition->pBuffer. Nothing is done if the directory is not
+ * indexed. If the index is full, the directory is dropped from the index
+ * and will be indexed again by the next search.
+ *
+ * This is done by FAT_InitDirEntry.
+ *
+ * @brief Adds a new directory entry to the directory name index.
+ * @param pPartition       The current partition.
+ * @param DirectoryCluster The first cluster of the directory holding the entry.
+ * @param pDirLocation     The location of the directory entry.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_InsertIndexedName(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, const TFatDirectoryLocation* pDirLocation);
+
+/**
+ * The name is taken from the directory entry at pDirLocation, which must
+ * be held by pPartition->pBuffer, so this must be called before the entry
+ * is marked as deleted.
+ *
+ * This is done by FAT_DeleteDirEntry.
+ *
+ * @brief Removes a directory entry from the directory name index.
+ * @param pPartition   The current partition.
+ * @param pDirLocation The location of the directory entry.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_RemoveIndexedName(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation);
+#endif
+#endif
+
+#ifdef FAT_DIR_HINT_ENTRIES
+/**
+ * Forgets all hints. This is done by FAT_OpenPartition. It must also be
+ * done if directory entries are deleted other than through 
+ * FAT_DeleteDirEntry.
+ *
+ * @brief Initialises the free directory entry hints.
+ * @param pDirHints The free directory entry hints.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_InitDirHints(TFatDirHints* pDirHints);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * This is done by FAT_CreateDirEntry and FAT_CreateRootDirEntry when
+ * pPartition->pDirHints is not NULL.
+ *
+ * @brief Returns where to start looking for a free entry in a directory.
+ * @param pPartition       The current partition.
+ * @param DirectoryCluster The first cluster of the directory, or zero (0) for the FAT16 root directory.
+ * @param pDirLocation     Receives the first entry that may be free. The sector is not loaded.
+ * @return 1 if there is a hint for the directory, 0 if the whole directory must be searched.
+ * @ingroup Dir
+ */
+FAT_API uint8_t FAT_GetDirHint(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * All entries of the directory before pDirLocation must be in use. The
+ * least recently used hint is replaced if the directory has none.
+ *
+ * This is done by FAT_CreateDirEntry and FAT_CreateRootDirEntry with the
+ * entry they return.
+ *
+ * @brief Remembers where to start looking for a free entry in a directory.
+ * @param pPartition       The current partition.
+ * @param DirectoryCluster The first cluster of the directory, or zero (0) for the FAT16 root directory.
+ * @param pDirLocation     The first entry that may be free.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_SetDirHint(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, const TFatDirectoryLocation* pDirLocation);
+
+/**
+ * The directory entry at pDirLocation must be held by pPartition->pBuffer,
+ * so this must be called before the entry is marked as deleted. A hint
+ * in the same cluster as the entry is moved back to it. Hints in other
+ * clusters are dropped, since the order of the clusters is not known,
+ * and so is the hint of the directory the entry refers to.
+ *
+ * This is done by FAT_DeleteDirEntry.
+ *
+ * @brief Updates the free directory entry hints for a deleted entry.
+ * @param pPartition   The current partition.
+ * @param pDirLocation The location of the directory entry.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_UpdateDirHints(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation);
+#endif
+#endif
+
+#endif
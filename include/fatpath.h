@@ -0,0 +1,117 @@
+#ifndef FATPATH_H_INCLUSION_GUARD
+#define FATPATH_H_INCLUSION_GUARD
+
+/**
+ * Lower case letters are converted to upper case and the name and
+ * extension are padded with spaces. "." and ".." are converted to the
+ * names of the dot entries found in subdirectories.
+ *
+ * Example: "readme.txt" becomes "README  TXT".
+ *
+ * @brief Converts a file name to the 8.3 format used in directory entries.
+ * @param pName      The file name. Does not have to be null-terminated.
+ * @param Length     The length of the file name.
+ * @param pShortName Receives the 11 characters of the 8.3 name. Not null-terminated.
+ * @return 1 on success, 0 if the name can not be represented in 8.3 format.
+ * @ingroup Dir
+ */
+FAT_API uint8_t FAT_MakeShortName(const char* pName, uint16_t Length, char* pShortName);
+
+/**
+ * The path consists of 8.3 names separated by '/' or '\\', for example
+ * "/LOGS/2026/DAY01.TXT". Leading, trailing and repeated separators are
+ * ignored, and the path is always resolved from the root directory.
+ * Long file names are not supported.
+ *
+ * If pPartition->pPathCache is not NULL, the components of the path are
+ * first looked up in the path lookup cache. A path whose directories are
+ * all in the cache is opened by reading only the sector holding the
+ * last entry.
+ *
+ * pDirLocation will contain the information where the entry is located
+ * on success. On failure, its contents will be overwritten.
+ *
+ * @brief Finds the directory entry specified by a path.
+ * @param pPartition   The current partition.
+ * @param pPath        The null-terminated path.
+ * @param pDirLocation Information where the directory entry is located.
+ * @return A pointer to the entry information on success. Will be NULL if
+ *         the entry was not found, if a component is not a directory or
+ *         if the path names the root directory.
+ * @ingroup Dir
+ *
+ * @see FAT_FindDirEntry, FAT_MakeShortName
+ */
+FAT_API TFatDirEntry* FAT_OpenPath(TFatPartition* pPartition, const char* pPath, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * Works like FAT_OpenPath, but copies the directory entry instead of
+ * returning a pointer into pPartition->pBuffer, which the next disk access
+ * overwrites. If FAT_ENABLE_THREADS is configured, the path is resolved
+ * holding FAT_LOCK_READ, so the copy is consistent even while another
+ * thread modifies the volume.
+ *
+ * @brief Finds the directory entry specified by a path and copies it.
+ * @param pPartition   The current partition.
+ * @param pPath        The null-terminated path.
+ * @param pDirEntry    Receives a copy of the directory entry.
+ * @param pDirLocation Information where the directory entry is located.
+ * @return 1 on success, 0 in the cases where FAT_OpenPath returns NULL.
+ * @ingroup Dir
+ *
+ * @see FAT_OpenPath, FAT_ClonePartition
+ */
+FAT_API uint8_t FAT_LookupPath(TFatPartition* pPartition, const char* pPath, TFatDirEntry* pDirEntry, TFatDirectoryLocation* pDirLocation);
+
+/**
+ * Resolves all components of the path but the last one, like 
+ * FAT_OpenPath does, and converts the last one to the 8.3 format. This is
+ * used to create the entry a path names.
+ *
+ * @brief Finds the directory that holds the entry specified by a path.
+ * @param pPartition        The current partition.
+ * @param pPath             The null-terminated path.
+ * @param pDirectoryCluster Receives the first cluster of the directory, or 
+ *                          zero (0) for the root directory.
+ * @param pName             Receives the 11 characters of the 8.3 name of the last component.
+ * @return 1 on success, 0 if a directory along the path was not found or
+ *         if the path names the root directory.
+ * @ingroup Dir
+ *
+ * @see FAT_OpenPath
+ */
+FAT_API uint8_t FAT_OpenParentPath(TFatPartition* pPartition, const char* pPath, TFatClusterNr* pDirectoryCluster, char* pName);
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+/**
+ * Invalidates all entries and resets the statistics counters.
+ *
+ * This is done by FAT_OpenPartition. It must also be done if directories
+ * are deleted or renamed other than through FAT_DeleteDirEntry.
+ *
+ * @brief Initialises the path lookup cache.
+ * @param pPathCache The path lookup cache.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_InitPathCache(TFatPathCache* pPathCache);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * The directory entry at pDirLocation must be held by pPartition->pBuffer.
+ * If it is a directory, the whole cache is invalidated, since the paths
+ * below it are no longer valid.
+ *
+ * This is done by FAT_DeleteDirEntry.
+ *
+ * @brief Removes a directory entry from the path lookup cache.
+ * @param pPartition   The current partition.
+ * @param pDirLocation The location of the directory entry.
+ * @return Nothing.
+ * @ingroup Dir
+ */
+FAT_API void FAT_ForgetPath(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation);
+#endif
+#endif
+
+#endif
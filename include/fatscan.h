@@ -0,0 +1,114 @@
+#ifndef FATSCAN_H_INCLUSION_GUARD
+#define FATSCAN_H_INCLUSION_GUARD
+
+/**
+ * The kernels below examine FAT entries in bulk. They use SSE2 or AVX2 
+ * when the compiler targets it (unless FAT_DISABLE_SIMD is configured) 
+ * and a portable implementation otherwise. pEntries does not have to be 
+ * aligned.
+ */
+
+#ifdef FAT_ENABLE_FAT16
+/**
+ * @brief Finds the first free entry in an array of FAT16 entries.
+ * @param pEntries A pointer to the first entry.
+ * @param Count    The number of entries.
+ * @return The index of the first free entry, or Count if all entries are used.
+ * @ingroup FAT
+ */
+FAT_API uint16_t FAT16_FindFreeEntry(const uint8_t* pEntries, uint16_t Count);
+
+/**
+ * @brief Counts the free entries in an array of FAT16 entries.
+ * @param pEntries A pointer to the first entry.
+ * @param Count    The number of entries.
+ * @return The number of free entries.
+ * @ingroup FAT
+ */
+FAT_API uint16_t FAT16_CountFreeEntries(const uint8_t* pEntries, uint16_t Count);
+#endif
+
+#ifdef FAT_ENABLE_FAT32
+/**
+ * @note The reserved upper four bits of the entries are ignored.
+ * @brief Finds the first free entry in an array of FAT32 entries.
+ * @param pEntries A pointer to the first entry.
+ * @param Count    The number of entries.
+ * @return The index of the first free entry, or Count if all entries are used.
+ * @ingroup FAT
+ */
+FAT_API uint16_t FAT32_FindFreeEntry(const uint8_t* pEntries, uint16_t Count);
+
+/**
+ * @note The reserved upper four bits of the entries are ignored.
+ * @brief Counts the free entries in an array of FAT32 entries.
+ * @param pEntries A pointer to the first entry.
+ * @param Count    The number of entries.
+ * @return The number of free entries.
+ * @ingroup FAT
+ */
+FAT_API uint16_t FAT32_CountFreeEntries(const uint8_t* pEntries, uint16_t Count);
+#endif
+
+/**
+ * Reads the whole first FAT. The result is stored in 
+ * pPartition->FreeClusters; the FSInfo sector of a FAT32 partition is only 
+ * updated once a later allocation changes the count, so that counting stays 
+ * a read-only operation.
+ *
+ * For FAT32 partitions with a valid FSInfo sector, pPartition->FreeClusters
+ * is normally known after FAT_OpenPartition, and calling this function is
+ * only necessary if the FSInfo value can not be trusted.
+ *
+ * @brief Counts the free clusters of a partition.
+ * @param pPartition The current partition.
+ * @return The number of free clusters.
+ * @ingroup FAT
+ */
+FAT_API uint32_t FAT_CountFreeClusters(TFatPartition* pPartition);
+
+/**
+ * @brief The entries of a directory sector that FAT_ScanDirSector found, one bit per entry.
+ * @see FAT_ScanDirSector
+ * @ingroup Dir
+ */
+typedef struct {
+  uint16_t          Match;                 /**< Entries whose name is the one searched for. Long file name entries never match. */
+  uint16_t          Deleted;               /**< Entries marked as deleted. */
+  uint16_t          End;                   /**< Entries whose name starts with zero (0). The first one ends the directory. */
+  uint16_t          LongName;              /**< Long file name entries. */
+} TFatDirScan;
+
+/**
+ * Examines all FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR entries of a 
+ * directory sector at once, instead of testing one entry at a time. Bit N
+ * of each mask refers to entry N. Entries after the first bit in 
+ * pScan->End are not part of the directory, so Match, Deleted and LongName
+ * only contain entries before it.
+ *
+ * Like the FAT scanning kernels, this uses SSE2 when the compiler targets
+ * it, unless FAT_DISABLE_SIMD is configured.
+ *
+ * @brief Compares a name against all entries of a directory sector.
+ * @param pSector The contents of the directory sector.
+ * @param pName   The 8.3 name to search for, or NULL to only find the deleted, end and long file name entries.
+ * @param pScan   Receives the masks.
+ * @return Nothing.
+ * @ingroup Dir
+ *
+ * @see FAT_GetLowestBit
+ */
+FAT_API void FAT_ScanDirSector(const uint8_t* pSector, const char* pName, TFatDirScan* pScan);
+
+/**
+ * Used for the masks returned by FAT_ScanDirSector, where the bit number
+ * is the entry number, and by the vectorised FAT scanning functions.
+ *
+ * @brief Returns the index of the lowest set bit in a mask.
+ * @param Mask The mask. Must not be zero (0).
+ * @return The bit number.
+ * @ingroup Dir
+ */
+FAT_API uint8_t FAT_GetLowestBit(uint32_t Mask);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef FATTABLE_H_INCLUSION_GUARD
+#define FATTABLE_H_INCLUSION_GUARD
+
+#ifdef FAT_ENABLE_FAT_TABLE
+/**
+ * Discards the current window and, if pPartition->pTable is not NULL, 
+ * loads the beginning of the FAT into it. Modified FAT sectors are 
+ * discarded, so FAT_Flush must be called first if the table has been 
+ * modified.
+ *
+ * This is done by FAT_OpenPartition.
+ *
+ * @brief Initialises the in-memory FAT table of a partition.
+ * @param pPartition The current partition.
+ * @return Nothing.
+ * @ingroup FAT
+ */
+FAT_API void FAT_InitTable(TFatPartition* pPartition);
+#endif
+
+/**
+ * If an in-memory FAT table is used, a pointer into the table is returned
+ * and no sector is read unless the window has to be moved. Otherwise, the
+ * sector is loaded using FAT_LoadSector and pPartition->pBuffer is 
+ * returned.
+ *
+ * The returned pointer is only valid until the next call to a function 
+ * that accesses the disk.
+ *
+ * @brief Returns the contents of a sector of the first FAT.
+ * @param pPartition   The current partition.
+ * @param SectorOffset The sector number, relative to the start of the FAT.
+ * @return A pointer to the sector contents.
+ * @ingroup FAT
+ *
+ * @see FAT_StoreFATSector
+ */
+FAT_API uint8_t* FAT_LoadFATSector(TFatPartition* pPartition, uint32_t SectorOffset);
+
+#ifdef FAT_ENABLE_WRITE
+/**
+ * Must be called after modifying the contents returned by 
+ * FAT_LoadFATSector. If an in-memory FAT table is used, the sector is 
+ * only marked as modified and is written when the window is moved or 
+ * when FAT_Flush is called. Otherwise, it is stored using 
+ * FAT_StoreSector.
+ *
+ * Only the first FAT is written. The other FAT tables are updated by 
+ * FAT_MirrorFAT.
+ *
+ * @brief Stores a modified sector of the first FAT.
+ * @param pPartition   The current partition.
+ * @param SectorOffset The sector number, relative to the start of the FAT.
+ * @return Nothing.
+ * @ingroup FAT
+ *
+ * @see FAT_LoadFATSector, FAT_Flush
+ */
+FAT_API void FAT_StoreFATSector(TFatPartition* pPartition, uint32_t SectorOffset);
+
+#ifdef FAT_ENABLE_FAT_TABLE
+/**
+ * Consecutive modified sectors are written with a single FAT_StoreSectors
+ * request to each of the pPartition->MirroredFATs FAT tables.
+ *
+ * @brief Writes all modified sectors of the in-memory FAT table to the disk.
+ * @param pPartition The current partition.
+ * @return Nothing.
+ * @ingroup FAT
+ *
+ * @see FAT_Flush
+ */
+FAT_API void FAT_FlushTable(TFatPartition* pPartition);
+#endif
+
+/**
+ * Sectors of the first FAT that have been stored without an in-memory FAT
+ * table are remembered in pPartition->DirtyFATSectors. This function reads
+ * each of them once and stores it to the other pPartition->MirroredFATs - 1
+ * FAT tables, so that the cost of keeping the copies identical is paid once
+ * per flush instead of once per modification. If more than 
+ * FAT_DIRTY_FAT_SECTORS sectors have been modified, every sector between 
+ * the first and the last modified one is copied.
+ *
+ * This is done by FAT_Flush.
+ *
+ * @brief Copies the modified sectors of the first FAT to the other FAT tables.
+ * @param pPartition The current partition.
+ * @return Nothing.
+ * @ingroup FAT
+ *
+ * @see FAT_StoreFATSector, FAT_Flush
+ */
+FAT_API void FAT_MirrorFAT(TFatPartition* pPartition);
+#endif
+
+#endif
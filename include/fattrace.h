@@ -0,0 +1,87 @@
+#ifndef FATTRACE_H_INCLUSION_GUARD
+#define FATTRACE_H_INCLUSION_GUARD
+
+#ifdef FAT_ENABLE_TRACE
+/**
+ * @brief The size of the header that starts a trace.
+ * @see FAT_InitTrace
+ * @ingroup Device
+ */
+#define FAT_TRACE_HEADER_SIZE (8)
+
+/**
+ * @brief The size of a record of a trace.
+ * @see FAT_RecordTrace
+ * @ingroup Device
+ */
+#define FAT_TRACE_RECORD_SIZE (6)
+
+/**
+ * @brief The version of the trace format, stored in the header.
+ * @ingroup Device
+ */
+#define FAT_TRACE_VERSION (1)
+
+/**
+ * @brief Set in the flags of a record for a write request.
+ * @ingroup Device
+ */
+#define FAT_TRACE_WRITE (0x80)
+
+/**
+ * @brief The bits of the flags of a record that hold the region of the first sector.
+ * @see FAT_GetSectorRegion
+ * @ingroup Device
+ */
+#define FAT_TRACE_REGION_MASK (0x03)
+
+/**
+ * The header ("FATT", the version and three zero bytes) is put into
+ * pRecorder->pBuffer, so it is written with the first records.
+ *
+ * @brief Initialises a trace recorder.
+ * @param pRecorder The trace recorder. pBuffer, BufferSize, Write and pContext must be set.
+ * @return Nothing.
+ * @ingroup Device
+ */
+FAT_API void FAT_InitTrace(TFatTraceRecorder* pRecorder);
+
+/**
+ * This is a TFatStats::Trace function. To record the requests of a
+ * partition, set TFatStats::Trace to FAT_RecordTrace and TFatStats::pContext
+ * to the recorder.
+ *
+ * Every request becomes a record of FAT_TRACE_RECORD_SIZE bytes: the
+ * first sector number (4 bytes, little-endian), the number of sectors
+ * (1 byte) and the flags (1 byte, FAT_TRACE_WRITE and the region). Requests
+ * of more than 255 sectors are split into several records.
+ * pRecorder->Write is called whenever pRecorder->pBuffer is full.
+ *
+ * Single sector reads are usually made by FAT_LoadSector and reads of
+ * more sectors by FAT_LoadSectors, which bypasses the sector cache. To
+ * record every sector load, the partition should be used without a sector
+ * cache and a FAT table while recording.
+ *
+ * @brief Records a read or write request.
+ * @param pContext  The trace recorder.
+ * @param Operation FAT_STATS_READ or FAT_STATS_WRITE.
+ * @param Region    The region of SectorNr.
+ * @param SectorNr  The first sector of the request.
+ * @param Count     The number of sectors of the request.
+ * @return Nothing.
+ * @ingroup Device
+ *
+ * @see FAT_InitTrace, FAT_FlushTrace
+ */
+FAT_API void FAT_RecordTrace(void* pContext, uint8_t Operation, uint8_t Region, uint32_t SectorNr, uint16_t Count);
+
+/**
+ * @brief Writes the buffered part of a trace with pRecorder->Write.
+ * @param pRecorder The trace recorder.
+ * @return Nothing.
+ * @ingroup Device
+ */
+FAT_API void FAT_FlushTrace(TFatTraceRecorder* pRecorder);
+#endif
+
+#endif
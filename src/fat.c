@@ -1,273 +1,629 @@
-#include "../include/fat.h"
-
-#ifdef FAT_DEBUG
-#include <stdlib.h>
-#include <assert.h>
-#include <stdio.h>
-#endif
-
-#include <string.h>
-
-#ifdef FAT_SINGLE_FILE
-#include "fat16.c"
-#include "fat32.c"
-#endif
-
-/* TODO: What does this actually compute? The start of the partition data block? */
-FAT_API uint32_t FAT_GetRootOffset(const TFatPartition* pPartition)
-{
-  return pPartition->PartitionLBA + pPartition->ReservedSectors + FAT_NUMBER_OF_FATS * pPartition->SectorsPerFAT;
-}
-
-FAT_API void FAT_Seek(const TFatPartition* pPartition, TFatLocation* pLocation, TFatClusterNr ClusterNr)
-{
-  pLocation->Cluster = ClusterNr;
-  pLocation->Sector = FAT_GetRootOffset(pPartition) 
-    + (ClusterNr - 2) * pPartition->SectorsPerCluster 
-    + pPartition->RootDirectoryEntries / (FAT_BYTES_PER_SECTOR / FAT_DIRECTORY_ENTRY_SIZE);
-  pLocation->SectorsLeftInCluster = pPartition->SectorsPerCluster - 1;
-  return;
-}
-
-FAT_API uint8_t FAT_OpenPartition(TFatPartition* pPartition, uint8_t PartitionNr)
-{
-  /* Read the MBR */
-  FAT_ReadSector(pPartition, 0); 
-
-  if (!FAT_IsMBRValid(pPartition->pBuffer)) return 0;
-
-  switch (FAT_GetPartitionType(pPartition->pBuffer, PartitionNr))
-  {
-#ifdef FAT_ENABLE_FAT32
-  case 0x0b:
-  case 0x0c:
-#ifdef FAT_ENABLE_BOTH
-    pPartition->Type = FAT_32;
-#endif
-    D_(printf("Partition type: FAT32\n"));
-    break;
-#endif
-#ifdef FAT_ENABLE_FAT16
-  case 0x04:
-  case 0x06:
-  case 0x0e:
-#ifdef FAT_ENABLE_BOTH
-    pPartition->Type = FAT_16;
-#endif
-    D_(printf("Partition type: FAT16\n"));
-    break;
-#endif
-  default:
-    D_(printf("Invalid partition type: %d\n", FAT_GetPartitionType(pPartition->pBuffer, PartitionNr)));
-    return 0;
-  }
-
-  pPartition->PartitionLBA = FAT_GetPartitionLBA(pPartition->pBuffer, PartitionNr);
-
-  /* Read the Volume ID to the buffer */
-  FAT_ReadSector(pPartition, pPartition->PartitionLBA); 
-
-  /* Read other parameters that we need for the other functions to work. */
-  pPartition->ReservedSectors      = FAT_GetReservedSectors(pPartition->pBuffer);
-  pPartition->SectorsPerCluster    = FAT_GetSectorsPerCluster(pPartition->pBuffer);
-  pPartition->SectorsPerFAT        = FAT_GetSectorsPerFAT(pPartition);
-  pPartition->RootDirectoryEntries = FAT_GetRootDirectoryEntries(pPartition->pBuffer);
-
-#ifdef FAT_DEBUG
-  printf("-----------------------------\n");
-  printf("Partition LBA:          %d\n", pPartition->PartitionLBA);
-  printf("Reserved sectors:       %d\n", pPartition->ReservedSectors);
-  printf("Sectors per cluster:    %d\n", pPartition->SectorsPerCluster);
-  printf("Sectors per FAT:        %d\n", pPartition->SectorsPerFAT);
-  if (FAT_IsFAT16(pPartition))
-    printf("Root directory entries: %d\n", pPartition->RootDirectoryEntries);
-  printf("-----------------------------\n");
-#endif
-
-  return 1;
-}
-
-FAT_API void FAT_ReadNextSector(TFatPartition* pPartition, TFatLocation* pLocation)
-{
-  /* We need to fetch a new sector. Are there any left in this cluster? */
-  if (pLocation->SectorsLeftInCluster == 0)
-  { 
-    /* There wasn't. So we must fetch the next cluster by following the cluster chain.*/
-    TFatClusterNr NextCluster = FAT_GetNextCluster(pPartition, pLocation->Cluster);
-#ifdef FAT_ENABLE_BOTH
-    if (FAT_IsFAT16(pPartition))
-    {
-#endif
-#ifdef FAT_ENABLE_FAT16
-      if (NextCluster == 0xFFFF) return;
-#endif
-#ifdef FAT_ENABLE_BOTH
-    }
-    else /* FAT32 */
-    {
-#endif
-#ifdef FAT_ENABLE_FAT32
-      if (NextCluster == 0x0FFFFFFF) return;
-#endif
-#ifdef FAT_ENABLE_BOTH
-    }
-#endif
-    FAT_Seek(pPartition, pLocation, NextCluster);
-  }
-  else
-  {
-    /* There are more sectors in this cluster. */
-    pLocation->Sector++;
-    pLocation->SectorsLeftInCluster--;
-  }
-  FAT_ReadSector(pPartition, pLocation->Sector);
-}
-
-FAT_API void FAT_GetFirstDirectoryEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation)
-{
-  FAT_Seek(pPartition, &pDirLocation->Location, StartCluster);
-  FAT_ReadSector(pPartition, pDirLocation->Location.Sector);
-  pDirLocation->EntryOffset = 0;
-}
-
-FAT_API void FAT_GetNextDirectoryEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
-{ 
-  /* At entry, all state variables reflect the previous entry. */
-  if (pDirLocation->EntryOffset == (FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR - 1))
-  {
-    FAT_ReadNextSector(pPartition, &pDirLocation->Location);
-    pDirLocation->EntryOffset = 0;
-  }
-  else
-  {
-    /* Skip to the next in this sector. */
-    pDirLocation->EntryOffset++;
-  }
-}
-
-FAT_API TFatDirEntry* FAT_FindDirEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, char* pName, TFatDirectoryLocation* pDirLocation)
-{
-  /* Load the root director sector */
-  FAT_GetFirstDirectoryEntry(pPartition, DirectoryCluster, pDirLocation);
-  for (;;)
-  {
-    TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
-
-    if (FAT_IsLastDirEntry(pPartition, pDirEntry, pDirLocation)) break;
-
-    if (!FAT_IsDirEntryDeleted(pDirEntry) && 
-        !FAT_IsLongFileName(pDirEntry))
-    {
-#ifdef FAT_DEBUG
-      if (FAT_IsVolumeID(pDirEntry))
-      {
-        printf("Volume: %.11s\n", pDirEntry->Name);
-      } 
-      else if (FAT_IsFile(pDirEntry))
-      {
-        printf("%.11s    %10d  %10d\n", pDirEntry->Name, pDirEntry->FileSize, FAT_GetStartCluster(pDirEntry));
-      }
-      else if (FAT_IsDirectory(pDirEntry))
-      {
-        printf("%.11s   <DIR>        %10d\n", pDirEntry->Name, FAT_GetStartCluster(pDirEntry));
-      }
-#endif
-      {
-        const void* pCurName = pDirEntry->Name;
-        if (memcmp((void*)pName, pCurName, 11) == 0)
-	{
-	  return pDirEntry;
-	}
-      }
-    }
-    FAT_GetNextDirectoryEntry(pPartition, pDirLocation);
-  }
-  return NULL;
-}
-
-#ifdef FAT_ENABLE_WRITE
-
-FAT_API uint8_t FAT_CreateCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatLocation* pLocation)
-{
-  TFatClusterNr ClusterNr = FAT_FindFreeCluster(pPartition);
-
-  if (ClusterNr == 0)
-  {
-    return 0;
-  }
-
-  FAT_LinkClusters(pPartition, FirstCluster, ClusterNr);
-  
-  /* Update pLocation */
-  FAT_Seek(pPartition, pLocation, ClusterNr);
-
-  return 1;
-}
-
-FAT_API TFatDirEntry* FAT_CreateDirEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation)
-{
-  TFatClusterNr LastCluster = StartCluster;
-  
-  D_(printf("Creating directory entry, start cluster: %d\n", StartCluster));
-  
-  FAT_GetFirstDirectoryEntry(pPartition, StartCluster, pDirLocation);
-
-  while (FAT_IsCurrentClusterValid(pPartition, &pDirLocation->Location))
-  {
-    TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
-
-    if (FAT_IsDirEntryDeleted(pDirEntry) ||        /* Found deleted entry */
-        (pDirEntry->Name[0] == 0x00)) /* Found the last entry */
-    {
-      /* Found an entry that can be used! In case it was a deleted entry,
-       * we can just re-use it. If it was the last entry, the remaining entries
-       * must be "empty" as well.
-       */
-      D_(printf("Found unused entry at %d::%d\n", pDirLocation->Location.Cluster, pDirLocation->EntryOffset));
-      return pDirEntry;
-    }
-    LastCluster = pDirLocation->Location.Cluster; /* Save it, so we know which one we should link from. */
-    FAT_GetNextDirectoryEntry(pPartition, pDirLocation);
-  }
-  /* We found the last cluster. Bummer. 
-   * To extend the directory table, we must find a new
-   * cluster, link it together with the last one, and then
-   * clear the entire cluster (we're forced to since all entries
-   * must be marked as "empty". After that, we're done.
-   */
-  D_(printf("Didn't find unused in cluster. Have to create new cluster.\n"));
-
-  if (FAT_CreateCluster(pPartition, LastCluster, &pDirLocation->Location))
-  {
-    /* Clear the entire cluster. */
-    uint8_t I;
-    uint32_t Sector = pDirLocation->Location.Sector;
-    memset((void*)pPartition->pBuffer, 0, FAT_BYTES_PER_SECTOR);
-  
-    for (I = 0; I < pPartition->SectorsPerCluster; I++)
-    {
-      FAT_WriteSector(pPartition, Sector);
-      Sector++;
-    }
-
-    pDirLocation->EntryOffset = 0;
-    return (TFatDirEntry*)pPartition->pBuffer; 
-  }
-  
-  /* Could not create a new cluster - The disk is probably full */
-  return NULL;
-}
-
-void FAT_InitDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation, const char* pDirEntryName)
-{
-  const TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
-
-  memset((void*)pDirEntry, 0, sizeof(*pDirEntry));
-  memcpy((void*)pDirEntry->Name, (void*)pDirEntryName, sizeof(pDirEntry->Name));
-
-  FAT_WriteSector(pPartition, pDirLocation->Location.Sector);
-  D_(printf("Initialised directory entry with name %s\n", pDirEntryName));
-}
-
-#endif
-
+#include "../include/fat.h"
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#include <string.h>
+
+#ifdef FAT_SINGLE_FILE
+#include "fat16.c"
+#include "fat32.c"
+#include "fatcache.c"
+#include "fattable.c"
+#include "fatextent.c"
+#include "fatalloc.c"
+#include "fatscan.c"
+#include "fatindex.c"
+#include "fatpath.c"
+#include "fatfile.c"
+#include "fattrace.c"
+#endif
+
+/* TODO: What does this actually compute? The start of the partition data block? */
+FAT_API uint32_t FAT_GetRootOffset(const TFatPartition* pPartition)
+{
+  return pPartition->PartitionLBA + pPartition->ReservedSectors + pPartition->NumberOfFATs * pPartition->SectorsPerFAT;
+}
+
+FAT_API void FAT_Seek(const TFatPartition* pPartition, TFatLocation* pLocation, TFatClusterNr ClusterNr)
+{
+  pLocation->Cluster = ClusterNr;
+  pLocation->Sector = FAT_GetRootOffset(pPartition) 
+    + (ClusterNr - 2) * pPartition->SectorsPerCluster 
+    + pPartition->RootDirectoryEntries / (FAT_BYTES_PER_SECTOR / FAT_DIRECTORY_ENTRY_SIZE);
+  pLocation->SectorsLeftInCluster = pPartition->SectorsPerCluster - 1;
+  return;
+}
+
+FAT_API uint8_t FAT_OpenPartition(TFatPartition* pPartition, uint8_t PartitionNr)
+{
+  uint32_t TotalSectors;
+  uint32_t DataSectors;
+  uint32_t MaxClusters;
+
+#ifdef FAT_CACHE_SECTORS
+  if (pPartition->pCache != NULL)
+  {
+    FAT_InitCache(pPartition->pCache);
+  }
+#endif
+#ifdef FAT_DIR_INDEX_ENTRIES
+  if (pPartition->pNameIndex != NULL)
+  {
+    FAT_InitNameIndex(pPartition->pNameIndex);
+  }
+#endif
+#ifdef FAT_PATH_CACHE_ENTRIES
+  if (pPartition->pPathCache != NULL)
+  {
+    FAT_InitPathCache(pPartition->pPathCache);
+  }
+#endif
+#ifdef FAT_DIR_HINT_ENTRIES
+  if (pPartition->pDirHints != NULL)
+  {
+    FAT_InitDirHints(pPartition->pDirHints);
+  }
+#endif
+
+  /* Read the MBR */
+  FAT_LoadSector(pPartition, 0); 
+
+  if (!FAT_IsMBRValid(pPartition->pBuffer)) return 0;
+
+  switch (FAT_GetPartitionType(pPartition->pBuffer, PartitionNr))
+  {
+#ifdef FAT_ENABLE_FAT32
+  case 0x0b:
+  case 0x0c:
+#ifdef FAT_ENABLE_BOTH
+    pPartition->Type = FAT_32;
+#endif
+    D_(printf("Partition type: FAT32\n"));
+    break;
+#endif
+#ifdef FAT_ENABLE_FAT16
+  case 0x04:
+  case 0x06:
+  case 0x0e:
+#ifdef FAT_ENABLE_BOTH
+    pPartition->Type = FAT_16;
+#endif
+    D_(printf("Partition type: FAT16\n"));
+    break;
+#endif
+  default:
+    D_(printf("Invalid partition type: %d\n", FAT_GetPartitionType(pPartition->pBuffer, PartitionNr)));
+    return 0;
+  }
+
+  pPartition->PartitionLBA = FAT_GetPartitionLBA(pPartition->pBuffer, PartitionNr);
+
+  /* Read the Volume ID to the buffer */
+  FAT_LoadSector(pPartition, pPartition->PartitionLBA); 
+
+  /* Read other parameters that we need for the other functions to work. */
+  pPartition->ReservedSectors      = FAT_GetReservedSectors(pPartition->pBuffer);
+  pPartition->SectorsPerCluster    = FAT_GetSectorsPerCluster(pPartition->pBuffer);
+  pPartition->SectorsPerFAT        = FAT_GetSectorsPerFAT(pPartition);
+  pPartition->NumberOfFATs         = FAT_GetNrOfFATs(pPartition->pBuffer);
+  pPartition->RootDirectoryEntries = FAT_GetRootDirectoryEntries(pPartition->pBuffer);
+
+  /* The number of data clusters, limited to the number of entries in the FAT. */
+  TotalSectors = FAT_GetTotalSectors16(pPartition->pBuffer);
+  if (TotalSectors == 0)
+  {
+    TotalSectors = FAT_GetTotalSectors32(pPartition->pBuffer);
+  }
+  DataSectors = TotalSectors - pPartition->ReservedSectors - pPartition->NumberOfFATs * pPartition->SectorsPerFAT
+    - pPartition->RootDirectoryEntries / FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR;
+  MaxClusters = pPartition->SectorsPerFAT * FAT_Cond(pPartition, FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR, FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR) - 2;
+  if (DataSectors / pPartition->SectorsPerCluster < MaxClusters)
+  {
+    MaxClusters = DataSectors / pPartition->SectorsPerCluster;
+  }
+  pPartition->ClusterCount = (TFatClusterNr)MaxClusters;
+  pPartition->FreeClusters = FAT_UNKNOWN_FREE_CLUSTERS;
+#ifdef FAT_ENABLE_WRITE
+  pPartition->NextFreeCluster = 2;
+  pPartition->MirroredFATs = pPartition->NumberOfFATs;
+#ifdef FAT_ENABLE_FAT32
+  if (FAT_IsFAT32(pPartition) && (FAT32_GetExtFlags(pPartition->pBuffer) & FAT32_MIRRORING_DISABLED))
+  {
+    /* Only the active FAT is used, which is assumed to be the first one. */
+    pPartition->MirroredFATs = 1;
+  }
+#endif
+  pPartition->DirtyFATSectorCount = 0;
+  pPartition->FirstDirtyFATSector = 0;
+  pPartition->EndDirtyFATSector = 0;
+#ifdef FAT_ENABLE_FREE_MAP
+  pPartition->FreeMapValid = 0;
+#endif
+#endif
+#ifdef FAT_ENABLE_FAT32
+  pPartition->FSInfoSector = 0;
+  if (FAT_IsFAT32(pPartition))
+  {
+    FAT32_ReadFSInfo(pPartition);
+  }
+#endif
+
+#ifdef FAT_DEBUG
+  printf("-----------------------------\n");
+  printf("Partition LBA:          %d\n", pPartition->PartitionLBA);
+  printf("Reserved sectors:       %d\n", pPartition->ReservedSectors);
+  printf("Sectors per cluster:    %d\n", pPartition->SectorsPerCluster);
+  printf("Sectors per FAT:        %d\n", pPartition->SectorsPerFAT);
+  printf("Number of FATs:         %d\n", pPartition->NumberOfFATs);
+  printf("Clusters:               %d\n", pPartition->ClusterCount);
+  if (FAT_IsFAT16(pPartition))
+    printf("Root directory entries: %d\n", pPartition->RootDirectoryEntries);
+  printf("-----------------------------\n");
+#endif
+
+#ifdef FAT_ENABLE_FAT_TABLE
+  FAT_InitTable(pPartition);
+#endif
+
+  return 1;
+}
+
+#ifdef FAT_ENABLE_THREADS
+FAT_API void FAT_ClonePartition(const TFatPartition* pSource, TFatPartition* pClone, uint8_t* pBuffer)
+{
+  *pClone = *pSource;
+  pClone->pBuffer = pBuffer;
+#ifdef FAT_ENABLE_FAT_TABLE
+  /* A partial table is moved by the readers, so it can not be shared. */
+  if ((pSource->pTable != NULL) &&
+      ((pSource->pTable->FirstSector != 0) || (pSource->pTable->LoadedSectors != pSource->SectorsPerFAT)))
+  {
+    pClone->pTable = NULL;
+  }
+#endif
+#ifdef FAT_DIR_INDEX_ENTRIES
+  pClone->pNameIndex = NULL;
+#endif
+#ifdef FAT_PATH_CACHE_ENTRIES
+  pClone->pPathCache = NULL;
+#endif
+#ifdef FAT_DIR_HINT_ENTRIES
+  pClone->pDirHints = NULL;
+#endif
+#ifdef FAT_ENABLE_STATS
+  pClone->pStats = NULL;
+#endif
+#if defined(FAT_ENABLE_WRITE) && defined(FAT_ENABLE_FREE_MAP)
+  pClone->pFreeMap = NULL;
+  pClone->FreeMapSize = 0;
+  pClone->FreeMapValid = 0;
+#endif
+}
+#endif
+
+/* Moves pLocation to the first sector of the next cluster in the cluster chain.
+ * If there is none, pLocation->Cluster is set to the end of chain marker that
+ * FAT_IsCurrentClusterValid checks for, and 0 is returned.
+ */
+static uint8_t FAT_SeekNextCluster(TFatPartition* pPartition, TFatLocation* pLocation)
+{
+  const TFatClusterNr NextCluster = FAT_GetNextCluster(pPartition, pLocation->Cluster);
+
+  if (FAT_IsEndOfChain(pPartition, NextCluster))
+  {
+    pLocation->Cluster = FAT_Cond(pPartition, 0xFFFF, 0x0FFFFFFF);
+    return 0;
+  }
+  FAT_Seek(pPartition, pLocation, NextCluster);
+  return 1;
+}
+
+FAT_API void FAT_ReadNextSector(TFatPartition* pPartition, TFatLocation* pLocation)
+{
+  /* We need to fetch a new sector. Are there any left in this cluster? */
+  if (pLocation->SectorsLeftInCluster == 0)
+  { 
+    /* There wasn't. So we must fetch the next cluster by following the cluster chain.*/
+    if (!FAT_SeekNextCluster(pPartition, pLocation)) return;
+  }
+  else
+  {
+    /* There are more sectors in this cluster. */
+    pLocation->Sector++;
+    pLocation->SectorsLeftInCluster--;
+  }
+  FAT_LoadSector(pPartition, pLocation->Sector);
+}
+
+FAT_API uint8_t FAT_ReadCluster(TFatPartition* pPartition, TFatLocation* pLocation, uint8_t* pDest)
+{
+  const uint8_t Count = pLocation->SectorsLeftInCluster + 1;
+
+  FAT_LoadSectors(pPartition, pLocation->Sector, Count, pDest);
+
+  pLocation->Sector += Count - 1;
+  pLocation->SectorsLeftInCluster = 0;
+  return Count;
+}
+
+FAT_API uint8_t FAT_ReadNextCluster(TFatPartition* pPartition, TFatLocation* pLocation, uint8_t* pDest)
+{
+  if (!FAT_SeekNextCluster(pPartition, pLocation)) return 0;
+
+  return FAT_ReadCluster(pPartition, pLocation, pDest);
+}
+
+#ifdef FAT_ENABLE_STATS
+FAT_API uint8_t FAT_GetSectorRegion(const TFatPartition* pPartition, uint32_t SectorNr)
+{
+  const uint32_t FATStart = pPartition->PartitionLBA + pPartition->ReservedSectors;
+  const uint32_t RootStart = FAT_GetRootOffset(pPartition);
+
+  /* The MBR and the volume ID are read before the partition is known. */
+  if ((SectorNr <= pPartition->PartitionLBA) || (SectorNr < FATStart)) return FAT_REGION_BOOT;
+  if (SectorNr < RootStart) return FAT_REGION_FAT;
+  if (SectorNr < RootStart + pPartition->RootDirectoryEntries / FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR) return FAT_REGION_ROOT;
+  return FAT_REGION_DATA;
+}
+
+FAT_API void FAT_ResetStats(TFatStats* pStats)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_REGION_COUNT; I++)
+  {
+    pStats->Reads[I] = 0;
+    pStats->Writes[I] = 0;
+  }
+  for (I = 0; I < FAT_STATS_LATENCY_BUCKETS; I++)
+  {
+    pStats->Latency[I] = 0;
+  }
+  pStats->ReadRequests = 0;
+  pStats->WriteRequests = 0;
+  pStats->BytesRead = 0;
+  pStats->BytesWritten = 0;
+  pStats->Hits = 0;
+  pStats->Misses = 0;
+}
+
+/* Counts a read or write request of Count sectors and passes it to the trace hook. */
+static void FAT_CountRequest(TFatPartition* pPartition, uint8_t Operation, uint32_t SectorNr, uint16_t Count)
+{
+  TFatStats* const pStats = pPartition->pStats;
+  uint32_t* const pSectors = (Operation == FAT_STATS_READ) ? pStats->Reads : pStats->Writes;
+  const uint8_t Region = FAT_GetSectorRegion(pPartition, SectorNr);
+  uint16_t I;
+
+  if (Operation == FAT_STATS_READ)
+  {
+    pStats->ReadRequests++;
+    pStats->BytesRead += (uint32_t)Count * FAT_BYTES_PER_SECTOR;
+  }
+  else
+  {
+    pStats->WriteRequests++;
+    pStats->BytesWritten += (uint32_t)Count * FAT_BYTES_PER_SECTOR;
+  }
+
+  /* A request can span regions, e.g. when the FAT tables are mirrored. */
+  for (I = 0; I < Count; I++)
+  {
+    pSectors[FAT_GetSectorRegion(pPartition, SectorNr + I)]++;
+  }
+
+  if (pStats->Trace != NULL)
+  {
+    pStats->Trace(pStats->pContext, Operation, Region, SectorNr, Count);
+  }
+}
+
+/* Returns the start time of a device call, if device calls are timed. */
+static uint32_t FAT_StartDeviceCall(const TFatPartition* pPartition)
+{
+  const TFatStats* const pStats = pPartition->pStats;
+
+  return ((pStats != NULL) && (pStats->GetTime != NULL)) ? pStats->GetTime(pStats->pContext) : 0;
+}
+
+/* Counts the duration of a device call in the latency histogram. */
+static void FAT_EndDeviceCall(TFatPartition* pPartition, uint32_t StartTime)
+{
+  TFatStats* const pStats = pPartition->pStats;
+  uint32_t Duration;
+  uint8_t Bucket = 0;
+
+  if ((pStats == NULL) || (pStats->GetTime == NULL)) return;
+
+  /* Unsigned subtraction gives the right duration when the time wraps. */
+  Duration = pStats->GetTime(pStats->pContext) - StartTime;
+  while ((Duration != 0) && (Bucket < FAT_STATS_LATENCY_BUCKETS - 1))
+  {
+    Duration >>= 1;
+    Bucket++;
+  }
+  pStats->Latency[Bucket]++;
+}
+#endif
+
+FAT_API void FAT_ReadSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, uint8_t* pDest)
+{
+  TFatDevice* const pDevice = pPartition->pDevice;
+  S_(uint32_t StartTime;)
+
+  D_(printf(" Reading sector: %d (%d)\n", SectorNr, Count));
+  S_(if (pPartition->pStats != NULL) FAT_CountRequest(pPartition, FAT_STATS_READ, SectorNr, Count));
+
+  if ((Count > 1) && (pDevice->ReadSectors != NULL))
+  {
+    S_(StartTime = FAT_StartDeviceCall(pPartition));
+    pDevice->ReadSectors(pDevice, SectorNr, Count, pDest);
+    S_(FAT_EndDeviceCall(pPartition, StartTime));
+    return;
+  }
+  for (; Count != 0; Count--)
+  {
+    S_(StartTime = FAT_StartDeviceCall(pPartition));
+    pDevice->ReadSector(pDevice, SectorNr++, pDest);
+    S_(FAT_EndDeviceCall(pPartition, StartTime));
+    pDest += FAT_BYTES_PER_SECTOR;
+  }
+}
+
+#ifdef FAT_ENABLE_WRITE
+FAT_API void FAT_WriteSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource)
+{
+  TFatDevice* const pDevice = pPartition->pDevice;
+  S_(uint32_t StartTime;)
+
+  D_(printf(" Writing sector: %d (%d)\n", SectorNr, Count));
+  S_(if (pPartition->pStats != NULL) FAT_CountRequest(pPartition, FAT_STATS_WRITE, SectorNr, Count));
+
+  if ((Count > 1) && (pDevice->WriteSectors != NULL))
+  {
+    S_(StartTime = FAT_StartDeviceCall(pPartition));
+    pDevice->WriteSectors(pDevice, SectorNr, Count, pSource);
+    S_(FAT_EndDeviceCall(pPartition, StartTime));
+    return;
+  }
+  for (; Count != 0; Count--)
+  {
+    S_(StartTime = FAT_StartDeviceCall(pPartition));
+    pDevice->WriteSector(pDevice, SectorNr++, pSource);
+    S_(FAT_EndDeviceCall(pPartition, StartTime));
+    pSource += FAT_BYTES_PER_SECTOR;
+  }
+}
+#endif
+
+FAT_API void FAT_GetFirstDirectoryEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation)
+{
+  FAT_Seek(pPartition, &pDirLocation->Location, StartCluster);
+  FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+  pDirLocation->EntryOffset = 0;
+}
+
+FAT_API void FAT_GetNextDirectoryEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
+{ 
+  /* At entry, all state variables reflect the previous entry. */
+  if (pDirLocation->EntryOffset == (FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR - 1))
+  {
+    FAT_ReadNextSector(pPartition, &pDirLocation->Location);
+    pDirLocation->EntryOffset = 0;
+  }
+  else
+  {
+    /* Skip to the next in this sector. */
+    pDirLocation->EntryOffset++;
+  }
+}
+
+FAT_API TFatDirEntry* FAT_FindDirEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, char* pName, TFatDirectoryLocation* pDirLocation)
+{
+#ifdef FAT_DIR_INDEX_ENTRIES
+  if (pPartition->pNameIndex != NULL)
+  {
+    return FAT_FindIndexedDirEntry(pPartition, DirectoryCluster, pName, pDirLocation);
+  }
+#endif
+
+  /* Compare the name against a whole sector of entries at a time. */
+  FAT_GetFirstDirectoryEntry(pPartition, DirectoryCluster, pDirLocation);
+  while (FAT_IsCurrentClusterValid(pPartition, &pDirLocation->Location))
+  {
+    TFatDirScan Scan;
+
+    FAT_ScanDirSector(pPartition->pBuffer, pName, &Scan);
+    if (Scan.Match != 0)
+    {
+      pDirLocation->EntryOffset = FAT_GetLowestBit(Scan.Match);
+      return FAT_GetDirEntry(pPartition, pDirLocation);
+    }
+    if (Scan.End != 0)
+    {
+      /* Leave pDirLocation at the last entry, for FAT_IsLastDirEntry. */
+      pDirLocation->EntryOffset = FAT_GetLowestBit(Scan.End);
+      break;
+    }
+    FAT_ReadNextSector(pPartition, &pDirLocation->Location);
+  }
+  return NULL;
+}
+
+#ifdef FAT_ENABLE_WRITE
+
+FAT_API uint8_t FAT_CreateCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatLocation* pLocation)
+{
+  TFatClusterNr ClusterNr = FAT_FindFreeCluster(pPartition);
+
+  if (ClusterNr == 0)
+  {
+    return 0;
+  }
+
+  FAT_LinkClusters(pPartition, FirstCluster, ClusterNr);
+  
+  /* Update pLocation */
+  FAT_Seek(pPartition, pLocation, ClusterNr);
+
+  return 1;
+}
+
+FAT_API TFatDirEntry* FAT_CreateDirEntry(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatDirectoryLocation* pDirLocation)
+{
+  TFatClusterNr LastCluster = StartCluster;
+  uint16_t InUse = 0;
+  
+  D_(printf("Creating directory entry, start cluster: %d\n", StartCluster));
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+  /* Remembered for FAT_InitDirEntry, which adds the name to the index. */
+  if (pPartition->pNameIndex != NULL)
+  {
+    pPartition->pNameIndex->CreateCluster = StartCluster;
+  }
+#endif
+  
+#ifdef FAT_DIR_HINT_ENTRIES
+  /* Continue where the last entry of this directory was created. */
+  if (FAT_GetDirHint(pPartition, StartCluster, pDirLocation))
+  {
+    InUse = (uint16_t)((1 << pDirLocation->EntryOffset) - 1);
+    LastCluster = pDirLocation->Location.Cluster;
+    FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+  }
+  else
+#endif
+  {
+    FAT_GetFirstDirectoryEntry(pPartition, StartCluster, pDirLocation);
+  }
+
+  while (FAT_IsCurrentClusterValid(pPartition, &pDirLocation->Location))
+  {
+    TFatDirScan Scan;
+    uint16_t Free;
+
+    FAT_ScanDirSector(pPartition->pBuffer, NULL, &Scan);
+    Free = (uint16_t)((Scan.Deleted | Scan.End) & ~InUse);
+    if (Free != 0)
+    {
+      /* Found an entry that can be used! In case it was a deleted entry,
+       * we can just re-use it. If it was the last entry, the remaining entries
+       * must be "empty" as well.
+       */
+      pDirLocation->EntryOffset = FAT_GetLowestBit(Free);
+      D_(printf("Found unused entry at %d::%d\n", pDirLocation->Location.Cluster, pDirLocation->EntryOffset));
+#ifdef FAT_DIR_HINT_ENTRIES
+      FAT_SetDirHint(pPartition, StartCluster, pDirLocation);
+#endif
+      return FAT_GetDirEntry(pPartition, pDirLocation);
+    }
+    InUse = 0;
+    LastCluster = pDirLocation->Location.Cluster; /* Save it, so we know which one we should link from. */
+    FAT_ReadNextSector(pPartition, &pDirLocation->Location);
+  }
+  /* We found the last cluster. Bummer. 
+   * To extend the directory table, we must find a new
+   * cluster, link it together with the last one, and then
+   * clear the entire cluster (we're forced to since all entries
+   * must be marked as "empty". After that, we're done.
+   */
+  D_(printf("Didn't find unused in cluster. Have to create new cluster.\n"));
+
+  if (FAT_CreateCluster(pPartition, LastCluster, &pDirLocation->Location))
+  {
+    /* Clear the entire cluster. */
+    uint8_t I;
+    uint32_t Sector = pDirLocation->Location.Sector;
+    memset((void*)pPartition->pBuffer, 0, FAT_BYTES_PER_SECTOR);
+  
+    for (I = 0; I < pPartition->SectorsPerCluster; I++)
+    {
+      FAT_StoreSector(pPartition, Sector);
+      Sector++;
+    }
+
+    pDirLocation->EntryOffset = 0;
+#ifdef FAT_DIR_HINT_ENTRIES
+    FAT_SetDirHint(pPartition, StartCluster, pDirLocation);
+#endif
+    return (TFatDirEntry*)pPartition->pBuffer; 
+  }
+  
+  /* Could not create a new cluster - The disk is probably full */
+  return NULL;
+}
+
+FAT_API void FAT_Flush(TFatPartition* pPartition)
+{
+#ifdef FAT_ENABLE_FAT32
+  if (FAT_IsFAT32(pPartition))
+  {
+    FAT32_WriteFSInfo(pPartition);
+  }
+#endif
+#ifdef FAT_ENABLE_FAT_TABLE
+  if (pPartition->pTable != NULL)
+  {
+    FAT_FlushTable(pPartition);
+  }
+#endif
+  FAT_MirrorFAT(pPartition);
+#ifdef FAT_CACHE_WRITE_BACK
+  if (pPartition->pCache != NULL)
+  {
+    FAT_FlushCache(pPartition);
+  }
+#endif
+  if (pPartition->pDevice->Flush != NULL)
+  {
+    pPartition->pDevice->Flush(pPartition->pDevice);
+  }
+}
+
+void FAT_InitDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation, const char* pDirEntryName)
+{
+  const TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
+
+  memset((void*)pDirEntry, 0, sizeof(*pDirEntry));
+  memcpy((void*)pDirEntry->Name, (void*)pDirEntryName, sizeof(pDirEntry->Name));
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+  if (pPartition->pNameIndex != NULL)
+  {
+    FAT_InsertIndexedName(pPartition, pPartition->pNameIndex->CreateCluster, pDirLocation);
+  }
+#endif
+
+  FAT_StoreSector(pPartition, pDirLocation->Location.Sector);
+  D_(printf("Initialised directory entry with name %s\n", pDirEntryName));
+}
+
+FAT_API void FAT_DeleteDirEntry(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation)
+{
+  TFatDirEntry* pDirEntry;
+
+  FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+  pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+  FAT_RemoveIndexedName(pPartition, pDirLocation);
+#endif
+#ifdef FAT_PATH_CACHE_ENTRIES
+  FAT_ForgetPath(pPartition, pDirLocation);
+#endif
+#ifdef FAT_DIR_HINT_ENTRIES
+  FAT_UpdateDirHints(pPartition, pDirLocation);
+#endif
+
+  D_(printf("Deleting directory entry %.11s\n", pDirEntry->Name));
+  pDirEntry->Name[0] = 0xE5;
+  FAT_StoreSector(pPartition, pDirLocation->Location.Sector);
+}
+
+#endif
+
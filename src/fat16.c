@@ -1,212 +1,259 @@
-#include "../include/fat.h"
-#include <string.h>
-
-#ifdef FAT_DEBUG
-#include <stdlib.h>
-#include <assert.h>
-#include <stdio.h>
-#endif
-
-#ifdef FAT_ENABLE_FAT16
-
-FAT_API TFatClusterNr FAT16_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster)
-{
-  const uint32_t Sector = FAT_GetFATSector(pPartition) + ((uint16_t)CurrentCluster / (FAT_BYTES_PER_SECTOR / sizeof(uint16_t)));
-  const uint32_t Offset = ((uint16_t)CurrentCluster % (FAT_BYTES_PER_SECTOR / sizeof(uint16_t))) * sizeof(uint16_t);
-  FAT_ReadSector(pPartition, Sector);
-
-  return (TFatClusterNr)*(uint16_t*)(pPartition->pBuffer + Offset);
-}
-
-FAT_API void FAT16_GetNextRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
-{
-  /* Cluster is used as the number of root dir entries left */
-  pDirLocation->Location.Cluster--;
-
-  if (pDirLocation->Location.Cluster == 0)
-  {
-    /* No more directory entries left. */
-
-    /* Setting Cluster to 0xFFFF will result in "no more entries" in FAT_IsLastDirEntry(). */
-    pDirLocation->Location.Cluster = 0xFFFF;
-    return;
-  }
-  else if (pDirLocation->EntryOffset == (FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR - 1))
-  {
-    /* Read the last directory entry for this sector. Must read a new sector */
-    pDirLocation->Location.Sector++;
-    FAT_ReadSector(pPartition, pDirLocation->Location.Sector);
-    pDirLocation->EntryOffset = 0;
-  }
-  else
-  {
-    pDirLocation->EntryOffset++;
-  }
-}
-
-FAT_API void FAT16_GetFirstRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
-{
-  pDirLocation->Location.Sector = FAT_GetRootOffset(pPartition);
-  /* Reusing Cluster as the number of dir entries left 
-   * Maximum: 512 sectors * 16 entries = 8192 entries - uint16_t is enough, and TFatClusterNr may
-   *          be a uint16_t.
-   */
-  pDirLocation->Location.Cluster = (TFatClusterNr)pPartition->RootDirectoryEntries; 
-  pDirLocation->EntryOffset = 0;
-  FAT_ReadSector(pPartition, pDirLocation->Location.Sector);
-}
-
-FAT_API TFatDirEntry* FAT16_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation)
-{
-  /* The FAT16 root directory is special. It's a fixed number of sectors
-   * located at a specific location. So it's not difficult to search through. 
-   */
-  FAT16_GetFirstRootDirEntry(pPartition, pDirLocation);
-
-  for (;;)
-  {
-    TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
-
-    if (FAT16_IsLastDirEntry(pPartition, pDirEntry, pDirLocation)) break;
-
-    if (!FAT_IsDirEntryDeleted(pDirEntry) && 
-        !FAT_IsLongFileName(pDirEntry))
-    {
-#ifdef FAT_DEBUG
-      if (FAT_IsVolumeID(pDirEntry))
-      {
-        printf("Volume: %.11s\n", pDirEntry->Name);
-      } 
-      else if (FAT_IsFile(pDirEntry))
-      {
-        printf("%.11s    %10d  %10d\n", pDirEntry->Name, pDirEntry->FileSize, FAT_GetStartCluster(pDirEntry));
-      }
-      else if (FAT_IsDirectory(pDirEntry))
-      {
-        printf("%.11s   <DIR>         %10d\n", pDirEntry->Name, FAT_GetStartCluster(pDirEntry));
-      }
-#endif
-      {
-        const void* pCurName = pDirEntry->Name;
-        if (memcmp((void*)pName, pCurName, sizeof(pDirEntry->Name)) == 0)
-	{
-          return pDirEntry;
-	}
-      }
-    }
-    FAT16_GetNextRootDirEntry(pPartition, pDirLocation);  
-  }
-  return NULL;
-}
-
-#ifdef FAT_ENABLE_WRITE
-
-/* Returns 1 if an entry can be created. In that case,
- * CurrentSector and DirectoryEntryOffset points to the
- * new entry. If none can be found, 0 is returned.
- * The number of root directory entries is limited on FAT16 
- * (normally for HDDs, there are 512 * (sector size)/(entry_size)
- *  == 8192 entries)
- */
-FAT_API TFatDirEntry* FAT16_CreateRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
-{
-  FAT16_GetFirstRootDirEntry(pPartition, pDirLocation);
-
-  while (FAT16_IsCurrentClusterValid(pPartition, &pDirLocation->Location))
-  {
-    TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
-
-    if (FAT_IsDirEntryDeleted(pDirEntry) ||  /* Found deleted entry */
-        (pDirEntry->Name[0] == 0x00))        /* Found the last entry */
-    {
-      /* Found an entry that can be used! In case it was a deleted entry,
-       * we can just re-use it. If it was the last entry, the remaining entries
-       * must be "empty" as well.
-       */
-      return pDirEntry;
-    }
-    FAT16_GetNextRootDirEntry(pPartition, pDirLocation);
-  }
-  /* We went through all entries, and still couldn't find one. */
-  return NULL;
-}
-
-/* Finds the next free cluster on the disk, which it returns.
- * If zero (0) is returned, no cluster was found.
- */
-FAT_API TFatClusterNr FAT16_FindFreeCluster(TFatPartition* pPartition) 
-{
-  uint16_t LastCluster;
-  uint16_t FatSectorOffset;
-  uint16_t CurrentCluster = 0; /* TODO: Numbering starts at two? */
-  uint32_t FatSector = FAT_GetFATSector(pPartition);
-
-  LastCluster = (uint16_t)(pPartition->SectorsPerFAT / pPartition->SectorsPerCluster);
-
-  /* Search through the FAT table until we find one that is marked as 'free'.
-   * 
-   * Since there are 256 FAT16 entries, we allow the loop variable to 
-   * wrap over.
-   */
-  do {
-    FAT_ReadSector(pPartition, FatSector);
-    for (FatSectorOffset = 0; FatSectorOffset < FAT_BYTES_PER_SECTOR; FatSectorOffset += sizeof(uint16_t))
-    {
-      if ((*(uint16_t*)(pPartition->pBuffer + FatSectorOffset)) == 0x0000) 
-      {
-	D_(printf("Found free cluster %d\n", CurrentCluster));
-        return (TFatClusterNr)CurrentCluster;
-      }
-      CurrentCluster++;
-    }
-    FatSector++;
-  } while (CurrentCluster < LastCluster); 
-
-  D_(printf("No free cluster found (Disk full?)\n"));
-
-  return 0;
-}
-
-/* Links FirstCluster to SecondCluster and terminates the cluster chain after SecondCluster
- *
- * If FirstCluster is 0, it will not link the clusters, but SecondCluster will still be
- * terminated, thus creating the first cluster of a cluster chain.
- */
-FAT_API void FAT16_LinkClusters(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatClusterNr SecondCluster)
-{
-  uint32_t Sector;
-  uint32_t Offset;
-  
-  D_(printf("Linking Cluster %d -> %d.\n", FirstCluster, SecondCluster));
-
-  /* Link the clusters */
-  if (FirstCluster != 0)
-  {
-    Sector = FAT_GetFATSector(pPartition) + ((uint16_t)FirstCluster / FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR);
-    Offset = ((uint16_t)FirstCluster % FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR) * sizeof(uint16_t);
-  
-    FAT_ReadSector(pPartition, Sector);  
-
-    *(uint16_t*)(pPartition->pBuffer + Offset) = (uint16_t)SecondCluster;
-
-    FAT_WriteSector(pPartition, Sector);
-  }
-
-  /* TODO: We could check if the SecondCluster has the same FAT sector 
-   * as the first and only read/write once instead of 2*(R+W)
-   */
-
-  /* Set SecondCluster to 0xFFFF - which indicates the last cluster. */
-  Sector = FAT_GetFATSector(pPartition) + ((uint16_t)SecondCluster / (FAT_BYTES_PER_SECTOR / sizeof(uint16_t)));
-  Offset = ((uint16_t)SecondCluster % (FAT_BYTES_PER_SECTOR / sizeof(uint16_t))) * sizeof(uint16_t);
-  
-  FAT_ReadSector(pPartition, Sector);
-
-  *(uint16_t*)(pPartition->pBuffer + Offset) = 0xFFFF;
-
-  FAT_WriteSector(pPartition, Sector);
-  
-  D_(printf("Linking done."));
-}
-#endif
-#endif
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_ENABLE_FAT16
+
+FAT_API TFatClusterNr FAT16_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster)
+{
+  const uint32_t Offset = ((uint16_t)CurrentCluster % FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR) * sizeof(uint16_t);
+  const uint8_t* pSector = FAT_LoadFATSector(pPartition, (uint16_t)CurrentCluster / FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR);
+
+  return (TFatClusterNr)*(uint16_t*)(pSector + Offset);
+}
+
+FAT_API void FAT16_GetNextRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
+{
+  /* Cluster is used as the number of root dir entries left */
+  pDirLocation->Location.Cluster--;
+
+  if (pDirLocation->Location.Cluster == 0)
+  {
+    /* No more directory entries left. */
+
+    /* Setting Cluster to 0xFFFF will result in "no more entries" in FAT_IsLastDirEntry(). */
+    pDirLocation->Location.Cluster = 0xFFFF;
+    return;
+  }
+  else if (pDirLocation->EntryOffset == (FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR - 1))
+  {
+    /* Read the last directory entry for this sector. Must read a new sector */
+    pDirLocation->Location.Sector++;
+    FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+    pDirLocation->EntryOffset = 0;
+  }
+  else
+  {
+    pDirLocation->EntryOffset++;
+  }
+}
+
+FAT_API void FAT16_GetFirstRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
+{
+  pDirLocation->Location.Sector = FAT_GetRootOffset(pPartition);
+  /* Reusing Cluster as the number of dir entries left 
+   * Maximum: 512 sectors * 16 entries = 8192 entries - uint16_t is enough, and TFatClusterNr may
+   *          be a uint16_t.
+   */
+  pDirLocation->Location.Cluster = (TFatClusterNr)pPartition->RootDirectoryEntries; 
+  pDirLocation->EntryOffset = 0;
+  FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+}
+
+/* Cluster holds the number of root directory entries left, counting the
+ * current one. These work a sector at a time, with EntryOffset at zero (0).
+ */
+static uint16_t FAT16_GetValidRootEntries(const TFatDirectoryLocation* pDirLocation)
+{
+  const TFatClusterNr Left = pDirLocation->Location.Cluster;
+
+  if (Left >= FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR) return 0xFFFF;
+
+  return (uint16_t)((1 << Left) - 1);
+}
+
+static void FAT16_SetRootDirEntry(TFatDirectoryLocation* pDirLocation, uint8_t EntryOffset)
+{
+  pDirLocation->Location.Cluster -= EntryOffset;
+  pDirLocation->EntryOffset = EntryOffset;
+}
+
+static uint8_t FAT16_GetNextRootDirSector(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
+{
+  if (pDirLocation->Location.Cluster <= FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR)
+  {
+    /* Setting Cluster to 0xFFFF will result in "no more entries" in FAT_IsLastDirEntry(). */
+    pDirLocation->Location.Cluster = 0xFFFF;
+    return 0;
+  }
+  pDirLocation->Location.Cluster -= FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR;
+  pDirLocation->Location.Sector++;
+  FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+  return 1;
+}
+
+FAT_API TFatDirEntry* FAT16_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation)
+{
+  /* The FAT16 root directory is special. It's a fixed number of sectors
+   * located at a specific location. So it's not difficult to search through. 
+   */
+#ifdef FAT_DIR_INDEX_ENTRIES
+  if (pPartition->pNameIndex != NULL)
+  {
+    return FAT_FindIndexedDirEntry(pPartition, 0, pName, pDirLocation);
+  }
+#endif
+  FAT16_GetFirstRootDirEntry(pPartition, pDirLocation);
+
+  for (;;)
+  {
+    const uint16_t Valid = FAT16_GetValidRootEntries(pDirLocation);
+    TFatDirScan Scan;
+
+    FAT_ScanDirSector(pPartition->pBuffer, pName, &Scan);
+    if ((Scan.Match & Valid) != 0)
+    {
+      FAT16_SetRootDirEntry(pDirLocation, FAT_GetLowestBit((uint16_t)(Scan.Match & Valid)));
+      return FAT_GetDirEntry(pPartition, pDirLocation);
+    }
+    if ((Scan.End & Valid) != 0)
+    {
+      FAT16_SetRootDirEntry(pDirLocation, FAT_GetLowestBit((uint16_t)(Scan.End & Valid)));
+      break;
+    }
+    if (!FAT16_GetNextRootDirSector(pPartition, pDirLocation)) break;
+  }
+  return NULL;
+}
+
+#ifdef FAT_ENABLE_WRITE
+
+/* Returns 1 if an entry can be created. In that case,
+ * CurrentSector and DirectoryEntryOffset points to the
+ * new entry. If none can be found, 0 is returned.
+ * The number of root directory entries is limited on FAT16 
+ * (normally for HDDs, there are 512 * (sector size)/(entry_size)
+ *  == 8192 entries)
+ */
+FAT_API TFatDirEntry* FAT16_CreateRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
+{
+  uint16_t InUse = 0;
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+  /* Remembered for FAT_InitDirEntry, which adds the name to the index. */
+  if (pPartition->pNameIndex != NULL)
+  {
+    pPartition->pNameIndex->CreateCluster = 0;
+  }
+#endif
+
+#ifdef FAT_DIR_HINT_ENTRIES
+  /* Continue where the last entry of the root directory was created. */
+  if (FAT_GetDirHint(pPartition, 0, pDirLocation))
+  {
+    InUse = (uint16_t)((1 << pDirLocation->EntryOffset) - 1);
+    pDirLocation->Location.Cluster += pDirLocation->EntryOffset;
+    pDirLocation->EntryOffset = 0;
+    FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+  }
+  else
+#endif
+  {
+    FAT16_GetFirstRootDirEntry(pPartition, pDirLocation);
+  }
+
+  do
+  {
+    TFatDirScan Scan;
+    uint16_t Free;
+
+    FAT_ScanDirSector(pPartition->pBuffer, NULL, &Scan);
+    Free = (uint16_t)((Scan.Deleted | Scan.End) & FAT16_GetValidRootEntries(pDirLocation) & ~InUse);
+    InUse = 0;
+    if (Free != 0)
+    {
+      /* Found an entry that can be used! In case it was a deleted entry,
+       * we can just re-use it. If it was the last entry, the remaining entries
+       * must be "empty" as well.
+       */
+      FAT16_SetRootDirEntry(pDirLocation, FAT_GetLowestBit(Free));
+#ifdef FAT_DIR_HINT_ENTRIES
+      FAT_SetDirHint(pPartition, 0, pDirLocation);
+#endif
+      return FAT_GetDirEntry(pPartition, pDirLocation);
+    }
+  } while (FAT16_GetNextRootDirSector(pPartition, pDirLocation));
+  /* We went through all entries, and still couldn't find one. */
+  return NULL;
+}
+
+FAT_API TFatClusterNr FAT16_FindFreeCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster) 
+{
+  const uint32_t EndCluster = (uint32_t)pPartition->ClusterCount + 2;
+  uint32_t ClusterNr = FirstCluster;
+
+  /* Search through the FAT table a sector at a time until we find an 
+   * entry that is marked as 'free'.
+   */
+  while (ClusterNr < EndCluster)
+  {
+    const uint16_t Index = (uint16_t)(ClusterNr % FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR);
+    uint16_t Count = FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR - Index;
+    uint16_t Found;
+    const uint8_t* pSector = FAT_LoadFATSector(pPartition, ClusterNr / FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR);
+
+    if (Count > EndCluster - ClusterNr)
+    {
+      Count = (uint16_t)(EndCluster - ClusterNr);
+    }
+    Found = FAT16_FindFreeEntry(pSector + Index * sizeof(uint16_t), Count);
+    if (Found < Count) 
+    {
+      return (TFatClusterNr)(ClusterNr + Found);
+    }
+    ClusterNr += Count;
+  }
+  return 0;
+}
+
+/* Links FirstCluster to SecondCluster and terminates the cluster chain after SecondCluster
+ *
+ * If FirstCluster is 0, it will not link the clusters, but SecondCluster will still be
+ * terminated, thus creating the first cluster of a cluster chain.
+ */
+FAT_API void FAT16_LinkClusters(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatClusterNr SecondCluster)
+{
+  const uint32_t SecondSector = (uint16_t)SecondCluster / FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR;
+  const uint32_t SecondOffset = ((uint16_t)SecondCluster % FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR) * sizeof(uint16_t);
+  uint8_t* pSector;
+  
+  D_(printf("Linking Cluster %d -> %d.\n", FirstCluster, SecondCluster));
+
+  /* Link the clusters */
+  if (FirstCluster != 0)
+  {
+    const uint32_t Sector = (uint16_t)FirstCluster / FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR;
+    const uint32_t Offset = ((uint16_t)FirstCluster % FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR) * sizeof(uint16_t);
+  
+    pSector = FAT_LoadFATSector(pPartition, Sector);  
+
+    *(uint16_t*)(pSector + Offset) = (uint16_t)SecondCluster;
+
+    /* When both entries are in the same FAT sector, it only has to be
+     * read and written once.
+     */
+    if (Sector != SecondSector)
+    {
+      FAT_StoreFATSector(pPartition, Sector);
+      pSector = FAT_LoadFATSector(pPartition, SecondSector);
+    }
+  }
+  else
+  {
+    pSector = FAT_LoadFATSector(pPartition, SecondSector);
+  }
+
+  /* Set SecondCluster to 0xFFFF - which indicates the last cluster. */
+  *(uint16_t*)(pSector + SecondOffset) = 0xFFFF;
+
+  FAT_StoreFATSector(pPartition, SecondSector);
+  
+  D_(printf("Linking done."));
+}
+#endif
+#endif
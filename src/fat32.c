@@ -1,30 +1,169 @@
-#include "../include/fat.h"
-
-#ifdef FAT_DEBUG
-#include <stdlib.h>
-#include <assert.h>
-#include <stdio.h>
-#endif
-
-#ifdef FAT_ENABLE_FAT32
-
-FAT_API TFatClusterNr FAT32_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster)
-{
-  const uint32_t Sector = FAT_GetFATSector(pPartition) + (CurrentCluster / (FAT_BYTES_PER_SECTOR / sizeof(uint32_t)));
-  const uint32_t Offset = (CurrentCluster % (FAT_BYTES_PER_SECTOR / sizeof(uint32_t))) * sizeof(uint32_t);
-  FAT_ReadSector(pPartition, Sector);
-
-  /* Only the lowest 28 bits of a FAT32 cluster number are valid. */
-  return (TFatClusterNr)(*(uint32_t*)(pPartition->pBuffer + Offset)) & 0x0FFFFFFF;
-}
-
-FAT_API TFatDirEntry* FAT32_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation)
-{
-  /* Read the volume ID */
-  FAT_ReadSector(pPartition, pPartition->PartitionLBA); 
-
-  return FAT_FindDirEntry(pPartition, FAT32_GetRootDirectoryCluster(pPartition->pBuffer), pName, pDirLocation);
-}
-
-
-#endif
+#include "../include/fat.h"
+#include <stddef.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_ENABLE_FAT32
+
+FAT_API TFatClusterNr FAT32_GetNextCluster(TFatPartition* pPartition, TFatClusterNr CurrentCluster)
+{
+  const uint32_t Offset = (CurrentCluster % FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR) * sizeof(uint32_t);
+  const uint8_t* pSector = FAT_LoadFATSector(pPartition, CurrentCluster / FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR);
+
+  /* Only the lowest 28 bits of a FAT32 cluster number are valid. */
+  return (TFatClusterNr)(*(uint32_t*)(pSector + Offset)) & 0x0FFFFFFF;
+}
+
+FAT_API TFatDirEntry* FAT32_FindRootDirEntry(TFatPartition* pPartition, char* pName, TFatDirectoryLocation* pDirLocation)
+{
+  /* Read the volume ID */
+  FAT_LoadSector(pPartition, pPartition->PartitionLBA); 
+
+  return FAT_FindDirEntry(pPartition, FAT32_GetRootDirectoryCluster(pPartition->pBuffer), pName, pDirLocation);
+}
+
+FAT_API void FAT32_ReadFSInfo(TFatPartition* pPartition)
+{
+  uint32_t FreeCount;
+
+  pPartition->FSInfoSector = FAT32_GetFSInfoSector(pPartition->pBuffer);
+  if ((pPartition->FSInfoSector == 0) || (pPartition->FSInfoSector >= pPartition->ReservedSectors))
+  {
+    pPartition->FSInfoSector = 0;
+    return;
+  }
+
+  FAT_LoadSector(pPartition, pPartition->PartitionLBA + pPartition->FSInfoSector);
+  if (!FAT32_IsFSInfoValid(pPartition->pBuffer))
+  {
+    D_(printf("Invalid FSInfo sector\n"));
+    pPartition->FSInfoSector = 0;
+    return;
+  }
+
+  /* Both values are hints and are only used if they are plausible. */
+  FreeCount = FAT32_GetFSInfoFreeCount(pPartition->pBuffer);
+  if (FreeCount <= pPartition->ClusterCount)
+  {
+    pPartition->FreeClusters = FreeCount;
+  }
+#ifdef FAT_ENABLE_WRITE
+  {
+    const uint32_t NextFree = FAT32_GetFSInfoNextFree(pPartition->pBuffer);
+
+    if ((NextFree >= 2) && (NextFree <= (uint32_t)pPartition->ClusterCount + 1))
+    {
+      pPartition->NextFreeCluster = (TFatClusterNr)NextFree;
+    }
+  }
+  pPartition->FSInfoDirty = 0;
+#endif
+
+  D_(printf("FSInfo: %d free clusters, next free: %d\n", FreeCount, FAT32_GetFSInfoNextFree(pPartition->pBuffer)));
+}
+
+#ifdef FAT_ENABLE_WRITE
+
+FAT_API TFatDirEntry* FAT32_CreateRootDirEntry(TFatPartition* pPartition, TFatDirectoryLocation* pDirLocation)
+{
+  /* Read the volume ID */
+  FAT_LoadSector(pPartition, pPartition->PartitionLBA); 
+
+  return FAT_CreateDirEntry(pPartition, FAT32_GetRootDirectoryCluster(pPartition->pBuffer), pDirLocation);
+}
+
+FAT_API TFatClusterNr FAT32_FindFreeCluster(TFatPartition* pPartition, TFatClusterNr FirstCluster) 
+{
+  const uint32_t EndCluster = (uint32_t)pPartition->ClusterCount + 2;
+  uint32_t ClusterNr = FirstCluster;
+
+  /* Search through the FAT table a sector at a time until we find an 
+   * entry that is marked as 'free'.
+   */
+  while (ClusterNr < EndCluster)
+  {
+    const uint16_t Index = (uint16_t)(ClusterNr % FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR);
+    uint16_t Count = FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR - Index;
+    uint16_t Found;
+    const uint8_t* pSector = FAT_LoadFATSector(pPartition, ClusterNr / FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR);
+
+    if (Count > EndCluster - ClusterNr)
+    {
+      Count = (uint16_t)(EndCluster - ClusterNr);
+    }
+    Found = FAT32_FindFreeEntry(pSector + Index * sizeof(uint32_t), Count);
+    if (Found < Count) 
+    {
+      return (TFatClusterNr)(ClusterNr + Found);
+    }
+    ClusterNr += Count;
+  }
+  return 0;
+}
+
+/* Sets a FAT32 entry, preserving its reserved upper four bits. */
+#define FAT32_SetEntry(pSector, Offset, Value) \
+  (*(uint32_t*)((pSector) + (Offset)) = (*(uint32_t*)((pSector) + (Offset)) & 0xF0000000UL) | ((uint32_t)(Value) & 0x0FFFFFFFUL))
+
+FAT_API void FAT32_LinkClusters(TFatPartition* pPartition, TFatClusterNr FirstCluster, TFatClusterNr SecondCluster)
+{
+  const uint32_t SecondSector = SecondCluster / FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR;
+  const uint32_t SecondOffset = (SecondCluster % FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR) * sizeof(uint32_t);
+  uint8_t* pSector;
+
+  D_(printf("Linking Cluster %d -> %d.\n", FirstCluster, SecondCluster));
+
+  if (FirstCluster != 0)
+  {
+    const uint32_t Sector = FirstCluster / FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR;
+    const uint32_t Offset = (FirstCluster % FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR) * sizeof(uint32_t);
+
+    pSector = FAT_LoadFATSector(pPartition, Sector);
+    FAT32_SetEntry(pSector, Offset, SecondCluster);
+
+    /* When both entries are in the same FAT sector, it only has to be
+     * read and written once.
+     */
+    if (Sector != SecondSector)
+    {
+      FAT_StoreFATSector(pPartition, Sector);
+      pSector = FAT_LoadFATSector(pPartition, SecondSector);
+    }
+  }
+  else
+  {
+    pSector = FAT_LoadFATSector(pPartition, SecondSector);
+  }
+
+  /* Mark SecondCluster as the last cluster. */
+  FAT32_SetEntry(pSector, SecondOffset, 0x0FFFFFFF);
+
+  FAT_StoreFATSector(pPartition, SecondSector);
+}
+
+FAT_API void FAT32_WriteFSInfo(TFatPartition* pPartition)
+{
+  const uint32_t Sector = pPartition->PartitionLBA + pPartition->FSInfoSector;
+
+  if ((pPartition->FSInfoSector == 0) || !pPartition->FSInfoDirty)
+  {
+    return;
+  }
+
+  FAT_LoadSector(pPartition, Sector);
+  if (FAT32_IsFSInfoValid(pPartition->pBuffer))
+  {
+    FAT32_GetFSInfoFreeCount(pPartition->pBuffer) = pPartition->FreeClusters;
+    FAT32_GetFSInfoNextFree(pPartition->pBuffer) = pPartition->NextFreeCluster;
+    FAT_StoreSector(pPartition, Sector);
+  }
+  pPartition->FSInfoDirty = 0;
+}
+#endif
+
+
+#endif
@@ -0,0 +1,364 @@
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_ENABLE_WRITE
+
+#define FAT_GetLastCluster(pPartition) ((TFatClusterNr)((pPartition)->ClusterCount + 1))
+
+#define FAT_ScanFreeCluster(pPartition, FirstCluster) (FAT_Cond(pPartition, FAT16_FindFreeCluster(pPartition, FirstCluster), FAT32_FindFreeCluster(pPartition, FirstCluster)))
+
+#define FAT_GetEntriesPerSector(pPartition) ((uint16_t)FAT_Cond(pPartition, FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR, FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR))
+
+/* Returns entry Index of a FAT sector. */
+#define FAT_GetFATEntry(pPartition, pSector, Index) (FAT_Cond(pPartition, (TFatClusterNr)((const uint16_t*)(pSector))[Index], (TFatClusterNr)(((const uint32_t*)(pSector))[Index] & 0x0FFFFFFF)))
+
+#ifdef FAT_ENABLE_FREE_MAP
+
+#define FAT_HasFreeMap(pPartition) (((pPartition)->pFreeMap != NULL) && ((pPartition)->FreeMapSize >= FAT_FREE_MAP_SIZE((pPartition)->ClusterCount)))
+
+#define FAT_IsClusterUsed(pFreeMap, ClusterNr) ((pFreeMap)[(ClusterNr) >> 3] & (uint8_t)(1 << ((ClusterNr) & 7)))
+
+/* Reads the whole FAT and marks the used clusters in the bitmap. The bits 
+ * of the reserved clusters and of those beyond the end of the partition are
+ * set as well, so they are never returned.
+ */
+static void FAT_BuildFreeMap(TFatPartition* pPartition)
+{
+  const uint32_t LastCluster = FAT_GetLastCluster(pPartition);
+  const uint16_t EntriesPerSector = FAT_GetEntriesPerSector(pPartition);
+  uint8_t* const pFreeMap = pPartition->pFreeMap;
+  const uint8_t* pSector = NULL;
+  uint32_t ClusterNr;
+  uint32_t Free = 0;
+
+  memset((void*)pFreeMap, 0xFF, FAT_FREE_MAP_SIZE(pPartition->ClusterCount));
+
+  for (ClusterNr = 2; ClusterNr <= LastCluster; ClusterNr++)
+  {
+    const uint16_t Index = (uint16_t)(ClusterNr % EntriesPerSector);
+
+    if ((pSector == NULL) || (Index == 0))
+    {
+      pSector = FAT_LoadFATSector(pPartition, ClusterNr / EntriesPerSector);
+    }
+    if (FAT_GetFATEntry(pPartition, pSector, Index) == 0)
+    {
+      pFreeMap[ClusterNr >> 3] &= (uint8_t)~(1 << (ClusterNr & 7));
+      Free++;
+    }
+  }
+
+  D_(printf("Built free cluster map: %d of %d clusters free\n", Free, pPartition->ClusterCount));
+
+  pPartition->FreeClusters = Free;
+  pPartition->FreeMapValid = 1;
+#ifdef FAT_ENABLE_FAT32
+  pPartition->FSInfoDirty = 1;
+#endif
+}
+
+/* Returns the first free cluster from FirstCluster to LastCluster, or 0. */
+static TFatClusterNr FAT_SearchFreeMap(const uint8_t* pFreeMap, uint32_t FirstCluster, uint32_t LastCluster)
+{
+  uint32_t ClusterNr = FirstCluster;
+
+  while (ClusterNr <= LastCluster)
+  {
+    if (((ClusterNr & 7) == 0) && (pFreeMap[ClusterNr >> 3] == 0xFF))
+    {
+      /* Skip eight used clusters at a time. */
+      ClusterNr += 8;
+      continue;
+    }
+    if (!FAT_IsClusterUsed(pFreeMap, ClusterNr))
+    {
+      return (TFatClusterNr)ClusterNr;
+    }
+    ClusterNr++;
+  }
+  return 0;
+}
+#endif
+
+FAT_API TFatClusterNr FAT_FindFreeCluster(TFatPartition* pPartition)
+{
+  const TFatClusterNr Cursor = pPartition->NextFreeCluster;
+  TFatClusterNr ClusterNr;
+
+#ifdef FAT_ENABLE_FREE_MAP
+  if (FAT_HasFreeMap(pPartition))
+  {
+    uint8_t* const pFreeMap = pPartition->pFreeMap;
+
+    if (!pPartition->FreeMapValid)
+    {
+      FAT_BuildFreeMap(pPartition);
+    }
+    ClusterNr = FAT_SearchFreeMap(pFreeMap, Cursor, FAT_GetLastCluster(pPartition));
+    if (ClusterNr == 0)
+    {
+      ClusterNr = FAT_SearchFreeMap(pFreeMap, 2, Cursor);
+    }
+    if (ClusterNr != 0)
+    {
+      pFreeMap[ClusterNr >> 3] |= (uint8_t)(1 << (ClusterNr & 7));
+    }
+  }
+  else
+#endif
+  {
+    ClusterNr = FAT_ScanFreeCluster(pPartition, Cursor);
+    if ((ClusterNr == 0) && (Cursor > 2))
+    {
+      /* Wrap around to the start of the partition. */
+      ClusterNr = FAT_ScanFreeCluster(pPartition, 2);
+    }
+  }
+
+  if (ClusterNr == 0)
+  {
+    D_(printf("No free cluster found (Disk full?)\n"));
+    return 0;
+  }
+  D_(printf("Found free cluster %d\n", ClusterNr));
+
+  pPartition->NextFreeCluster = (ClusterNr == FAT_GetLastCluster(pPartition)) ? 2 : ClusterNr + 1;
+  if (pPartition->FreeClusters != FAT_UNKNOWN_FREE_CLUSTERS)
+  {
+    pPartition->FreeClusters--;
+  }
+#ifdef FAT_ENABLE_FAT32
+  pPartition->FSInfoDirty = 1;
+#endif
+  return ClusterNr;
+}
+
+/* Sets entry Index of a FAT sector. The reserved upper four bits of a 
+ * FAT32 entry are preserved.
+ */
+static void FAT_SetFATEntry(const TFatPartition* pPartition, uint8_t* pSector, uint16_t Index, TFatClusterNr Value)
+{
+  if (FAT_IsFAT16(pPartition))
+  {
+    ((uint16_t*)pSector)[Index] = (uint16_t)Value;
+  }
+  else
+  {
+    ((uint32_t*)pSector)[Index] = (((uint32_t*)pSector)[Index] & 0xF0000000UL) | ((uint32_t)Value & 0x0FFFFFFFUL);
+  }
+}
+
+/* Searches FirstCluster to LastCluster for Count consecutive free clusters.
+ * Returns Count if such a run was found, otherwise the length of the longest
+ * run (possibly 0). The first cluster of the run is stored in pStartCluster.
+ */
+static TFatClusterNr FAT_FindFreeRun(TFatPartition* pPartition, uint32_t FirstCluster, uint32_t LastCluster, 
+                                     TFatClusterNr Count, TFatClusterNr* pStartCluster)
+{
+  const uint16_t EntriesPerSector = FAT_GetEntriesPerSector(pPartition);
+  const uint8_t* pSector = NULL;
+  TFatClusterNr Longest = 0;
+  TFatClusterNr Length = 0;
+  uint32_t ClusterNr;
+  uint8_t Free;
+
+  for (ClusterNr = FirstCluster; ClusterNr <= LastCluster; ClusterNr++)
+  {
+#ifdef FAT_ENABLE_FREE_MAP
+    if (FAT_HasFreeMap(pPartition))
+    {
+      Free = !FAT_IsClusterUsed(pPartition->pFreeMap, ClusterNr);
+    }
+    else
+#endif
+    {
+      const uint16_t Index = (uint16_t)(ClusterNr % EntriesPerSector);
+
+      if ((pSector == NULL) || (Index == 0))
+      {
+        pSector = FAT_LoadFATSector(pPartition, ClusterNr / EntriesPerSector);
+      }
+      Free = (FAT_GetFATEntry(pPartition, pSector, Index) == 0);
+    }
+
+    if (!Free)
+    {
+      Length = 0;
+      continue;
+    }
+    Length++;
+    if (Length > Longest)
+    {
+      Longest = Length;
+      *pStartCluster = (TFatClusterNr)(ClusterNr - (Length - 1));
+      if (Longest == Count)
+      {
+        break;
+      }
+    }
+  }
+  return Longest;
+}
+
+FAT_API TFatClusterNr FAT_AllocateClusters(TFatPartition* pPartition, TFatClusterNr PrevCluster, TFatClusterNr Count, TFatClusterNr* pStartCluster)
+{
+  const uint32_t LastCluster = FAT_GetLastCluster(pPartition);
+  const uint16_t EntriesPerSector = FAT_GetEntriesPerSector(pPartition);
+  const TFatClusterNr Cursor = pPartition->NextFreeCluster;
+  TFatClusterNr Length;
+  TFatClusterNr StartCluster = 0;
+  uint32_t ClusterNr;
+  uint32_t EndCluster;
+
+  if (Count == 0)
+  {
+    return 0;
+  }
+
+#ifdef FAT_ENABLE_FREE_MAP
+  if (FAT_HasFreeMap(pPartition) && !pPartition->FreeMapValid)
+  {
+    FAT_BuildFreeMap(pPartition);
+  }
+#endif
+
+  /* Next-fit: search from the cursor to the end, then wrap around. */
+  Length = FAT_FindFreeRun(pPartition, Cursor, LastCluster, Count, &StartCluster);
+  if ((Length < Count) && (Cursor > 2))
+  {
+    TFatClusterNr WrappedStart = 0;
+    uint32_t WrappedLast = (uint32_t)Cursor - 1 + (Count - 1);
+    TFatClusterNr WrappedLength;
+
+    if (WrappedLast > LastCluster)
+    {
+      WrappedLast = LastCluster;
+    }
+    WrappedLength = FAT_FindFreeRun(pPartition, 2, WrappedLast, Count, &WrappedStart);
+    if (WrappedLength > Length)
+    {
+      Length = WrappedLength;
+      StartCluster = WrappedStart;
+    }
+  }
+  if (Length == 0)
+  {
+    D_(printf("No free cluster found (Disk full?)\n"));
+    return 0;
+  }
+
+  D_(printf("Allocating clusters %d-%d after %d\n", StartCluster, StartCluster + Length - 1, PrevCluster));
+
+  /* Write the chain one FAT sector at a time. The link from PrevCluster is
+   * written along with the run if it is in the same FAT sector.
+   */
+  EndCluster = (uint32_t)StartCluster + Length - 1;
+  ClusterNr = StartCluster;
+  while (ClusterNr <= EndCluster)
+  {
+    const uint32_t Sector = ClusterNr / EntriesPerSector;
+    uint8_t* const pSector = FAT_LoadFATSector(pPartition, Sector);
+
+    if ((PrevCluster != 0) && (PrevCluster / EntriesPerSector == Sector))
+    {
+      FAT_SetFATEntry(pPartition, pSector, (uint16_t)(PrevCluster % EntriesPerSector), StartCluster);
+      PrevCluster = 0;
+    }
+    do
+    {
+      FAT_SetFATEntry(pPartition, pSector, (uint16_t)(ClusterNr % EntriesPerSector), 
+                      (ClusterNr == EndCluster) ? FAT_Cond(pPartition, 0xFFFF, 0x0FFFFFFF) : (TFatClusterNr)(ClusterNr + 1));
+#ifdef FAT_ENABLE_FREE_MAP
+      if (FAT_HasFreeMap(pPartition))
+      {
+        pPartition->pFreeMap[ClusterNr >> 3] |= (uint8_t)(1 << (ClusterNr & 7));
+      }
+#endif
+      ClusterNr++;
+    } while ((ClusterNr <= EndCluster) && (ClusterNr % EntriesPerSector != 0));
+    FAT_StoreFATSector(pPartition, Sector);
+  }
+  if (PrevCluster != 0)
+  {
+    const uint32_t Sector = PrevCluster / EntriesPerSector;
+
+    FAT_SetFATEntry(pPartition, FAT_LoadFATSector(pPartition, Sector), (uint16_t)(PrevCluster % EntriesPerSector), StartCluster);
+    FAT_StoreFATSector(pPartition, Sector);
+  }
+
+  pPartition->NextFreeCluster = (EndCluster == LastCluster) ? 2 : (TFatClusterNr)(EndCluster + 1);
+  if (pPartition->FreeClusters != FAT_UNKNOWN_FREE_CLUSTERS)
+  {
+    pPartition->FreeClusters -= Length;
+  }
+#ifdef FAT_ENABLE_FAT32
+  pPartition->FSInfoDirty = 1;
+#endif
+
+  *pStartCluster = StartCluster;
+  return Length;
+}
+
+FAT_API TFatClusterNr FAT_FreeClusters(TFatPartition* pPartition, TFatClusterNr PrevCluster, TFatClusterNr StartCluster)
+{
+  const uint16_t EntriesPerSector = FAT_GetEntriesPerSector(pPartition);
+  TFatClusterNr ClusterNr = StartCluster;
+  TFatClusterNr Freed = 0;
+
+  D_(printf("Freeing the chain from %d after %d\n", StartCluster, PrevCluster));
+
+  if (PrevCluster != 0)
+  {
+    const uint32_t Sector = PrevCluster / EntriesPerSector;
+
+    FAT_SetFATEntry(pPartition, FAT_LoadFATSector(pPartition, Sector), (uint16_t)(PrevCluster % EntriesPerSector), 
+                    FAT_Cond(pPartition, 0xFFFF, 0x0FFFFFFF));
+    FAT_StoreFATSector(pPartition, Sector);
+  }
+
+  /* Free the links that are in the same FAT sector with one 
+   * read-modify-write, then move on to the sector of the next link.
+   */
+  while ((ClusterNr >= 2) && (ClusterNr <= FAT_GetLastCluster(pPartition)))
+  {
+    const uint32_t Sector = ClusterNr / EntriesPerSector;
+    uint8_t* const pSector = FAT_LoadFATSector(pPartition, Sector);
+
+    do
+    {
+      const uint16_t Index = (uint16_t)(ClusterNr % EntriesPerSector);
+      const TFatClusterNr NextCluster = FAT_GetFATEntry(pPartition, pSector, Index);
+
+      FAT_SetFATEntry(pPartition, pSector, Index, 0);
+#ifdef FAT_ENABLE_FREE_MAP
+      if (FAT_HasFreeMap(pPartition) && pPartition->FreeMapValid)
+      {
+        pPartition->pFreeMap[ClusterNr >> 3] &= (uint8_t)~(1 << (ClusterNr & 7));
+      }
+#endif
+      if (ClusterNr < pPartition->NextFreeCluster)
+      {
+        pPartition->NextFreeCluster = ClusterNr;
+      }
+      Freed++;
+      ClusterNr = NextCluster;
+    } while ((ClusterNr >= 2) && (ClusterNr <= FAT_GetLastCluster(pPartition)) && (ClusterNr / EntriesPerSector == Sector));
+    FAT_StoreFATSector(pPartition, Sector);
+  }
+
+  if (pPartition->FreeClusters != FAT_UNKNOWN_FREE_CLUSTERS)
+  {
+    pPartition->FreeClusters += Freed;
+  }
+#ifdef FAT_ENABLE_FAT32
+  pPartition->FSInfoDirty = 1;
+#endif
+  return Freed;
+}
+#endif
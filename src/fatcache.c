@@ -0,0 +1,297 @@
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_ENABLE_STATS
+/* Counts a FAT_LoadSector call in TFatStats::Hits or TFatStats::Misses. */
+#define FAT_CountLoad(pPartition, Counter) do { if ((pPartition)->pStats != NULL) (pPartition)->pStats->Counter++; } while (0)
+#endif
+
+#ifdef FAT_CACHE_SECTORS
+#define FAT_GetCacheData(pCache, Index) ((pCache)->pData + (uint32_t)(Index) * FAT_BYTES_PER_SECTOR)
+
+FAT_API void FAT_InitCache(TFatCache* pCache)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_CACHE_SECTORS; I++)
+  {
+    pCache->Entries[I].Flags = 0;
+  }
+  pCache->Tick = 0;
+  pCache->Hits = 0;
+  pCache->Misses = 0;
+  pCache->Evictions = 0;
+}
+
+/* Returns the index of the entry holding SectorNr, or FAT_CACHE_SECTORS
+ * if the sector is not cached.
+ */
+static uint8_t FAT_FindCacheEntry(const TFatCache* pCache, uint32_t SectorNr)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_CACHE_SECTORS; I++)
+  {
+    if ((pCache->Entries[I].Flags & FAT_CACHE_VALID) && 
+        (pCache->Entries[I].Sector == SectorNr))
+    {
+      return I;
+    }
+  }
+  return FAT_CACHE_SECTORS;
+}
+
+/* Returns the index of the entry that should hold a new sector. An unused
+ * entry is preferred, otherwise the least recently used one is returned.
+ */
+static uint8_t FAT_FindVictimEntry(const TFatCache* pCache)
+{
+  uint8_t I;
+  uint8_t Victim = 0;
+
+  for (I = 0; I < FAT_CACHE_SECTORS; I++)
+  {
+    if (!(pCache->Entries[I].Flags & FAT_CACHE_VALID))
+    {
+      return I;
+    }
+    /* Unsigned subtraction keeps the order correct when Tick wraps. */
+    if ((uint32_t)(pCache->Tick - pCache->Entries[I].LastUsed) > 
+        (uint32_t)(pCache->Tick - pCache->Entries[Victim].LastUsed))
+    {
+      Victim = I;
+    }
+  }
+  return Victim;
+}
+
+#ifdef FAT_CACHE_WRITE_BACK
+/* Writes a modified entry to the disk. */
+static void FAT_WriteCacheEntry(TFatPartition* pPartition, uint8_t Index)
+{
+  TFatCache* const pCache = pPartition->pCache;
+
+  FAT_WriteSectors(pPartition, pCache->Entries[Index].Sector, 1, FAT_GetCacheData(pCache, Index));
+  pCache->Entries[Index].Flags &= (uint8_t)~FAT_CACHE_DIRTY;
+}
+#endif
+
+/* Returns an entry that can be used for SectorNr, which must not be cached.
+ * If a valid entry has to be replaced, it is written to the disk first if it
+ * has been modified.
+ */
+static uint8_t FAT_AllocateCacheEntry(TFatPartition* pPartition, uint32_t SectorNr)
+{
+  TFatCache* const pCache = pPartition->pCache;
+  const uint8_t Index = FAT_FindVictimEntry(pCache);
+
+  if (pCache->Entries[Index].Flags & FAT_CACHE_VALID)
+  {
+    pCache->Evictions++;
+#ifdef FAT_CACHE_WRITE_BACK
+    if (pCache->Entries[Index].Flags & FAT_CACHE_DIRTY)
+    {
+      FAT_WriteCacheEntry(pPartition, Index);
+    }
+#endif
+  }
+  pCache->Entries[Index].Sector = SectorNr;
+  pCache->Entries[Index].Flags = FAT_CACHE_VALID;
+  return Index;
+}
+
+/* Loads a sector through the sector cache. */
+static void FAT_LoadCachedSector(TFatPartition* pPartition, uint32_t SectorNr)
+{
+  TFatCache* const pCache = pPartition->pCache;
+  uint8_t Index;
+
+  Index = FAT_FindCacheEntry(pCache, SectorNr);
+  if (Index != FAT_CACHE_SECTORS)
+  {
+    pCache->Hits++;
+    S_(FAT_CountLoad(pPartition, Hits));
+  }
+  else
+  {
+    pCache->Misses++;
+    S_(FAT_CountLoad(pPartition, Misses));
+    Index = FAT_AllocateCacheEntry(pPartition, SectorNr);
+    FAT_ReadSectors(pPartition, SectorNr, 1, FAT_GetCacheData(pCache, Index));
+  }
+  memcpy((void*)pPartition->pBuffer, (void*)FAT_GetCacheData(pCache, Index), FAT_BYTES_PER_SECTOR);
+  pCache->Entries[Index].LastUsed = ++pCache->Tick;
+}
+
+#ifdef FAT_ENABLE_WRITE
+/* Stores a sector through the sector cache. */
+static void FAT_StoreCachedSector(TFatPartition* pPartition, uint32_t SectorNr)
+{
+  TFatCache* const pCache = pPartition->pCache;
+  uint8_t Index;
+
+  Index = FAT_FindCacheEntry(pCache, SectorNr);
+#ifdef FAT_CACHE_WRITE_BACK
+  if (Index == FAT_CACHE_SECTORS)
+  {
+    Index = FAT_AllocateCacheEntry(pPartition, SectorNr);
+  }
+  pCache->Entries[Index].Flags |= FAT_CACHE_DIRTY;
+#else
+  /* Write-through: only sectors that are already cached are updated. Sectors
+   * that are written without having been read (e.g. when clearing a new 
+   * directory cluster) would otherwise evict more useful entries.
+   */
+  FAT_WriteSector(pPartition, SectorNr);
+  if (Index == FAT_CACHE_SECTORS)
+  {
+    return;
+  }
+#endif
+  memcpy((void*)FAT_GetCacheData(pCache, Index), (void*)pPartition->pBuffer, FAT_BYTES_PER_SECTOR);
+  pCache->Entries[Index].LastUsed = ++pCache->Tick;
+}
+#endif
+#endif
+
+FAT_API void FAT_LoadSector(TFatPartition* pPartition, uint32_t SectorNr)
+{
+  TFatDevice* const pDevice = pPartition->pDevice;
+
+  if (pDevice->MapSector != NULL)
+  {
+    /* The sector is read where it lies, so there is nothing to copy or cache. */
+    pPartition->pBuffer = pDevice->MapSector(pDevice, SectorNr);
+    S_(FAT_CountLoad(pPartition, Hits));
+    return;
+  }
+#ifdef FAT_CACHE_SECTORS
+  if (pPartition->pCache != NULL)
+  {
+    FAT_Lock(pPartition, FAT_LOCK_CACHE);
+    FAT_LoadCachedSector(pPartition, SectorNr);
+    FAT_Unlock(pPartition, FAT_LOCK_CACHE);
+    return;
+  }
+#endif
+  S_(FAT_CountLoad(pPartition, Misses));
+  FAT_ReadSector(pPartition, SectorNr);
+}
+
+FAT_API void FAT_LoadSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, uint8_t* pDest)
+{
+#ifdef FAT_CACHE_WRITE_BACK
+  TFatCache* const pCache = pPartition->pCache;
+  uint8_t I;
+#endif
+
+#ifdef FAT_CACHE_WRITE_BACK
+  if (pCache == NULL)
+  {
+    FAT_ReadSectors(pPartition, SectorNr, Count, pDest);
+    return;
+  }
+
+  /* Another thread could write back and evict a modified entry between
+   * the read and the merge below.
+   */
+  FAT_Lock(pPartition, FAT_LOCK_CACHE);
+  FAT_ReadSectors(pPartition, SectorNr, Count, pDest);
+
+  /* The disk holds stale data for sectors that are modified in the cache. */
+  for (I = 0; I < FAT_CACHE_SECTORS; I++)
+  {
+    const uint32_t Index = pCache->Entries[I].Sector - SectorNr;
+
+    if ((pCache->Entries[I].Flags & FAT_CACHE_DIRTY) && (Index < Count))
+    {
+      memcpy((void*)(pDest + Index * FAT_BYTES_PER_SECTOR), (void*)FAT_GetCacheData(pCache, I), FAT_BYTES_PER_SECTOR);
+    }
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_CACHE);
+#else
+  FAT_ReadSectors(pPartition, SectorNr, Count, pDest);
+#endif
+}
+
+#ifdef FAT_ENABLE_WRITE
+
+FAT_API void FAT_StoreSector(TFatPartition* pPartition, uint32_t SectorNr)
+{
+#ifdef FAT_CACHE_SECTORS
+  if (pPartition->pCache != NULL)
+  {
+    FAT_Lock(pPartition, FAT_LOCK_CACHE);
+    FAT_StoreCachedSector(pPartition, SectorNr);
+    FAT_Unlock(pPartition, FAT_LOCK_CACHE);
+    return;
+  }
+#endif
+  FAT_WriteSector(pPartition, SectorNr);
+}
+
+FAT_API void FAT_StoreSectors(TFatPartition* pPartition, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource)
+{
+#ifdef FAT_CACHE_SECTORS
+  TFatCache* const pCache = pPartition->pCache;
+  uint8_t I;
+
+  if (pCache != NULL)
+  {
+    FAT_Lock(pPartition, FAT_LOCK_CACHE);
+    for (I = 0; I < FAT_CACHE_SECTORS; I++)
+    {
+      const uint32_t Index = pCache->Entries[I].Sector - SectorNr;
+
+      if ((pCache->Entries[I].Flags & FAT_CACHE_VALID) && (Index < Count))
+      {
+        memcpy((void*)FAT_GetCacheData(pCache, I), (void*)(pSource + Index * FAT_BYTES_PER_SECTOR), FAT_BYTES_PER_SECTOR);
+        pCache->Entries[I].Flags &= (uint8_t)~FAT_CACHE_DIRTY;
+      }
+    }
+    FAT_Unlock(pPartition, FAT_LOCK_CACHE);
+  }
+#endif
+  FAT_WriteSectors(pPartition, SectorNr, Count, pSource);
+}
+
+#ifdef FAT_CACHE_WRITE_BACK
+FAT_API void FAT_FlushCache(TFatPartition* pPartition)
+{
+  TFatCache* const pCache = pPartition->pCache;
+
+  /* Write the modified entries in ascending sector order, which lets the
+   * disk handle them as a sequential write. The cache is small, so picking
+   * the lowest remaining sector on every iteration is cheap enough.
+   */
+  FAT_Lock(pPartition, FAT_LOCK_CACHE);
+  for (;;)
+  {
+    uint8_t I;
+    uint8_t Lowest = FAT_CACHE_SECTORS;
+
+    for (I = 0; I < FAT_CACHE_SECTORS; I++)
+    {
+      if ((pCache->Entries[I].Flags & FAT_CACHE_DIRTY) && 
+          ((Lowest == FAT_CACHE_SECTORS) || (pCache->Entries[I].Sector < pCache->Entries[Lowest].Sector)))
+      {
+        Lowest = I;
+      }
+    }
+    if (Lowest == FAT_CACHE_SECTORS)
+    {
+      break;
+    }
+    FAT_WriteCacheEntry(pPartition, Lowest);
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_CACHE);
+}
+#endif
+
+#endif
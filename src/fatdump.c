@@ -1,128 +1,712 @@
-#ifdef _WIN32
-#include <windows.h>
-#endif
-
-#include <stdlib.h>
-#include <assert.h>
-#include <stdio.h>
-
-#include "../include/fat.h"
-
-#ifdef _WIN32
-static HANDLE hFile;
-#endif
-#ifdef __unix__
-static FILE* fp;
-#endif
-
-static uint8_t FAT_Buffer[FAT_BYTES_PER_SECTOR];
-
-void FAT_ReadSector(TFatPartition* pPartition, uint32_t SectorNr)
-{
-#ifdef FAT_DEBUG
-  printf(" Reading sector: %d\n", SectorNr);
-#endif
-
-#ifdef _WIN32
-  {
-    DWORD BytesRead;
-    assert(SetFilePointer(hFile, SectorNr * FAT_BYTES_PER_SECTOR, NULL, FILE_BEGIN) != INVALID_SET_FILE_POINTER);
-    assert(ReadFile(hFile, (LPVOID)pPartition->pBuffer, FAT_BYTES_PER_SECTOR, &BytesRead, NULL) != 0);
-    assert(BytesRead == FAT_BYTES_PER_SECTOR);
-  }
-#endif
-#ifdef __unix__
-  fseek(fp, SectorNr * FAT_BYTES_PER_SECTOR, SEEK_SET);
-  assert(fread((void*)FAT_Buffer, 1, FAT_BYTES_PER_SECTOR, fp) == FAT_BYTES_PER_SECTOR);
-#endif
-}
-
-void FAT_WriteSector(TFatPartition* pPartition, uint32_t SectorNr)
-{
-#ifdef FAT_DEBUG
-  printf(" Writing sector: %d\n", SectorNr);
-#endif
-
-#ifdef _WIN32
-  {
-    DWORD BytesWritten;
-    assert(SetFilePointer(hFile, SectorNr * FAT_BYTES_PER_SECTOR, NULL, FILE_BEGIN) != INVALID_SET_FILE_POINTER);
-    assert(WriteFile(hFile, (LPVOID)pPartition->pBuffer, FAT_BYTES_PER_SECTOR, &BytesWritten, NULL) != 0);
-    assert(BytesWritten == FAT_BYTES_PER_SECTOR);
-  }
-#endif
-#ifdef __unix__
-  fseek(fp, SectorNr * FAT_BYTES_PER_SECTOR, SEEK_SET);
-  assert(fwrite((void*)FAT_Buffer, 1, FAT_BYTES_PER_SECTOR, fp) == FAT_BYTES_PER_SECTOR);
-#endif
-}
-
-int main (int argc, char *argv[])
-{
-  TFatPartition Partition;
-
-  if (argc != 2)
-  {
-    printf("Usage: %s <disk_image>\n", argv[0]);
-    return EXIT_FAILURE;
-  }
-
-#ifdef _WIN32
-  hFile = CreateFileA(argv[1],
-                     GENERIC_READ,          
-                     FILE_SHARE_READ,       
-                     NULL,                  
-                     OPEN_EXISTING,        
-                     FILE_ATTRIBUTE_NORMAL,
-                     NULL);                
- 
-  assert(hFile != INVALID_HANDLE_VALUE);
-#elif __unix__
-  fp = fopen(argv[1], "r+");
-  assert(fp != NULL);
-#endif
-
-  Partition.pBuffer = FAT_Buffer;
-
-  if (FAT_OpenPartition(&Partition, 0))
-  {
-    TFatDirectoryLocation DirLocation;
-
-    FAT_FindRootDirEntry(&Partition, "FIXAT   TT", &DirLocation);
-
-    if (FAT_IsLastDirEntry(&Partition, FAT_GetDirEntry(&Partition, &DirLocation), &DirLocation))
-    {
-      printf("The file was not found\n");
-    }
-    else
-    {
-      printf("Fixat.TXT starts at cluster: %d\n", FAT_GetStartCluster(FAT_GetDirEntry(&Partition, &DirLocation)));
-    }
-
-    FAT_FindDirEntry(&Partition, 8, "FIXAT   TT", &DirLocation);
-
-    /*
-    if (FAT_CreateDirEntry(4))
-    {
-      FAT_InitDirEntry("MYFILE  TXT");
-      printf("Directory entry created.\n");
-      if (FAT_CreateFreeCluster(0))
-      {
-	printf("1. Found free cluster: %d\n", FAT_CurrentCluster);
-	FAT_CreateFreeCluster(FAT_CurrentCluster);
-	printf("2. Found free cluster: %d\n", FAT_CurrentCluster);
-	FAT_CreateFreeCluster(FAT_CurrentCluster);
-	printf("3. Found free cluster: %d\n", FAT_CurrentCluster);
-      }
-    }
-    else*/
-    {
-      printf("Couldn't create directory entry.\n");
-    }
-  }
-  else
-  {
-    printf("FATAL: The disk is either corrupt, or has an invalid partition type.\n");
-  }
-  return 0;
-}
+#ifdef __unix__
+/* Needed for the POSIX thread and stdio locking functions. */
+#define _POSIX_C_SOURCE 200112L
+#include <unistd.h>
+#endif
+
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/fat.h"
+#include "../include/fathost.h"
+
+/* Directories are listed by a pool of threads if the library is built
+ * with FAT_ENABLE_THREADS, and by the main thread otherwise.
+ */
+#if defined(FAT_ENABLE_THREADS) && defined(__unix__)
+#define FAT_DUMP_THREADS
+#include <pthread.h>
+#endif
+
+/* The maximum number of threads. */
+#define FAT_DUMP_MAX_WORKERS (64)
+
+/* Subdirectories deeper than this are not listed, which also stops the
+ * walk on a corrupt volume whose directories form a cycle.
+ */
+#define FAT_DUMP_MAX_DEPTH (64)
+
+#ifdef FAT_DUMP_THREADS
+#define FAT_DumpLock(pMutex)   pthread_mutex_lock(pMutex)
+#define FAT_DumpUnlock(pMutex) pthread_mutex_unlock(pMutex)
+#else
+#define FAT_DumpLock(pMutex)
+#define FAT_DumpUnlock(pMutex)
+#endif
+
+/* A directory waiting to be listed. */
+typedef struct TFatDumpJob TFatDumpJob;
+struct TFatDumpJob {
+  TFatDumpJob*      pNext;                 /* The next job towards the tail of the queue. */
+  TFatDumpJob*      pPrev;                 /* The previous job towards the head of the queue. */
+  TFatClusterNr     Cluster;               /* The first cluster of the directory, or zero (0) for the FAT16 root directory. */
+  uint8_t           Depth;                 /* The number of directories above it. */
+  char*             pPath;                 /* The path of the directory, without a trailing '/'. Empty for the root directory. */
+};
+
+/* The state of one thread of the walk. Every worker has a queue of
+ * directories. It takes the newest one from the head of its own queue,
+ * which keeps the walk depth-first, and when it runs out, it steals the
+ * oldest one from the tail of another worker's queue.
+ */
+typedef struct {
+  TFatPartition     Partition;             /* The worker's read context. */
+  uint8_t           Buffer[FAT_BYTES_PER_SECTOR];
+  uint8_t*          pCluster;              /* A buffer for one directory cluster. */
+  TFatDumpJob*      pHead;                 /* The queue of directories to list. */
+  TFatDumpJob*      pTail;
+  TFatDumpJob*      pChildren;             /* The subdirectories found in the directory being listed. */
+  TFatDumpJob**     ppLastChild;
+  uint32_t          ChildCount;
+  char*             pOutput;               /* The listing of the directory being listed. */
+  size_t            OutputLength;
+  size_t            OutputSize;
+  unsigned long     Directories;
+  unsigned long     Files;
+  unsigned long     Clusters;
+  unsigned long     Errors;
+#ifdef FAT_DUMP_THREADS
+  pthread_t         Thread;
+  pthread_mutex_t   Mutex;                 /* Protects pHead and pTail. */
+#endif
+} TFatDumpWorker;
+
+static TFatDumpWorker* FAT_Workers;
+static uint32_t FAT_WorkerCount;
+static uint32_t FAT_PendingJobs;           /* Queued or running jobs. The walk is done when this drops to zero. */
+#ifdef FAT_DUMP_THREADS
+static uint32_t FAT_Pushes;                /* Incremented whenever jobs are queued. */
+static uint32_t FAT_IdleWorkers;
+static pthread_mutex_t FAT_PoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t FAT_PoolCondition = PTHREAD_COND_INITIALIZER;
+#endif
+
+static TFatPartition FAT_Partition;
+static uint8_t FAT_Buffer[FAT_BYTES_PER_SECTOR];
+
+#ifdef FAT_CACHE_SECTORS
+static TFatCache FAT_Cache;
+static uint8_t FAT_CacheData[FAT_CACHE_SECTORS * FAT_BYTES_PER_SECTOR];
+#endif
+
+#ifdef FAT_ENABLE_FAT_TABLE
+/* Sized to hold the whole FAT once the partition is open. */
+static TFatTable FAT_Table;
+#endif
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+static TFatNameIndex FAT_NameIndex;
+static TFatNameEntry FAT_NameIndexData[FAT_DIR_INDEX_DIRECTORIES * FAT_DIR_INDEX_ENTRIES];
+#endif
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+static TFatPathCache FAT_PathCache;
+#endif
+
+#ifdef FAT_DIR_HINT_ENTRIES
+static TFatDirHints FAT_DirHints;
+#endif
+
+static void FAT_DumpAppend(TFatDumpWorker* pWorker, const char* pText)
+{
+  const size_t Length = strlen(pText);
+
+  if (pWorker->OutputLength + Length > pWorker->OutputSize)
+  {
+    pWorker->OutputSize = 2 * (pWorker->OutputLength + Length);
+    pWorker->pOutput = (char*)realloc(pWorker->pOutput, pWorker->OutputSize);
+    assert(pWorker->pOutput != NULL);
+  }
+  memcpy(pWorker->pOutput + pWorker->OutputLength, pText, Length);
+  pWorker->OutputLength += Length;
+}
+
+/* Converts the 8.3 name of a directory entry to "NAME.EXT". */
+static void FAT_FormatName(const TFatDirEntry* pDirEntry, char* pName)
+{
+  uint8_t I;
+  uint8_t Length = 0;
+
+  for (I = 0; (I < 8) && (pDirEntry->Name[I] != ' '); I++)
+  {
+    pName[Length++] = (char)pDirEntry->Name[I];
+  }
+  /* 0x05 stands for a name that starts with 0xE5. */
+  if ((Length != 0) && ((uint8_t)pName[0] == 0x05))
+  {
+    pName[0] = (char)0xE5;
+  }
+  if (pDirEntry->Name[8] != ' ')
+  {
+    pName[Length++] = '.';
+    for (I = 8; (I < 11) && (pDirEntry->Name[I] != ' '); I++)
+    {
+      pName[Length++] = (char)pDirEntry->Name[I];
+    }
+  }
+  pName[Length] = '\0';
+}
+
+#define FAT_IsValidCluster(pPartition, Cluster) (((Cluster) >= 2) && ((Cluster) <= (pPartition)->ClusterCount + 1))
+
+/* Returns the number of clusters in a chain. *pBroken is set to 1 if the
+ * chain leads to a free or invalid cluster or is longer than the volume.
+ */
+static TFatClusterNr FAT_GetChainLength(TFatPartition* pPartition, TFatClusterNr Cluster, uint8_t* pBroken)
+{
+  TFatClusterNr Length = 0;
+
+  *pBroken = 0;
+  if (Cluster == 0) return 0;
+
+  while (!FAT_IsEndOfChain(pPartition, Cluster))
+  {
+    if (!FAT_IsValidCluster(pPartition, Cluster) || (Length > pPartition->ClusterCount))
+    {
+      *pBroken = 1;
+      break;
+    }
+    Length++;
+    Cluster = FAT_GetNextCluster(pPartition, Cluster);
+  }
+  return Length;
+}
+
+/* Creates a job for the directory pPath, or pPath/pName if pName is not NULL. */
+static TFatDumpJob* FAT_CreateJob(const char* pPath, size_t Length, const char* pName, TFatClusterNr Cluster, uint8_t Depth)
+{
+  const size_t NameLength = (pName != NULL) ? 1 + strlen(pName) : 0;
+  TFatDumpJob* const pJob = (TFatDumpJob*)malloc(sizeof(TFatDumpJob) + Length + NameLength + 1);
+
+  assert(pJob != NULL);
+  pJob->pNext = NULL;
+  pJob->pPrev = NULL;
+  pJob->Cluster = Cluster;
+  pJob->Depth = Depth;
+  pJob->pPath = (char*)(pJob + 1);
+  memcpy(pJob->pPath, pPath, Length);
+  pJob->pPath[Length] = '\0';
+  if (pName != NULL)
+  {
+    pJob->pPath[Length] = '/';
+    strcpy(pJob->pPath + Length + 1, pName);
+  }
+  return pJob;
+}
+
+/* Lists the entries of one sector or cluster of a directory. Returns 0 if
+ * the end of the directory has been reached.
+ */
+static uint8_t FAT_DumpEntries(TFatDumpWorker* pWorker, const TFatDumpJob* pJob, const uint8_t* pEntries, uint32_t Count)
+{
+  TFatPartition* const pPartition = &pWorker->Partition;
+  const uint32_t ClusterSize = (uint32_t)pPartition->SectorsPerCluster * FAT_BYTES_PER_SECTOR;
+  uint32_t I;
+
+  for (I = 0; I < Count; I++)
+  {
+    const TFatDirEntry* const pDirEntry = (const TFatDirEntry*)(pEntries + I * FAT_DIRECTORY_ENTRY_SIZE);
+    const TFatClusterNr StartCluster = FAT_GetStartCluster(pDirEntry);
+    TFatClusterNr Length;
+    uint8_t Broken;
+    char Name[13];
+    char Line[64];
+
+    if (pDirEntry->Name[0] == 0x00) return 0;
+    if (FAT_IsDirEntryDeleted(pDirEntry) || FAT_IsLongFileName(pDirEntry) ||
+        FAT_IsVolumeID(pDirEntry) || (pDirEntry->Name[0] == '.'))
+    {
+      continue;
+    }
+
+    FAT_FormatName(pDirEntry, Name);
+    Length = FAT_GetChainLength(pPartition, StartCluster, &Broken);
+    pWorker->Clusters += Length;
+
+    if (FAT_IsDirectory(pDirEntry))
+    {
+      pWorker->Directories++;
+      sprintf(Line, "%10s %10lu %8lu ", "<DIR>", (unsigned long)StartCluster, (unsigned long)Length);
+
+      if (!Broken && FAT_IsValidCluster(pPartition, StartCluster) && (pJob->Depth < FAT_DUMP_MAX_DEPTH))
+      {
+        TFatDumpJob* const pChild = FAT_CreateJob(pJob->pPath, strlen(pJob->pPath), Name, StartCluster, (uint8_t)(pJob->Depth + 1));
+
+        *pWorker->ppLastChild = pChild;
+        pWorker->ppLastChild = &pChild->pNext;
+        pWorker->ChildCount++;
+      }
+      else
+      {
+        Broken = 1;
+      }
+    }
+    else
+    {
+      pWorker->Files++;
+      sprintf(Line, "%10lu %10lu %8lu ", (unsigned long)pDirEntry->FileSize, (unsigned long)StartCluster, (unsigned long)Length);
+
+      /* The chain must be just long enough for the file size. */
+      if ((uint32_t)Length != (pDirEntry->FileSize + ClusterSize - 1) / ClusterSize)
+      {
+        Broken = 1;
+      }
+    }
+    if (Broken)
+    {
+      pWorker->Errors++;
+      Line[strlen(Line) - 1] = '!';
+    }
+    FAT_DumpAppend(pWorker, Line);
+    FAT_DumpAppend(pWorker, pJob->pPath);
+    FAT_DumpAppend(pWorker, "/");
+    FAT_DumpAppend(pWorker, Name);
+    FAT_DumpAppend(pWorker, "\n");
+  }
+  return 1;
+}
+
+/* Lists a directory a cluster at a time, collecting its subdirectories. */
+static void FAT_DumpDirectory(TFatDumpWorker* pWorker, const TFatDumpJob* pJob)
+{
+  TFatPartition* const pPartition = &pWorker->Partition;
+  const uint32_t EntriesPerCluster = (uint32_t)pPartition->SectorsPerCluster * FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR;
+
+  if (pJob->Cluster == 0)
+  {
+    /* The FAT16 root directory is a fixed area before the data clusters. */
+    uint32_t Sector = FAT_GetRootOffset(pPartition);
+    uint32_t Left = pPartition->RootDirectoryEntries / FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR;
+
+    while (Left != 0)
+    {
+      const uint16_t Count = (uint16_t)((Left < pPartition->SectorsPerCluster) ? Left : pPartition->SectorsPerCluster);
+
+      FAT_LoadSectors(pPartition, Sector, Count, pWorker->pCluster);
+      if (!FAT_DumpEntries(pWorker, pJob, pWorker->pCluster, (uint32_t)Count * FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR)) break;
+      Sector += Count;
+      Left -= Count;
+    }
+  }
+  else
+  {
+    TFatLocation Location;
+    TFatClusterNr Clusters = 0;
+
+    FAT_Seek(pPartition, &Location, pJob->Cluster);
+    FAT_ReadCluster(pPartition, &Location, pWorker->pCluster);
+    while (FAT_DumpEntries(pWorker, pJob, pWorker->pCluster, EntriesPerCluster) &&
+           (++Clusters <= pPartition->ClusterCount) &&
+           FAT_ReadNextCluster(pPartition, &Location, pWorker->pCluster))
+    {
+    }
+  }
+}
+
+/* Takes the next job from the worker's own queue, or steals one. */
+static TFatDumpJob* FAT_TakeJob(TFatDumpWorker* pWorker)
+{
+  TFatDumpJob* pJob;
+  uint32_t I;
+
+  FAT_DumpLock(&pWorker->Mutex);
+  pJob = pWorker->pHead;
+  if (pJob != NULL)
+  {
+    pWorker->pHead = pJob->pNext;
+    if (pWorker->pHead == NULL)
+    {
+      pWorker->pTail = NULL;
+    }
+    else
+    {
+      pWorker->pHead->pPrev = NULL;
+    }
+  }
+  FAT_DumpUnlock(&pWorker->Mutex);
+  if (pJob != NULL) return pJob;
+
+  for (I = 1; I < FAT_WorkerCount; I++)
+  {
+    TFatDumpWorker* const pVictim = &FAT_Workers[(pWorker - FAT_Workers + I) % FAT_WorkerCount];
+
+    FAT_DumpLock(&pVictim->Mutex);
+    pJob = pVictim->pTail;
+    if (pJob != NULL)
+    {
+      pVictim->pTail = pJob->pPrev;
+      if (pVictim->pTail == NULL)
+      {
+        pVictim->pHead = NULL;
+      }
+      else
+      {
+        pVictim->pTail->pNext = NULL;
+      }
+    }
+    FAT_DumpUnlock(&pVictim->Mutex);
+    if (pJob != NULL) return pJob;
+  }
+  return NULL;
+}
+
+/* Puts the subdirectories found by FAT_DumpDirectory at the head of the
+ * worker's queue, in the order they were found.
+ */
+static void FAT_QueueChildren(TFatDumpWorker* pWorker)
+{
+  TFatDumpJob* pJob;
+  TFatDumpJob* pLast = NULL;
+
+  if (pWorker->ChildCount == 0) return;
+
+  for (pJob = pWorker->pChildren; pJob != NULL; pJob = pJob->pNext)
+  {
+    pJob->pPrev = pLast;
+    pLast = pJob;
+  }
+
+  FAT_DumpLock(&pWorker->Mutex);
+  pLast->pNext = pWorker->pHead;
+  if (pWorker->pHead == NULL)
+  {
+    pWorker->pTail = pLast;
+  }
+  else
+  {
+    pWorker->pHead->pPrev = pLast;
+  }
+  pWorker->pHead = pWorker->pChildren;
+  FAT_DumpUnlock(&pWorker->Mutex);
+
+  FAT_DumpLock(&FAT_PoolMutex);
+  FAT_PendingJobs += pWorker->ChildCount;
+#ifdef FAT_DUMP_THREADS
+  FAT_Pushes++;
+  if (FAT_IdleWorkers != 0)
+  {
+    pthread_cond_broadcast(&FAT_PoolCondition);
+  }
+#endif
+  FAT_DumpUnlock(&FAT_PoolMutex);
+}
+
+static void* FAT_RunWorker(void* pContext)
+{
+  TFatDumpWorker* const pWorker = (TFatDumpWorker*)pContext;
+
+  for (;;)
+  {
+    TFatDumpJob* pJob;
+    uint8_t Done;
+#ifdef FAT_DUMP_THREADS
+    uint32_t Pushes;
+
+    /* Read before looking for work, so that jobs queued while looking
+     * are not missed.
+     */
+    FAT_DumpLock(&FAT_PoolMutex);
+    Pushes = FAT_Pushes;
+    FAT_DumpUnlock(&FAT_PoolMutex);
+#endif
+
+    pJob = FAT_TakeJob(pWorker);
+    if (pJob != NULL)
+    {
+      pWorker->pChildren = NULL;
+      pWorker->ppLastChild = &pWorker->pChildren;
+      pWorker->ChildCount = 0;
+      pWorker->OutputLength = 0;
+
+      FAT_DumpDirectory(pWorker, pJob);
+      free(pJob);
+
+      /* The listing of a directory is written in one piece. */
+      fwrite(pWorker->pOutput, 1, pWorker->OutputLength, stdout);
+
+      /* The children are counted before the parent is finished, so the
+       * number of pending jobs can not drop to zero too early.
+       */
+      FAT_QueueChildren(pWorker);
+      FAT_DumpLock(&FAT_PoolMutex);
+      FAT_PendingJobs--;
+#ifdef FAT_DUMP_THREADS
+      if (FAT_PendingJobs == 0)
+      {
+        pthread_cond_broadcast(&FAT_PoolCondition);
+      }
+#endif
+      FAT_DumpUnlock(&FAT_PoolMutex);
+      continue;
+    }
+
+    FAT_DumpLock(&FAT_PoolMutex);
+#ifdef FAT_DUMP_THREADS
+    FAT_IdleWorkers++;
+    while ((FAT_PendingJobs != 0) && (FAT_Pushes == Pushes))
+    {
+      pthread_cond_wait(&FAT_PoolCondition, &FAT_PoolMutex);
+    }
+    FAT_IdleWorkers--;
+#endif
+    Done = (uint8_t)(FAT_PendingJobs == 0);
+    FAT_DumpUnlock(&FAT_PoolMutex);
+    if (Done) break;
+  }
+  return NULL;
+}
+
+/* Lists the directory tree starting at pRoot with WorkerCount threads. */
+static void FAT_WalkTree(TFatPartition* pPartition, TFatDumpJob* pRoot, uint32_t WorkerCount)
+{
+  uint32_t I;
+
+  FAT_Workers = (TFatDumpWorker*)calloc(WorkerCount, sizeof(TFatDumpWorker));
+  assert(FAT_Workers != NULL);
+  FAT_WorkerCount = WorkerCount;
+  FAT_PendingJobs = 1;
+
+  for (I = 0; I < WorkerCount; I++)
+  {
+    TFatDumpWorker* const pWorker = &FAT_Workers[I];
+
+#ifdef FAT_DUMP_THREADS
+    FAT_ClonePartition(pPartition, &pWorker->Partition, pWorker->Buffer);
+    pthread_mutex_init(&pWorker->Mutex, NULL);
+#else
+    pWorker->Partition = *pPartition;
+    pWorker->Partition.pBuffer = pWorker->Buffer;
+#endif
+    pWorker->pCluster = (uint8_t*)malloc((size_t)pPartition->SectorsPerCluster * FAT_BYTES_PER_SECTOR);
+    assert(pWorker->pCluster != NULL);
+  }
+  FAT_Workers[0].pHead = pRoot;
+  FAT_Workers[0].pTail = pRoot;
+
+  printf("%10s %10s %8s  %s\n", "Size", "Cluster", "Chain", "Path");
+  fflush(stdout);
+#ifdef FAT_DUMP_THREADS
+  for (I = 1; I < WorkerCount; I++)
+  {
+    pthread_create(&FAT_Workers[I].Thread, NULL, FAT_RunWorker, &FAT_Workers[I]);
+  }
+#endif
+  FAT_RunWorker(&FAT_Workers[0]);
+#ifdef FAT_DUMP_THREADS
+  for (I = 1; I < WorkerCount; I++)
+  {
+    pthread_join(FAT_Workers[I].Thread, NULL);
+  }
+#endif
+
+  for (I = 1; I < WorkerCount; I++)
+  {
+    FAT_Workers[0].Directories += FAT_Workers[I].Directories;
+    FAT_Workers[0].Files += FAT_Workers[I].Files;
+    FAT_Workers[0].Clusters += FAT_Workers[I].Clusters;
+    FAT_Workers[0].Errors += FAT_Workers[I].Errors;
+  }
+  printf("%lu directories, %lu files, %lu clusters, %lu chain errors\n",
+         FAT_Workers[0].Directories, FAT_Workers[0].Files, FAT_Workers[0].Clusters, FAT_Workers[0].Errors);
+
+  for (I = 0; I < WorkerCount; I++)
+  {
+#ifdef FAT_DUMP_THREADS
+    pthread_mutex_destroy(&FAT_Workers[I].Mutex);
+#endif
+    free(FAT_Workers[I].pCluster);
+    free(FAT_Workers[I].pOutput);
+  }
+  free(FAT_Workers);
+}
+
+/* Returns the number of threads to use when it is not specified. */
+static uint32_t FAT_GetDefaultWorkers(void)
+{
+#ifdef FAT_DUMP_THREADS
+  const long Processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (Processors > FAT_DUMP_MAX_WORKERS) return FAT_DUMP_MAX_WORKERS;
+  if (Processors > 1) return (uint32_t)Processors;
+#endif
+  return 1;
+}
+
+int main (int argc, char *argv[])
+{
+  TFatPartition* const pPartition = &FAT_Partition;
+  uint32_t WorkerCount = FAT_GetDefaultWorkers();
+  const char* const pProgram = argv[0];
+  const char* pImage;
+  const char* pPath = NULL;
+#ifdef FAT_DUMP_THREADS
+  TFatLock Lock;
+#endif
+#ifdef __unix__
+  TFatMappedDevice Device;
+#else
+  TFatFileDevice Device;
+#endif
+
+  if ((argc >= 3) && (strcmp(argv[1], "-j") == 0))
+  {
+    WorkerCount = (uint32_t)atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if (((argc != 2) && (argc != 3)) || (WorkerCount == 0) || (WorkerCount > FAT_DUMP_MAX_WORKERS))
+  {
+    printf("Usage: %s [-j threads] <disk_image> [path]\n", pProgram);
+    return EXIT_FAILURE;
+  }
+#ifndef FAT_DUMP_THREADS
+  if (WorkerCount > 1)
+  {
+    printf("Built without FAT_ENABLE_THREADS, using one thread\n");
+    WorkerCount = 1;
+  }
+#endif
+  pImage = argv[1];
+  if (argc == 3)
+  {
+    pPath = argv[2];
+  }
+
+#ifdef __unix__
+  /* The image is only read, so the metadata is accessed in place. */
+  if (!FAT_OpenMappedDevice(&Device, pImage, 0))
+#else
+  if (!FAT_OpenFileDevice(&Device, pImage, 0))
+#endif
+  {
+    printf("FATAL: Could not open %s\n", pImage);
+    return EXIT_FAILURE;
+  }
+
+#ifdef __unix__
+  pPartition->pDevice = &Device.Memory.Device;
+#else
+  pPartition->pDevice = &Device.Device;
+#endif
+  pPartition->pBuffer = FAT_Buffer;
+#ifdef FAT_CACHE_SECTORS
+  FAT_Cache.pData = FAT_CacheData;
+  pPartition->pCache = &FAT_Cache;
+#endif
+#ifdef FAT_DIR_INDEX_ENTRIES
+  FAT_NameIndex.pData = FAT_NameIndexData;
+  pPartition->pNameIndex = &FAT_NameIndex;
+#endif
+#ifdef FAT_PATH_CACHE_ENTRIES
+  pPartition->pPathCache = &FAT_PathCache;
+#endif
+#ifdef FAT_DIR_HINT_ENTRIES
+  pPartition->pDirHints = &FAT_DirHints;
+#endif
+#ifdef FAT_DUMP_THREADS
+  if (WorkerCount > 1)
+  {
+    if (!FAT_OpenHostLock(&Lock))
+    {
+      printf("FATAL: Could not create the locks\n");
+      return EXIT_FAILURE;
+    }
+    pPartition->pLock = &Lock;
+  }
+#endif
+
+  if (FAT_OpenPartition(pPartition, 0))
+  {
+    TFatDumpJob* pRoot = NULL;
+
+#ifdef FAT_ENABLE_FAT_TABLE
+    /* With the whole FAT in memory, the workers follow the cluster chains
+     * without disk access. The table is shared by them.
+     */
+    FAT_Table.SectorCount = pPartition->SectorsPerFAT;
+    FAT_Table.pData = (uint8_t*)malloc((size_t)FAT_Table.SectorCount * FAT_BYTES_PER_SECTOR);
+    FAT_Table.pDirty = (uint8_t*)malloc(FAT_TABLE_DIRTY_SIZE(FAT_Table.SectorCount));
+    if ((FAT_Table.pData != NULL) && (FAT_Table.pDirty != NULL))
+    {
+      pPartition->pTable = &FAT_Table;
+      FAT_OpenPartition(pPartition, 0);
+    }
+#endif
+
+    if (pPartition->FreeClusters == FAT_UNKNOWN_FREE_CLUSTERS)
+    {
+      FAT_CountFreeClusters(pPartition);
+    }
+    printf("Free clusters: %lu of %lu\n", (unsigned long)pPartition->FreeClusters, (unsigned long)pPartition->ClusterCount);
+
+    if (pPath != NULL)
+    {
+      TFatDirectoryLocation DirLocation;
+      const TFatDirEntry* pDirEntry = FAT_OpenPath(pPartition, pPath, &DirLocation);
+
+      if (pDirEntry == NULL)
+      {
+        printf("%s was not found\n", pPath);
+      }
+      else if (!FAT_IsDirectory(pDirEntry))
+      {
+        printf("%s: %.11s, %lu bytes, starts at cluster %lu\n", pPath, pDirEntry->Name,
+               (unsigned long)pDirEntry->FileSize, (unsigned long)FAT_GetStartCluster(pDirEntry));
+      }
+      else
+      {
+        size_t Length = strlen(pPath);
+
+        while ((Length != 0) && ((pPath[Length - 1] == '/') || (pPath[Length - 1] == '\\'))) Length--;
+        pRoot = FAT_CreateJob(pPath, Length, NULL, FAT_GetStartCluster(pDirEntry), 0);
+      }
+    }
+    else
+    {
+      TFatClusterNr RootCluster = 0;
+
+#ifdef FAT_ENABLE_FAT32
+      if (FAT_IsFAT32(pPartition))
+      {
+        FAT_LoadSector(pPartition, pPartition->PartitionLBA);
+        RootCluster = FAT32_GetRootDirectoryCluster(pPartition->pBuffer);
+      }
+#endif
+      pRoot = FAT_CreateJob("", 0, NULL, RootCluster, 0);
+    }
+
+    if (pRoot != NULL)
+    {
+      FAT_WalkTree(pPartition, pRoot, WorkerCount);
+    }
+  }
+  else
+  {
+    printf("FATAL: The disk is either corrupt, or has an invalid partition type.\n");
+  }
+
+#ifdef FAT_CACHE_SECTORS
+  printf("Sector cache: %lu hits, %lu misses, %lu evictions\n",
+         (unsigned long)FAT_Cache.Hits, (unsigned long)FAT_Cache.Misses, (unsigned long)FAT_Cache.Evictions);
+#endif
+#ifdef FAT_ENABLE_FAT_TABLE
+  printf("FAT table: %lu loads\n", (unsigned long)FAT_Table.Loads);
+  free(FAT_Table.pData);
+  free(FAT_Table.pDirty);
+#endif
+
+#ifdef FAT_DUMP_THREADS
+  if (pPartition->pLock != NULL)
+  {
+    FAT_CloseHostLock(&Lock);
+  }
+#endif
+#ifdef __unix__
+  FAT_CloseMappedDevice(&Device);
+#else
+  FAT_CloseFileDevice(&Device);
+#endif
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "../include/fat.h"
+#include <stddef.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_ENABLE_EXTENTS
+
+/* Returns 1 if ClusterNr can be followed, i.e. it is neither an end of 
+ * chain marker nor a free or reserved entry, which would indicate a 
+ * damaged chain.
+ */
+#define FAT_IsChainCluster(pPartition, ClusterNr) (((ClusterNr) >= 2) && !FAT_IsEndOfChain(pPartition, ClusterNr))
+
+FAT_API uint8_t FAT_BuildExtentMap(TFatPartition* pPartition, TFatClusterNr StartCluster, TFatExtentMap* pMap)
+{
+  TFatExtent* pExtent = NULL;
+  TFatClusterNr Cluster = StartCluster;
+
+  pMap->Count = 0;
+  pMap->ClusterCount = 0;
+  pMap->Complete = 1;
+
+  while (FAT_IsChainCluster(pPartition, Cluster))
+  {
+    if ((pExtent != NULL) && (Cluster == pExtent->StartCluster + pExtent->Length))
+    {
+      /* The chain continues with the next cluster on the disk. */
+      pExtent->Length++;
+    }
+    else
+    {
+      if (pMap->Count == pMap->Capacity)
+      {
+        D_(printf("Extent map full after %d clusters\n", pMap->ClusterCount));
+        pMap->Complete = 0;
+        return 0;
+      }
+      pExtent = &pMap->pExtents[pMap->Count++];
+      pExtent->StartCluster = Cluster;
+      pExtent->Length = 1;
+      pExtent->FileCluster = pMap->ClusterCount;
+    }
+    pMap->ClusterCount++;
+    Cluster = FAT_GetNextCluster(pPartition, Cluster);
+  }
+
+  D_(printf("Extent map: %d clusters in %d extents\n", pMap->ClusterCount, pMap->Count));
+  return 1;
+}
+
+FAT_API uint8_t FAT_SeekFileOffset(TFatPartition* pPartition, const TFatExtentMap* pMap, uint32_t Offset, TFatLocation* pLocation)
+{
+  const uint32_t SectorNr = Offset / FAT_BYTES_PER_SECTOR;
+  const TFatClusterNr FileCluster = (TFatClusterNr)(SectorNr / pPartition->SectorsPerCluster);
+  const uint8_t SectorInCluster = (uint8_t)(SectorNr % pPartition->SectorsPerCluster);
+  TFatClusterNr Cluster;
+
+  if (pMap->Count == 0)
+  {
+    return 0;
+  }
+
+  if (FileCluster < pMap->ClusterCount)
+  {
+    /* Find the last extent that starts at or before FileCluster. */
+    uint16_t Low = 0;
+    uint16_t High = pMap->Count - 1;
+
+    while (Low < High)
+    {
+      const uint16_t Middle = (uint16_t)((Low + High + 1) / 2);
+
+      if (pMap->pExtents[Middle].FileCluster <= FileCluster)
+      {
+        Low = Middle;
+      }
+      else
+      {
+        High = Middle - 1;
+      }
+    }
+    Cluster = pMap->pExtents[Low].StartCluster + (FileCluster - pMap->pExtents[Low].FileCluster);
+  }
+  else if (pMap->Complete)
+  {
+    return 0;
+  }
+  else
+  {
+    /* The offset is beyond the mapped part, so follow the chain from 
+     * the last mapped cluster. 
+     */
+    const TFatExtent* pLast = &pMap->pExtents[pMap->Count - 1];
+    TFatClusterNr Steps = FileCluster - (pMap->ClusterCount - 1);
+
+    Cluster = pLast->StartCluster + pLast->Length - 1;
+    for (; Steps != 0; Steps--)
+    {
+      Cluster = FAT_GetNextCluster(pPartition, Cluster);
+      if (!FAT_IsChainCluster(pPartition, Cluster))
+      {
+        return 0;
+      }
+    }
+  }
+
+  FAT_Seek(pPartition, pLocation, Cluster);
+  pLocation->Sector += SectorInCluster;
+  pLocation->SectorsLeftInCluster -= SectorInCluster;
+  return 1;
+}
+#endif
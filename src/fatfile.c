@@ -0,0 +1,722 @@
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#define FAT_GetClusterSize(pPartition) ((uint32_t)(pPartition)->SectorsPerCluster * FAT_BYTES_PER_SECTOR)
+
+/* Points pFile->Location at the sector holding pFile->Position. If End is
+ * not zero (0), clusters are allocated when the chain ends before it, as
+ * many as are needed to hold End bytes. The last run of clusters allocated
+ * is followed without reading the FAT. Returns 0 if the chain ends, or if
+ * the disk is full. The cached position is only changed on success.
+ */
+static uint8_t FAT_LocateFilePosition(TFatFile* pFile, uint32_t End)
+{
+  TFatPartition* const pPartition = pFile->pPartition;
+  const uint32_t ClusterSize = FAT_GetClusterSize(pPartition);
+  const TFatClusterNr TargetIndex = (TFatClusterNr)(pFile->Position / ClusterSize);
+  const uint8_t SectorInCluster = (uint8_t)((pFile->Position % ClusterSize) / FAT_BYTES_PER_SECTOR);
+  TFatClusterNr Cluster = pFile->Location.Cluster;
+  TFatClusterNr Index = pFile->ClusterIndex;
+#ifdef FAT_ENABLE_WRITE
+  TFatClusterNr Count;
+#endif
+
+  if ((Cluster == 0) || (TargetIndex < Index))
+  {
+    /* Start over from the first cluster. */
+    Cluster = pFile->StartCluster;
+    Index = 0;
+
+    if (Cluster == 0)
+    {
+#ifdef FAT_ENABLE_WRITE
+      if (End == 0) return 0;
+
+      Count = FAT_AllocateClusters(pPartition, 0, (TFatClusterNr)((End - 1) / ClusterSize + 1), &Cluster);
+      if (Count == 0) return 0;
+
+      D_(printf("Allocated first cluster %d\n", Cluster));
+      pFile->RunStart = Cluster;
+      pFile->RunEnd = (TFatClusterNr)(Cluster + Count - 1);
+      pFile->StartCluster = Cluster;
+      pFile->Flags |= FAT_FILE_MODIFIED;
+#else
+      return 0;
+#endif
+    }
+  }
+
+  while (Index < TargetIndex)
+  {
+    TFatClusterNr NextCluster;
+
+    if ((Cluster >= pFile->RunStart) && (Cluster < pFile->RunEnd))
+    {
+      /* Allocated by this handle, so the FAT does not need to be read. */
+      NextCluster = (TFatClusterNr)(Cluster + 1);
+    }
+    else
+    {
+      NextCluster = FAT_GetNextCluster(pPartition, Cluster);
+    }
+
+    if (FAT_IsEndOfChain(pPartition, NextCluster) || (NextCluster < 2))
+    {
+#ifdef FAT_ENABLE_WRITE
+      if (End == 0) return 0;
+
+      Count = FAT_AllocateClusters(pPartition, Cluster, (TFatClusterNr)((End - 1) / ClusterSize - Index), &NextCluster);
+      if (Count == 0) return 0;
+
+      pFile->RunStart = NextCluster;
+      pFile->RunEnd = (TFatClusterNr)(NextCluster + Count - 1);
+#else
+      return 0;
+#endif
+    }
+    Cluster = NextCluster;
+    Index++;
+  }
+
+  FAT_Seek(pPartition, &pFile->Location, Cluster);
+  pFile->Location.Sector += SectorInCluster;
+  pFile->Location.SectorsLeftInCluster -= SectorInCluster;
+  pFile->ClusterIndex = Index;
+  return 1;
+}
+
+#ifdef FAT_ENABLE_WRITE
+/* Creates an empty file. On success, the new directory entry is held by
+ * pPartition->pBuffer.
+ */
+static TFatDirEntry* FAT_CreateFile(TFatPartition* pPartition, const char* pPath, TFatDirectoryLocation* pDirLocation)
+{
+  TFatClusterNr DirectoryCluster;
+  char Name[sizeof(((TFatDirEntry*)0)->Name) + 1];
+  TFatDirEntry* pDirEntry;
+
+  if (!FAT_OpenParentPath(pPartition, pPath, &DirectoryCluster, Name)) return NULL;
+  Name[sizeof(Name) - 1] = '\0';
+
+  if (DirectoryCluster == 0)
+  {
+    pDirEntry = FAT_CreateRootDirEntry(pPartition, pDirLocation);
+  }
+  else
+  {
+    pDirEntry = FAT_CreateDirEntry(pPartition, DirectoryCluster, pDirLocation);
+  }
+  if (pDirEntry == NULL) return NULL;
+
+  D_(printf("Creating file %s\n", pPath));
+  FAT_InitDirEntry(pPartition, pDirLocation, Name);
+  return pDirEntry;
+}
+#endif
+
+/* FAT_FileOpen, without locking. */
+static uint8_t FAT_OpenFile(TFatPartition* pPartition, const char* pPath, uint8_t Mode, TFatFile* pFile)
+{
+  TFatDirEntry* pDirEntry = FAT_OpenPath(pPartition, pPath, &pFile->DirLocation);
+
+#ifdef FAT_ENABLE_WRITE
+  if ((pDirEntry == NULL) && (Mode & FAT_FILE_CREATE) && (Mode & FAT_FILE_WRITE))
+  {
+    pDirEntry = FAT_CreateFile(pPartition, pPath, &pFile->DirLocation);
+  }
+  if ((pDirEntry != NULL) && (Mode & FAT_FILE_WRITE) && FAT_IsReadOnly(pDirEntry)) return 0;
+#else
+  if (Mode & FAT_FILE_WRITE) return 0;
+#endif
+  if ((pDirEntry == NULL) || !FAT_IsFile(pDirEntry)) return 0;
+
+  pFile->pPartition = pPartition;
+  pFile->StartCluster = FAT_GetStartCluster(pDirEntry);
+  pFile->Size = pDirEntry->FileSize;
+  pFile->Position = 0;
+  pFile->Location.Cluster = 0;
+  pFile->ClusterIndex = 0;
+  pFile->RunStart = 0;
+  pFile->RunEnd = 0;
+  pFile->Flags = (uint8_t)(Mode & FAT_FILE_WRITE);
+  return 1;
+}
+
+FAT_API uint8_t FAT_FileOpen(TFatPartition* pPartition, const char* pPath, uint8_t Mode, TFatFile* pFile)
+{
+#ifdef FAT_ENABLE_THREADS
+  const uint8_t LockType = (Mode & FAT_FILE_CREATE) ? FAT_LOCK_WRITE : FAT_LOCK_READ;
+  uint8_t Result;
+
+  FAT_Lock(pPartition, LockType);
+  Result = FAT_OpenFile(pPartition, pPath, Mode, pFile);
+  FAT_Unlock(pPartition, LockType);
+  return Result;
+#else
+  return FAT_OpenFile(pPartition, pPath, Mode, pFile);
+#endif
+}
+
+FAT_API uint32_t FAT_FileRead(TFatFile* pFile, void* pDest, uint32_t Count)
+{
+  TFatPartition* const pPartition = pFile->pPartition;
+  uint8_t* const pBytes = (uint8_t*)pDest;
+  uint32_t Done = 0;
+
+  if (Count > pFile->Size - pFile->Position)
+  {
+    Count = pFile->Size - pFile->Position;
+  }
+
+  FAT_Lock(pPartition, FAT_LOCK_READ);
+  while (Done < Count)
+  {
+    const uint16_t Offset = (uint16_t)(pFile->Position % FAT_BYTES_PER_SECTOR);
+    uint32_t Chunk;
+
+    if (!FAT_LocateFilePosition(pFile, 0)) break;
+
+    if ((Offset == 0) && (Count - Done >= FAT_BYTES_PER_SECTOR))
+    {
+      /* Whole sectors are read straight into the caller's buffer. */
+      uint16_t Sectors = (uint16_t)pFile->Location.SectorsLeftInCluster + 1;
+
+      if (Sectors > (Count - Done) / FAT_BYTES_PER_SECTOR)
+      {
+        Sectors = (uint16_t)((Count - Done) / FAT_BYTES_PER_SECTOR);
+      }
+      FAT_LoadSectors(pPartition, pFile->Location.Sector, Sectors, pBytes + Done);
+      Chunk = (uint32_t)Sectors * FAT_BYTES_PER_SECTOR;
+    }
+    else
+    {
+      Chunk = FAT_BYTES_PER_SECTOR - Offset;
+      if (Chunk > Count - Done)
+      {
+        Chunk = Count - Done;
+      }
+      FAT_LoadSector(pPartition, pFile->Location.Sector);
+      memcpy((void*)(pBytes + Done), (const void*)(pPartition->pBuffer + Offset), Chunk);
+    }
+    Done += Chunk;
+    pFile->Position += Chunk;
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_READ);
+  return Done;
+}
+
+/* Sorts the requests by offset and limits them to the file size. */
+static void FAT_SortFileRequests(const TFatFile* pFile, TFatFileRequest* pRequests, uint16_t Count)
+{
+  uint16_t I;
+
+  for (I = 0; I < Count; I++)
+  {
+    TFatFileRequest Request = pRequests[I];
+    uint16_t J = I;
+
+    if (Request.Offset >= pFile->Size)
+    {
+      Request.Length = 0;
+    }
+    else if (Request.Length > pFile->Size - Request.Offset)
+    {
+      Request.Length = pFile->Size - Request.Offset;
+    }
+
+    while ((J > 0) && (pRequests[J - 1].Offset > Request.Offset))
+    {
+      pRequests[J] = pRequests[J - 1];
+      J--;
+    }
+    pRequests[J] = Request;
+  }
+}
+
+FAT_API uint32_t FAT_FileReadV(TFatFile* pFile, TFatFileRequest* pRequests, uint16_t Count, uint8_t* pScratch, uint16_t ScratchSectors)
+{
+  TFatPartition* const pPartition = pFile->pPartition;
+  const TFatLocation Location = pFile->Location;
+  const TFatClusterNr ClusterIndex = pFile->ClusterIndex;
+  const uint32_t Position = pFile->Position;
+  uint32_t Done = 0;
+  uint32_t RunEnd = 0;
+  uint16_t First = 0;
+
+  if (ScratchSectors == 0)
+  {
+    pScratch = NULL;
+  }
+  FAT_SortFileRequests(pFile, pRequests, Count);
+
+  FAT_Lock(pPartition, FAT_LOCK_READ);
+  while (First < Count)
+  {
+    const TFatFileRequest* const pFirst = &pRequests[First];
+    uint32_t RunStart;
+    uint32_t Covered;
+    uint32_t Sector;
+    uint16_t Sectors;
+    uint16_t Needed;
+    uint16_t I;
+    const uint8_t* pData;
+
+    /* The sectors read so far are behind RunEnd. */
+    if ((pFirst->Length == 0) || (pFirst->Offset + pFirst->Length <= RunEnd))
+    {
+      First++;
+      continue;
+    }
+    RunStart = (pFirst->Offset > RunEnd) ? pFirst->Offset - pFirst->Offset % FAT_BYTES_PER_SECTOR : RunEnd;
+
+    pFile->Position = RunStart;
+    if (!FAT_LocateFilePosition(pFile, 0)) break;
+
+    /* Extend the run over the sectors of the following requests, up to 
+     * the end of the scratch buffer. The run continues into the next 
+     * cluster if it follows on the disk.
+     */
+    Sectors = (pScratch == NULL) ? 1 : ScratchSectors;
+    Covered = RunStart;
+    for (I = First; (I < Count) && (pRequests[I].Offset < RunStart + (uint32_t)Sectors * FAT_BYTES_PER_SECTOR); I++)
+    {
+      const TFatFileRequest* const pRequest = &pRequests[I];
+
+      if (pRequest->Length == 0) continue;
+      /* Requests starting in the sector after the last covered one are adjacent on the disk. */
+      if (pRequest->Offset / FAT_BYTES_PER_SECTOR > (Covered + FAT_BYTES_PER_SECTOR - 1) / FAT_BYTES_PER_SECTOR) break;
+
+      if (pRequest->Offset + pRequest->Length > Covered)
+      {
+        Covered = pRequest->Offset + pRequest->Length;
+      }
+    }
+    if (Covered - RunStart < (uint32_t)Sectors * FAT_BYTES_PER_SECTOR)
+    {
+      Sectors = (uint16_t)((Covered - RunStart + FAT_BYTES_PER_SECTOR - 1) / FAT_BYTES_PER_SECTOR);
+    }
+    Sector = pFile->Location.Sector;
+    Needed = Sectors;
+    Sectors = (uint16_t)pFile->Location.SectorsLeftInCluster + 1;
+    while (Sectors < Needed)
+    {
+      const TFatClusterNr NextCluster = FAT_GetNextCluster(pPartition, pFile->Location.Cluster);
+
+      if (NextCluster != pFile->Location.Cluster + 1) break;
+
+      pFile->Location.Cluster = NextCluster;
+      pFile->ClusterIndex++;
+      Sectors = (uint16_t)(Sectors + pPartition->SectorsPerCluster);
+    }
+    if (Sectors > Needed)
+    {
+      Sectors = Needed;
+    }
+    RunEnd = RunStart + (uint32_t)Sectors * FAT_BYTES_PER_SECTOR;
+
+    if (pScratch == NULL)
+    {
+      FAT_LoadSector(pPartition, Sector);
+      pData = pPartition->pBuffer;
+    }
+    else
+    {
+      FAT_LoadSectors(pPartition, Sector, Sectors, pScratch);
+      pData = pScratch;
+    }
+
+    /* Copy the run to every request that overlaps it. */
+    for (I = First; (I < Count) && (pRequests[I].Offset < RunEnd); I++)
+    {
+      const TFatFileRequest* const pRequest = &pRequests[I];
+      const uint32_t From = (pRequest->Offset > RunStart) ? pRequest->Offset : RunStart;
+      const uint32_t To = (pRequest->Offset + pRequest->Length < RunEnd) ? pRequest->Offset + pRequest->Length : RunEnd;
+
+      if (From < To)
+      {
+        memcpy((void*)((uint8_t*)pRequest->pDest + (From - pRequest->Offset)), (const void*)(pData + (From - RunStart)), To - From);
+        Done += To - From;
+      }
+    }
+  }
+
+  FAT_Unlock(pPartition, FAT_LOCK_READ);
+
+  pFile->Position = Position;
+  pFile->Location = Location;
+  pFile->ClusterIndex = ClusterIndex;
+  return Done;
+}
+
+FAT_API uint8_t FAT_FileSeek(TFatFile* pFile, uint32_t Offset)
+{
+  if (Offset > pFile->Size) return 0;
+
+  pFile->Position = Offset;
+  return 1;
+}
+
+#ifdef FAT_ENABLE_WRITE
+FAT_API uint32_t FAT_FileWrite(TFatFile* pFile, const void* pSource, uint32_t Count)
+{
+  TFatPartition* const pPartition = pFile->pPartition;
+  const uint8_t* const pBytes = (const uint8_t*)pSource;
+  uint32_t Done = 0;
+
+  if (!(pFile->Flags & FAT_FILE_WRITE)) return 0;
+
+  FAT_Lock(pPartition, FAT_LOCK_WRITE);
+  while (Done < Count)
+  {
+    const uint16_t Offset = (uint16_t)(pFile->Position % FAT_BYTES_PER_SECTOR);
+    uint32_t Chunk;
+
+    if (!FAT_LocateFilePosition(pFile, pFile->Position + (Count - Done))) break;
+
+    if ((Offset == 0) && (Count - Done >= FAT_BYTES_PER_SECTOR))
+    {
+      /* Whole sectors are written straight from the caller's buffer. */
+      uint16_t Sectors = (uint16_t)pFile->Location.SectorsLeftInCluster + 1;
+
+      if (Sectors > (Count - Done) / FAT_BYTES_PER_SECTOR)
+      {
+        Sectors = (uint16_t)((Count - Done) / FAT_BYTES_PER_SECTOR);
+      }
+      FAT_StoreSectors(pPartition, pFile->Location.Sector, Sectors, pBytes + Done);
+      Chunk = (uint32_t)Sectors * FAT_BYTES_PER_SECTOR;
+    }
+    else
+    {
+      Chunk = FAT_BYTES_PER_SECTOR - Offset;
+      if (Chunk > Count - Done)
+      {
+        Chunk = Count - Done;
+      }
+
+      /* The old contents are only needed if some of them are kept. */
+      if ((Offset != 0) || (pFile->Position + Chunk < pFile->Size))
+      {
+        FAT_LoadSector(pPartition, pFile->Location.Sector);
+      }
+      else
+      {
+        memset((void*)(pPartition->pBuffer + Chunk), 0, FAT_BYTES_PER_SECTOR - Chunk);
+      }
+      memcpy((void*)(pPartition->pBuffer + Offset), (const void*)(pBytes + Done), Chunk);
+      FAT_StoreSector(pPartition, pFile->Location.Sector);
+    }
+    Done += Chunk;
+    pFile->Position += Chunk;
+    if (pFile->Position > pFile->Size)
+    {
+      pFile->Size = pFile->Position;
+      pFile->Flags |= FAT_FILE_MODIFIED;
+    }
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_WRITE);
+  return Done;
+}
+
+/* FAT_FileFlush, without locking. */
+static void FAT_FlushFile(TFatFile* pFile)
+{
+  TFatPartition* const pPartition = pFile->pPartition;
+
+  if (pFile->Flags & FAT_FILE_MODIFIED)
+  {
+    TFatDirEntry* pDirEntry;
+
+    FAT_LoadSector(pPartition, pFile->DirLocation.Location.Sector);
+    pDirEntry = FAT_GetDirEntry(pPartition, &pFile->DirLocation);
+    pDirEntry->FileSize = pFile->Size;
+    pDirEntry->StartClusterLow = (uint16_t)pFile->StartCluster;
+#ifdef FAT_ENABLE_FAT32
+    pDirEntry->StartClusterHigh = (uint16_t)((uint32_t)pFile->StartCluster >> 16);
+#endif
+    FAT_StoreSector(pPartition, pFile->DirLocation.Location.Sector);
+    pFile->Flags &= (uint8_t)~FAT_FILE_MODIFIED;
+  }
+  FAT_Flush(pPartition);
+}
+
+FAT_API void FAT_FileFlush(TFatFile* pFile)
+{
+  FAT_Lock(pFile->pPartition, FAT_LOCK_WRITE);
+  FAT_FlushFile(pFile);
+  FAT_Unlock(pFile->pPartition, FAT_LOCK_WRITE);
+}
+
+FAT_API uint8_t FAT_FileReserve(TFatFile* pFile, uint32_t Bytes)
+{
+  const TFatLocation Location = pFile->Location;
+  const TFatClusterNr ClusterIndex = pFile->ClusterIndex;
+  const uint32_t Position = pFile->Position;
+  uint8_t Result;
+
+  if (!(pFile->Flags & FAT_FILE_WRITE)) return 0;
+  if (Bytes == 0) return 1;
+
+  /* Locating the last byte allocates everything up to it at once. */
+  pFile->Position = Bytes - 1;
+  FAT_Lock(pFile->pPartition, FAT_LOCK_WRITE);
+  Result = FAT_LocateFilePosition(pFile, Bytes);
+  FAT_Unlock(pFile->pPartition, FAT_LOCK_WRITE);
+
+  pFile->Position = Position;
+  pFile->Location = Location;
+  pFile->ClusterIndex = ClusterIndex;
+  return Result;
+}
+
+/* FAT_FileTruncate, without locking. */
+static uint8_t FAT_TruncateFile(TFatFile* pFile, uint32_t Size)
+{
+  TFatPartition* const pPartition = pFile->pPartition;
+  const TFatLocation Location = pFile->Location;
+  const TFatClusterNr ClusterIndex = pFile->ClusterIndex;
+  const uint32_t Position = pFile->Position;
+  TFatClusterNr LastCluster;
+  TFatClusterNr NextCluster;
+
+  if (Size > pFile->Size) return 0;
+
+  if (Size != pFile->Size)
+  {
+    pFile->Size = Size;
+    pFile->Flags |= FAT_FILE_MODIFIED;
+  }
+  if (Position > Size)
+  {
+    pFile->Position = Size;
+  }
+  if (pFile->StartCluster == 0) return 1;
+
+  if (Size == 0)
+  {
+    FAT_FreeClusters(pPartition, 0, pFile->StartCluster);
+    pFile->StartCluster = 0;
+    pFile->Location.Cluster = 0;
+    pFile->ClusterIndex = 0;
+    pFile->RunStart = 0;
+    pFile->RunEnd = 0;
+    pFile->Flags |= FAT_FILE_MODIFIED;
+    return 1;
+  }
+
+  pFile->Position = Size - 1;
+  if (!FAT_LocateFilePosition(pFile, 0))
+  {
+    /* The chain is shorter than the file, so there is nothing to free. */
+    pFile->Position = (Position > Size) ? Size : Position;
+    return 1;
+  }
+  LastCluster = pFile->Location.Cluster;
+
+  NextCluster = FAT_GetNextCluster(pPartition, LastCluster);
+  if (!FAT_IsEndOfChain(pPartition, NextCluster) && (NextCluster >= 2))
+  {
+    FAT_FreeClusters(pPartition, LastCluster, NextCluster);
+  }
+
+  /* The cached position is kept if its cluster is still in the chain. The
+   * last allocated run is at the end of the chain, so it is either cut
+   * short or gone.
+   */
+  if ((Location.Cluster != 0) && (ClusterIndex <= pFile->ClusterIndex))
+  {
+    pFile->Location = Location;
+    pFile->ClusterIndex = ClusterIndex;
+  }
+  if ((LastCluster >= pFile->RunStart) && (LastCluster <= pFile->RunEnd))
+  {
+    pFile->RunEnd = LastCluster;
+  }
+  else
+  {
+    pFile->RunStart = 0;
+    pFile->RunEnd = 0;
+  }
+  pFile->Position = (Position > Size) ? Size : Position;
+  return 1;
+}
+
+FAT_API uint8_t FAT_FileTruncate(TFatFile* pFile, uint32_t Size)
+{
+  uint8_t Result;
+
+  if (!(pFile->Flags & FAT_FILE_WRITE)) return 0;
+
+  FAT_Lock(pFile->pPartition, FAT_LOCK_WRITE);
+  Result = FAT_TruncateFile(pFile, Size);
+  FAT_Unlock(pFile->pPartition, FAT_LOCK_WRITE);
+  return Result;
+}
+
+FAT_API uint8_t FAT_FileDelete(TFatPartition* pPartition, const char* pPath)
+{
+  TFatDirectoryLocation DirLocation;
+  TFatDirEntry* pDirEntry;
+  TFatClusterNr StartCluster;
+
+  FAT_Lock(pPartition, FAT_LOCK_WRITE);
+  pDirEntry = FAT_OpenPath(pPartition, pPath, &DirLocation);
+  if ((pDirEntry == NULL) || !FAT_IsFile(pDirEntry) || FAT_IsReadOnly(pDirEntry))
+  {
+    FAT_Unlock(pPartition, FAT_LOCK_WRITE);
+    return 0;
+  }
+
+  StartCluster = FAT_GetStartCluster(pDirEntry);
+
+  /* The entry goes first, so an interruption can only lose clusters. */
+  FAT_DeleteDirEntry(pPartition, &DirLocation);
+  if (StartCluster != 0)
+  {
+    FAT_FreeClusters(pPartition, 0, StartCluster);
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_WRITE);
+  return 1;
+}
+
+/* Returns the size of the file that the cluster chain is extended to when
+ * the end of the file is at Position.
+ */
+#define FAT_GetLogExtent(pLog, Position) ((Position) + 1 + (pLog)->Preallocate * FAT_GetClusterSize((pLog)->File.pPartition))
+
+FAT_API uint8_t FAT_LogOpen(TFatPartition* pPartition, const char* pPath, TFatLog* pLog)
+{
+  TFatFile* const pFile = &pLog->File;
+  uint8_t Result = 1;
+
+  FAT_Lock(pPartition, FAT_LOCK_WRITE);
+  if (!FAT_OpenFile(pPartition, pPath, FAT_FILE_WRITE | FAT_FILE_CREATE, pFile))
+  {
+    Result = 0;
+  }
+  else
+  {
+    pFile->Position = pFile->Size;
+    pLog->Uncommitted = 0;
+    memset((void*)pLog->pSector, 0, FAT_BYTES_PER_SECTOR);
+
+    if (pFile->Size % FAT_BYTES_PER_SECTOR != 0)
+    {
+      Result = FAT_LocateFilePosition(pFile, 0);
+      if (Result)
+      {
+        FAT_LoadSectors(pPartition, pFile->Location.Sector, 1, pLog->pSector);
+      }
+    }
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_WRITE);
+  return Result;
+}
+
+/* FAT_LogCommit, without locking. */
+static void FAT_CommitLog(TFatLog* pLog)
+{
+  TFatFile* const pFile = &pLog->File;
+
+  /* The sector was located when its first byte was written. */
+  if (pFile->Position % FAT_BYTES_PER_SECTOR != 0)
+  {
+    FAT_StoreSectors(pFile->pPartition, pFile->Location.Sector, 1, pLog->pSector);
+  }
+  pLog->Uncommitted = 0;
+  FAT_FlushFile(pFile);
+}
+
+FAT_API uint32_t FAT_LogWrite(TFatLog* pLog, const void* pSource, uint32_t Count)
+{
+  TFatFile* const pFile = &pLog->File;
+  TFatPartition* const pPartition = pFile->pPartition;
+  const uint8_t* const pBytes = (const uint8_t*)pSource;
+  uint32_t Done = 0;
+
+  FAT_Lock(pPartition, FAT_LOCK_WRITE);
+  while (Done < Count)
+  {
+    const uint16_t Offset = (uint16_t)(pFile->Position % FAT_BYTES_PER_SECTOR);
+    uint16_t Sectors = 0;
+    uint32_t Chunk;
+
+    /* The sector at the end of the file is located when it is started. */
+    if ((Offset == 0) && !FAT_LocateFilePosition(pFile, FAT_GetLogExtent(pLog, pFile->Position))) break;
+
+    if ((Offset == 0) && (Count - Done >= FAT_BYTES_PER_SECTOR))
+    {
+      /* Whole sectors are written straight from the caller's buffer. */
+      Sectors = (uint16_t)pFile->Location.SectorsLeftInCluster + 1;
+
+      if (Sectors > (Count - Done) / FAT_BYTES_PER_SECTOR)
+      {
+        Sectors = (uint16_t)((Count - Done) / FAT_BYTES_PER_SECTOR);
+      }
+      FAT_StoreSectors(pPartition, pFile->Location.Sector, Sectors, pBytes + Done);
+      Chunk = (uint32_t)Sectors * FAT_BYTES_PER_SECTOR;
+    }
+    else
+    {
+      Chunk = FAT_BYTES_PER_SECTOR - Offset;
+      if (Chunk > Count - Done)
+      {
+        Chunk = Count - Done;
+      }
+      memcpy((void*)(pLog->pSector + Offset), (const void*)(pBytes + Done), Chunk);
+
+      if (Offset + Chunk == FAT_BYTES_PER_SECTOR)
+      {
+        FAT_StoreSectors(pPartition, pFile->Location.Sector, 1, pLog->pSector);
+        memset((void*)pLog->pSector, 0, FAT_BYTES_PER_SECTOR);
+        Sectors = 1;
+      }
+    }
+    Done += Chunk;
+    pFile->Position += Chunk;
+    pFile->Size = pFile->Position;
+    pFile->Flags |= FAT_FILE_MODIFIED;
+
+    pLog->Uncommitted = (uint16_t)(pLog->Uncommitted + Sectors);
+    if ((pLog->CommitInterval != 0) && (pLog->Uncommitted >= pLog->CommitInterval))
+    {
+      FAT_CommitLog(pLog);
+    }
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_WRITE);
+  return Done;
+}
+
+FAT_API void FAT_LogCommit(TFatLog* pLog)
+{
+  FAT_Lock(pLog->File.pPartition, FAT_LOCK_WRITE);
+  FAT_CommitLog(pLog);
+  FAT_Unlock(pLog->File.pPartition, FAT_LOCK_WRITE);
+}
+
+FAT_API void FAT_LogClose(TFatLog* pLog)
+{
+  /* Truncating keeps the cached position, which FAT_CommitLog needs. */
+  FAT_Lock(pLog->File.pPartition, FAT_LOCK_WRITE);
+  FAT_TruncateFile(&pLog->File, pLog->File.Size);
+  FAT_CommitLog(pLog);
+  FAT_Unlock(pLog->File.pPartition, FAT_LOCK_WRITE);
+  pLog->File.pPartition = NULL;
+}
+#endif
+
+FAT_API void FAT_FileClose(TFatFile* pFile)
+{
+#ifdef FAT_ENABLE_WRITE
+  if (pFile->Flags & FAT_FILE_WRITE)
+  {
+    FAT_FileFlush(pFile);
+  }
+#endif
+  pFile->pPartition = NULL;
+}
@@ -0,0 +1,390 @@
+#ifdef __unix__
+/* Needed for fseeko() and 64-bit file offsets, so that images larger 
+ * than 2 GB can be accessed. 
+ */
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200112L
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/fathost.h"
+
+#if defined(FAT_ENABLE_THREADS) && defined(__unix__)
+#include <pthread.h>
+#endif
+
+/* The seek and the transfer must not be separated by another thread. */
+#if defined(FAT_ENABLE_THREADS) && defined(__unix__)
+#define FAT_LockFile(pFile)   flockfile(pFile)
+#define FAT_UnlockFile(pFile) funlockfile(pFile)
+#elif defined(FAT_ENABLE_THREADS) && defined(_MSC_VER)
+#define FAT_LockFile(pFile)   _lock_file(pFile)
+#define FAT_UnlockFile(pFile) _unlock_file(pFile)
+#else
+#define FAT_LockFile(pFile)
+#define FAT_UnlockFile(pFile)
+#endif
+
+/* Seeks to the start of a sector. Returns 0 on success. */
+static int FAT_SeekFile(FILE* pFile, uint32_t SectorNr)
+{
+#if defined(__unix__)
+  return fseeko(pFile, (off_t)SectorNr * FAT_BYTES_PER_SECTOR, SEEK_SET);
+#elif defined(_MSC_VER)
+  return _fseeki64(pFile, (__int64)SectorNr * FAT_BYTES_PER_SECTOR, SEEK_SET);
+#else
+  return fseek(pFile, (long)SectorNr * FAT_BYTES_PER_SECTOR, SEEK_SET);
+#endif
+}
+
+static void FAT_FileReadSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, uint8_t* pDest)
+{
+  TFatFileDevice* const pFileDevice = (TFatFileDevice*)pDevice->pContext;
+  size_t Read = 0;
+
+  FAT_LockFile(pFileDevice->pFile);
+  if (FAT_SeekFile(pFileDevice->pFile, SectorNr) == 0)
+  {
+    Read = fread((void*)pDest, FAT_BYTES_PER_SECTOR, Count, pFileDevice->pFile);
+  }
+  FAT_UnlockFile(pFileDevice->pFile);
+  if (Read != Count)
+  {
+    memset((void*)(pDest + Read * FAT_BYTES_PER_SECTOR), 0, (Count - Read) * FAT_BYTES_PER_SECTOR);
+    pFileDevice->Error = 1;
+  }
+}
+
+static void FAT_FileReadSector(TFatDevice* pDevice, uint32_t SectorNr, uint8_t* pDest)
+{
+  FAT_FileReadSectors(pDevice, SectorNr, 1, pDest);
+}
+
+static void FAT_FileWriteSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource)
+{
+  TFatFileDevice* const pFileDevice = (TFatFileDevice*)pDevice->pContext;
+
+  FAT_LockFile(pFileDevice->pFile);
+  if ((FAT_SeekFile(pFileDevice->pFile, SectorNr) != 0) || 
+      (fwrite((void*)pSource, FAT_BYTES_PER_SECTOR, Count, pFileDevice->pFile) != Count))
+  {
+    pFileDevice->Error = 1;
+  }
+  FAT_UnlockFile(pFileDevice->pFile);
+}
+
+static void FAT_FileWriteSector(TFatDevice* pDevice, uint32_t SectorNr, const uint8_t* pSource)
+{
+  FAT_FileWriteSectors(pDevice, SectorNr, 1, pSource);
+}
+
+static void FAT_FileFlushDevice(TFatDevice* pDevice)
+{
+  TFatFileDevice* const pFileDevice = (TFatFileDevice*)pDevice->pContext;
+
+  if (fflush(pFileDevice->pFile) != 0)
+  {
+    pFileDevice->Error = 1;
+  }
+}
+
+uint8_t FAT_OpenFileDevice(TFatFileDevice* pFileDevice, const char* pPath, uint8_t Writable)
+{
+  pFileDevice->pFile = fopen(pPath, Writable ? "r+b" : "rb");
+  if (pFileDevice->pFile == NULL)
+  {
+    return 0;
+  }
+  pFileDevice->Error = 0;
+
+  pFileDevice->Device.ReadSector   = FAT_FileReadSector;
+  pFileDevice->Device.WriteSector  = FAT_FileWriteSector;
+  pFileDevice->Device.ReadSectors  = FAT_FileReadSectors;
+  pFileDevice->Device.WriteSectors = FAT_FileWriteSectors;
+  pFileDevice->Device.Flush        = FAT_FileFlushDevice;
+  pFileDevice->Device.MapSector    = NULL;
+  pFileDevice->Device.pContext     = pFileDevice;
+  return 1;
+}
+
+void FAT_CloseFileDevice(TFatFileDevice* pFileDevice)
+{
+  fclose(pFileDevice->pFile);
+  pFileDevice->pFile = NULL;
+}
+
+/* Returns a pointer to the first sector, or NULL if the range is outside the image. */
+static uint8_t* FAT_GetMemorySectors(TFatMemoryDevice* pMemoryDevice, uint32_t SectorNr, uint16_t Count)
+{
+  if ((SectorNr >= pMemoryDevice->SectorCount) || (Count > pMemoryDevice->SectorCount - SectorNr))
+  {
+    pMemoryDevice->Error = 1;
+    return NULL;
+  }
+  return pMemoryDevice->pData + (size_t)SectorNr * FAT_BYTES_PER_SECTOR;
+}
+
+static void FAT_MemoryReadSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, uint8_t* pDest)
+{
+  const uint8_t* pSource = FAT_GetMemorySectors((TFatMemoryDevice*)pDevice->pContext, SectorNr, Count);
+
+  if (pSource == NULL)
+  {
+    memset((void*)pDest, 0, (size_t)Count * FAT_BYTES_PER_SECTOR);
+    return;
+  }
+  memcpy((void*)pDest, (void*)pSource, (size_t)Count * FAT_BYTES_PER_SECTOR);
+}
+
+static void FAT_MemoryReadSector(TFatDevice* pDevice, uint32_t SectorNr, uint8_t* pDest)
+{
+  FAT_MemoryReadSectors(pDevice, SectorNr, 1, pDest);
+}
+
+static void FAT_MemoryWriteSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource)
+{
+  uint8_t* pDest = FAT_GetMemorySectors((TFatMemoryDevice*)pDevice->pContext, SectorNr, Count);
+
+  if (pDest != NULL)
+  {
+    memcpy((void*)pDest, (void*)pSource, (size_t)Count * FAT_BYTES_PER_SECTOR);
+  }
+}
+
+static void FAT_MemoryWriteSector(TFatDevice* pDevice, uint32_t SectorNr, const uint8_t* pSource)
+{
+  FAT_MemoryWriteSectors(pDevice, SectorNr, 1, pSource);
+}
+
+void FAT_OpenMemoryDevice(TFatMemoryDevice* pMemoryDevice, uint8_t* pData, uint32_t SectorCount)
+{
+  pMemoryDevice->pData       = pData;
+  pMemoryDevice->SectorCount = SectorCount;
+  pMemoryDevice->Error       = 0;
+
+  pMemoryDevice->Device.ReadSector   = FAT_MemoryReadSector;
+  pMemoryDevice->Device.WriteSector  = FAT_MemoryWriteSector;
+  pMemoryDevice->Device.ReadSectors  = FAT_MemoryReadSectors;
+  pMemoryDevice->Device.WriteSectors = FAT_MemoryWriteSectors;
+  pMemoryDevice->Device.Flush        = NULL;
+  pMemoryDevice->Device.MapSector    = NULL;
+  pMemoryDevice->Device.pContext     = pMemoryDevice;
+}
+
+#ifdef __unix__
+/* Returned by FAT_MappedMapSector for sectors outside the image. */
+static uint8_t FAT_ZeroSector[FAT_BYTES_PER_SECTOR];
+
+static uint8_t* FAT_MappedMapSector(TFatDevice* pDevice, uint32_t SectorNr)
+{
+  uint8_t* pSector = FAT_GetMemorySectors((TFatMemoryDevice*)pDevice->pContext, SectorNr, 1);
+
+  return (pSector != NULL) ? pSector : FAT_ZeroSector;
+}
+
+static void FAT_MappedWriteSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource)
+{
+  TFatMappedDevice* const pMappedDevice = (TFatMappedDevice*)pDevice->pContext;
+
+  FAT_MemoryWriteSectors(pDevice, SectorNr, Count, pSource);
+
+  if ((pMappedDevice->EndDirty == 0) || (SectorNr < pMappedDevice->FirstDirty))
+  {
+    pMappedDevice->FirstDirty = SectorNr;
+  }
+  if (SectorNr + Count > pMappedDevice->EndDirty)
+  {
+    pMappedDevice->EndDirty = SectorNr + Count;
+  }
+}
+
+static void FAT_MappedWriteSector(TFatDevice* pDevice, uint32_t SectorNr, const uint8_t* pSource)
+{
+  FAT_MappedWriteSectors(pDevice, SectorNr, 1, pSource);
+}
+
+/* Used for read-only mappings, which would fault when written to. */
+static void FAT_MappedRejectSectors(TFatDevice* pDevice, uint32_t SectorNr, uint16_t Count, const uint8_t* pSource)
+{
+  ((TFatMappedDevice*)pDevice->pContext)->Memory.Error = 1;
+}
+
+static void FAT_MappedRejectSector(TFatDevice* pDevice, uint32_t SectorNr, const uint8_t* pSource)
+{
+  FAT_MappedRejectSectors(pDevice, SectorNr, 1, pSource);
+}
+
+static void FAT_MappedFlush(TFatDevice* pDevice)
+{
+  TFatMappedDevice* const pMappedDevice = (TFatMappedDevice*)pDevice->pContext;
+  size_t Start, End;
+
+  if (pMappedDevice->EndDirty == 0)
+  {
+    return;
+  }
+
+  /* msync() needs a page aligned address, so round the written range. */
+  Start = (size_t)pMappedDevice->FirstDirty * FAT_BYTES_PER_SECTOR;
+  Start -= Start % (size_t)sysconf(_SC_PAGESIZE);
+  End = (size_t)pMappedDevice->EndDirty * FAT_BYTES_PER_SECTOR;
+
+  if (msync((void*)(pMappedDevice->Memory.pData + Start), End - Start, MS_SYNC) != 0)
+  {
+    pMappedDevice->Memory.Error = 1;
+  }
+  pMappedDevice->EndDirty = 0;
+}
+
+uint8_t FAT_OpenMappedDevice(TFatMappedDevice* pMappedDevice, const char* pPath, uint8_t Writable)
+{
+  struct stat Stat;
+  void* pData;
+  int File = open(pPath, Writable ? O_RDWR : O_RDONLY);
+
+  if (File < 0)
+  {
+    return 0;
+  }
+  if ((fstat(File, &Stat) != 0) || (Stat.st_size < FAT_BYTES_PER_SECTOR) || 
+      (Stat.st_size / FAT_BYTES_PER_SECTOR > (off_t)0xFFFFFFFFUL) || 
+      ((off_t)(size_t)Stat.st_size != Stat.st_size))
+  {
+    close(File);
+    return 0;
+  }
+
+  pData = mmap(NULL, (size_t)Stat.st_size, Writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, File, 0);
+  /* The mapping stays valid after the file is closed. */
+  close(File);
+  if (pData == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  pMappedDevice->Size       = (size_t)Stat.st_size;
+  pMappedDevice->FirstDirty = 0;
+  pMappedDevice->EndDirty   = 0;
+  FAT_OpenMemoryDevice(&pMappedDevice->Memory, (uint8_t*)pData, (uint32_t)(Stat.st_size / FAT_BYTES_PER_SECTOR));
+
+  if (Writable)
+  {
+    pMappedDevice->Memory.Device.WriteSector  = FAT_MappedWriteSector;
+    pMappedDevice->Memory.Device.WriteSectors = FAT_MappedWriteSectors;
+    pMappedDevice->Memory.Device.Flush        = FAT_MappedFlush;
+  }
+  else
+  {
+    pMappedDevice->Memory.Device.WriteSector  = FAT_MappedRejectSector;
+    pMappedDevice->Memory.Device.WriteSectors = FAT_MappedRejectSectors;
+    pMappedDevice->Memory.Device.MapSector    = FAT_MappedMapSector;
+  }
+  return 1;
+}
+
+void FAT_CloseMappedDevice(TFatMappedDevice* pMappedDevice)
+{
+  munmap((void*)pMappedDevice->Memory.pData, pMappedDevice->Size);
+  pMappedDevice->Memory.pData = NULL;
+}
+#endif
+
+#if defined(FAT_ENABLE_THREADS) && defined(__unix__)
+typedef struct {
+  pthread_rwlock_t  RwLock;
+  pthread_mutex_t   Turnstile;
+  pthread_mutex_t   CacheMutex;
+} TFatHostLock;
+
+static void FAT_HostLock(TFatLock* pLock, uint8_t Type)
+{
+  TFatHostLock* const pHostLock = (TFatHostLock*)pLock->pContext;
+
+  /* POSIX reader-writer locks may let a steady stream of readers starve
+   * a writer. A waiting writer holds the turnstile, which keeps new
+   * readers out until it has had its turn.
+   */
+  switch (Type)
+  {
+    case FAT_LOCK_READ:
+      pthread_mutex_lock(&pHostLock->Turnstile);
+      pthread_mutex_unlock(&pHostLock->Turnstile);
+      pthread_rwlock_rdlock(&pHostLock->RwLock);
+      break;
+    case FAT_LOCK_WRITE:
+      pthread_mutex_lock(&pHostLock->Turnstile);
+      pthread_rwlock_wrlock(&pHostLock->RwLock);
+      pthread_mutex_unlock(&pHostLock->Turnstile);
+      break;
+    default:
+      pthread_mutex_lock(&pHostLock->CacheMutex);
+      break;
+  }
+}
+
+static void FAT_HostUnlock(TFatLock* pLock, uint8_t Type)
+{
+  TFatHostLock* const pHostLock = (TFatHostLock*)pLock->pContext;
+
+  if (Type == FAT_LOCK_CACHE)
+  {
+    pthread_mutex_unlock(&pHostLock->CacheMutex);
+  }
+  else
+  {
+    pthread_rwlock_unlock(&pHostLock->RwLock);
+  }
+}
+
+uint8_t FAT_OpenHostLock(TFatLock* pLock)
+{
+  TFatHostLock* const pHostLock = (TFatHostLock*)malloc(sizeof(TFatHostLock));
+
+  if (pHostLock == NULL)
+  {
+    return 0;
+  }
+  if (pthread_rwlock_init(&pHostLock->RwLock, NULL) != 0)
+  {
+    free(pHostLock);
+    return 0;
+  }
+  if (pthread_mutex_init(&pHostLock->Turnstile, NULL) != 0)
+  {
+    pthread_rwlock_destroy(&pHostLock->RwLock);
+    free(pHostLock);
+    return 0;
+  }
+  if (pthread_mutex_init(&pHostLock->CacheMutex, NULL) != 0)
+  {
+    pthread_mutex_destroy(&pHostLock->Turnstile);
+    pthread_rwlock_destroy(&pHostLock->RwLock);
+    free(pHostLock);
+    return 0;
+  }
+
+  pLock->Lock     = FAT_HostLock;
+  pLock->Unlock   = FAT_HostUnlock;
+  pLock->pContext = pHostLock;
+  return 1;
+}
+
+void FAT_CloseHostLock(TFatLock* pLock)
+{
+  TFatHostLock* const pHostLock = (TFatHostLock*)pLock->pContext;
+
+  pthread_mutex_destroy(&pHostLock->CacheMutex);
+  pthread_mutex_destroy(&pHostLock->Turnstile);
+  pthread_rwlock_destroy(&pHostLock->RwLock);
+  free(pHostLock);
+  pLock->pContext = NULL;
+}
+#endif
@@ -0,0 +1,443 @@
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_DIR_INDEX_ENTRIES
+
+#if (FAT_DIR_INDEX_ENTRIES & (FAT_DIR_INDEX_ENTRIES - 1)) != 0
+#error FAT_DIR_INDEX_ENTRIES must be a power of two!
+#endif
+
+/* The table is never filled beyond three quarters, so that there is
+ * always an empty entry to end a probe sequence.
+ */
+#define FAT_DIR_INDEX_LIMIT (FAT_DIR_INDEX_ENTRIES - FAT_DIR_INDEX_ENTRIES / 4)
+
+#define FAT_GetNameSlot(Hash) ((uint16_t)((Hash) ^ ((Hash) >> 7)) & (FAT_DIR_INDEX_ENTRIES - 1))
+#define FAT_GetNextNameSlot(Slot) ((uint16_t)((Slot) + 1) & (FAT_DIR_INDEX_ENTRIES - 1))
+
+/* The FAT16 root directory has no cluster chain and is iterated with the
+ * FAT16_*RootDirEntry functions.
+ */
+#define FAT_IsFixedRootDirectory(pPartition, DirectoryCluster) (FAT_IsFAT16(pPartition) && ((DirectoryCluster) == 0))
+
+static uint16_t FAT_HashName(const uint8_t* pName)
+{
+  uint16_t Hash = 0;
+  uint8_t I;
+
+  for (I = 0; I < sizeof(((TFatDirEntry*)0)->Name); I++)
+  {
+    Hash = (uint16_t)(Hash * 31 + pName[I]);
+  }
+  return Hash;
+}
+
+static void FAT_GetFirstIndexedEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, TFatDirectoryLocation* pDirLocation)
+{
+#ifdef FAT_ENABLE_FAT16
+  if (FAT_IsFixedRootDirectory(pPartition, DirectoryCluster))
+  {
+    FAT16_GetFirstRootDirEntry(pPartition, pDirLocation);
+    return;
+  }
+#endif
+  FAT_GetFirstDirectoryEntry(pPartition, DirectoryCluster, pDirLocation);
+}
+
+static void FAT_GetNextIndexedEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, TFatDirectoryLocation* pDirLocation)
+{
+#ifdef FAT_ENABLE_FAT16
+  if (FAT_IsFixedRootDirectory(pPartition, DirectoryCluster))
+  {
+    FAT16_GetNextRootDirEntry(pPartition, pDirLocation);
+    return;
+  }
+#endif
+  FAT_GetNextDirectoryEntry(pPartition, pDirLocation);
+}
+
+static uint8_t FAT_IsLastIndexedEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, const TFatDirEntry* pDirEntry, const TFatDirectoryLocation* pDirLocation)
+{
+#ifdef FAT_ENABLE_FAT16
+  if (FAT_IsFixedRootDirectory(pPartition, DirectoryCluster))
+  {
+    return FAT16_IsLastDirEntry(pPartition, pDirEntry, pDirLocation);
+  }
+#endif
+  return FAT_IsLastDirEntry(pPartition, pDirEntry, pDirLocation);
+}
+
+static TFatDirIndex* FAT_GetDirIndex(TFatNameIndex* pNameIndex, TFatClusterNr DirectoryCluster)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_DIR_INDEX_DIRECTORIES; I++)
+  {
+    TFatDirIndex* const pDirIndex = &pNameIndex->Directories[I];
+
+    if ((pDirIndex->State != FAT_DIR_INDEX_UNUSED) && (pDirIndex->DirectoryCluster == DirectoryCluster))
+    {
+      return pDirIndex;
+    }
+  }
+  return NULL;
+}
+
+/* Takes over an unused or the least recently used index for the directory
+ * and positions it at the first directory entry, which is loaded into
+ * pPartition->pBuffer.
+ */
+static TFatDirIndex* FAT_CreateDirIndex(TFatPartition* pPartition, TFatClusterNr DirectoryCluster)
+{
+  TFatNameIndex* const pNameIndex = pPartition->pNameIndex;
+  TFatDirIndex* pDirIndex = &pNameIndex->Directories[0];
+  uint8_t I;
+
+  for (I = 0; I < FAT_DIR_INDEX_DIRECTORIES; I++)
+  {
+    TFatDirIndex* const pCandidate = &pNameIndex->Directories[I];
+
+    if (pCandidate->State == FAT_DIR_INDEX_UNUSED)
+    {
+      pDirIndex = pCandidate;
+      break;
+    }
+    if (pCandidate->LastUsed < pDirIndex->LastUsed)
+    {
+      pDirIndex = pCandidate;
+    }
+  }
+
+  D_(printf("Indexing directory %d\n", DirectoryCluster));
+
+  memset((void*)pDirIndex->pEntries, 0xFF, FAT_DIR_INDEX_ENTRIES * sizeof(TFatNameEntry));
+  pDirIndex->DirectoryCluster = DirectoryCluster;
+  pDirIndex->Count = 0;
+  pDirIndex->Used = 0;
+  pDirIndex->State = FAT_DIR_INDEX_PARTIAL;
+  FAT_GetFirstIndexedEntry(pPartition, DirectoryCluster, &pDirIndex->Resume);
+  return pDirIndex;
+}
+
+/* Returns 0 if the table is full. A location that is already in the table
+ * is not added again.
+ */
+static uint8_t FAT_AddIndexedName(TFatDirIndex* pDirIndex, uint16_t Hash, const TFatDirectoryLocation* pDirLocation)
+{
+  uint16_t Slot = FAT_GetNameSlot(Hash);
+  TFatNameEntry* pEntry;
+
+  for (;;)
+  {
+    pEntry = &pDirIndex->pEntries[Slot];
+    if (pEntry->EntryOffset == FAT_NAME_EMPTY) break;
+
+    if ((pEntry->Hash == Hash) &&
+        (pEntry->EntryOffset == pDirLocation->EntryOffset) &&
+        (pEntry->Sector == pDirLocation->Location.Sector))
+    {
+      return 1;
+    }
+    Slot = FAT_GetNextNameSlot(Slot);
+  }
+
+  if (pDirIndex->Used >= FAT_DIR_INDEX_LIMIT) return 0;
+
+  pEntry->Sector               = pDirLocation->Location.Sector;
+  pEntry->Cluster              = pDirLocation->Location.Cluster;
+  pEntry->SectorsLeftInCluster = pDirLocation->Location.SectorsLeftInCluster;
+  pEntry->EntryOffset          = pDirLocation->EntryOffset;
+  pEntry->Hash                 = Hash;
+  pDirIndex->Count++;
+  pDirIndex->Used++;
+  return 1;
+}
+
+FAT_API void FAT_InitNameIndex(TFatNameIndex* pNameIndex)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_DIR_INDEX_DIRECTORIES; I++)
+  {
+    TFatDirIndex* const pDirIndex = &pNameIndex->Directories[I];
+
+    pDirIndex->pEntries = pNameIndex->pData + I * FAT_DIR_INDEX_ENTRIES;
+    pDirIndex->State = FAT_DIR_INDEX_UNUSED;
+    pDirIndex->LastUsed = 0;
+  }
+  pNameIndex->CreateCluster = 0;
+  pNameIndex->Tick = 0;
+}
+
+FAT_API TFatDirEntry* FAT_FindIndexedDirEntry(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, const char* pName, TFatDirectoryLocation* pDirLocation)
+{
+  TFatNameIndex* const pNameIndex = pPartition->pNameIndex;
+  TFatDirIndex* pDirIndex = FAT_GetDirIndex(pNameIndex, DirectoryCluster);
+  const uint16_t Hash = FAT_HashName((const uint8_t*)pName);
+  uint16_t Slot = FAT_GetNameSlot(Hash);
+  uint8_t Loaded = 0;
+
+  if (pDirIndex == NULL)
+  {
+    pDirIndex = FAT_CreateDirIndex(pPartition, DirectoryCluster);
+    Loaded = 1;
+  }
+  pDirIndex->LastUsed = ++pNameIndex->Tick;
+
+  /* Check the names that are already indexed. Only entries with the same
+   * hash are read from the disk.
+   */
+  while (pDirIndex->pEntries[Slot].EntryOffset != FAT_NAME_EMPTY)
+  {
+    const TFatNameEntry* pEntry = &pDirIndex->pEntries[Slot];
+
+    if ((pEntry->Hash == Hash) && (pEntry->EntryOffset != FAT_NAME_REMOVED))
+    {
+      TFatDirEntry* pDirEntry;
+
+      pDirLocation->Location.Sector               = pEntry->Sector;
+      pDirLocation->Location.Cluster              = pEntry->Cluster;
+      pDirLocation->Location.SectorsLeftInCluster = pEntry->SectorsLeftInCluster;
+      pDirLocation->EntryOffset                   = pEntry->EntryOffset;
+      FAT_LoadSector(pPartition, pEntry->Sector);
+      Loaded = 0;
+
+      pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
+      if (memcmp((const void*)pName, (const void*)pDirEntry->Name, sizeof(pDirEntry->Name)) == 0)
+      {
+        return pDirEntry;
+      }
+    }
+    Slot = FAT_GetNextNameSlot(Slot);
+  }
+
+  if (pDirIndex->State == FAT_DIR_INDEX_COMPLETE) return NULL;
+
+  /* Continue the search where the previous one stopped. */
+  *pDirLocation = pDirIndex->Resume;
+  if (!Loaded)
+  {
+    FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+  }
+
+  for (;;)
+  {
+    TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
+
+    if (FAT_IsLastIndexedEntry(pPartition, DirectoryCluster, pDirEntry, pDirLocation))
+    {
+      if (pDirIndex->State == FAT_DIR_INDEX_PARTIAL)
+      {
+        pDirIndex->State = FAT_DIR_INDEX_COMPLETE;
+        pDirIndex->Resume = *pDirLocation;
+      }
+      break;
+    }
+
+    if (!FAT_IsDirEntryDeleted(pDirEntry) &&
+        !FAT_IsLongFileName(pDirEntry))
+    {
+      if ((pDirIndex->State == FAT_DIR_INDEX_PARTIAL) &&
+          !FAT_AddIndexedName(pDirIndex, FAT_HashName(pDirEntry->Name), pDirLocation))
+      {
+        /* Out of entries. Later searches continue from this entry without
+         * adding names.
+         */
+        D_(printf("Index of directory %d is full\n", DirectoryCluster));
+        pDirIndex->State = FAT_DIR_INDEX_FULL;
+        pDirIndex->Resume = *pDirLocation;
+      }
+
+      if (memcmp((const void*)pName, (const void*)pDirEntry->Name, sizeof(pDirEntry->Name)) == 0)
+      {
+        /* The entry is looked at again by the next search, but is not added twice. */
+        if (pDirIndex->State == FAT_DIR_INDEX_PARTIAL)
+        {
+          pDirIndex->Resume = *pDirLocation;
+        }
+        return pDirEntry;
+      }
+    }
+    FAT_GetNextIndexedEntry(pPartition, DirectoryCluster, pDirLocation);
+  }
+  return NULL;
+}
+
+#ifdef FAT_ENABLE_WRITE
+FAT_API void FAT_InsertIndexedName(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, const TFatDirectoryLocation* pDirLocation)
+{
+  TFatDirIndex* pDirIndex;
+
+  if (pPartition->pNameIndex == NULL) return;
+
+  pDirIndex = FAT_GetDirIndex(pPartition->pNameIndex, DirectoryCluster);
+  if (pDirIndex == NULL) return;
+
+  if (!FAT_AddIndexedName(pDirIndex, FAT_HashName(FAT_GetDirEntry(pPartition, pDirLocation)->Name), pDirLocation))
+  {
+    /* The entry may be located before Resume, so the index can not be
+     * used without it.
+     */
+    D_(printf("Index of directory %d is full, dropping it\n", DirectoryCluster));
+    pDirIndex->State = FAT_DIR_INDEX_UNUSED;
+  }
+}
+
+FAT_API void FAT_RemoveIndexedName(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation)
+{
+  const uint16_t Hash = FAT_HashName(FAT_GetDirEntry(pPartition, pDirLocation)->Name);
+  uint8_t I;
+
+  if (pPartition->pNameIndex == NULL) return;
+
+  for (I = 0; I < FAT_DIR_INDEX_DIRECTORIES; I++)
+  {
+    TFatDirIndex* const pDirIndex = &pPartition->pNameIndex->Directories[I];
+    uint16_t Slot = FAT_GetNameSlot(Hash);
+
+    if (pDirIndex->State == FAT_DIR_INDEX_UNUSED) continue;
+
+    while (pDirIndex->pEntries[Slot].EntryOffset != FAT_NAME_EMPTY)
+    {
+      TFatNameEntry* const pEntry = &pDirIndex->pEntries[Slot];
+
+      if ((pEntry->Hash == Hash) &&
+          (pEntry->EntryOffset == pDirLocation->EntryOffset) &&
+          (pEntry->Sector == pDirLocation->Location.Sector))
+      {
+        pEntry->EntryOffset = FAT_NAME_REMOVED;
+        pDirIndex->Count--;
+        return;
+      }
+      Slot = FAT_GetNextNameSlot(Slot);
+    }
+  }
+}
+#endif
+#endif
+
+#ifdef FAT_DIR_HINT_ENTRIES
+FAT_API void FAT_InitDirHints(TFatDirHints* pDirHints)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_DIR_HINT_ENTRIES; I++)
+  {
+    pDirHints->Entries[I].LastUsed = 0;
+  }
+  pDirHints->Tick = 0;
+}
+
+#ifdef FAT_ENABLE_WRITE
+static TFatDirHint* FAT_FindDirHint(TFatDirHints* pDirHints, TFatClusterNr DirectoryCluster)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_DIR_HINT_ENTRIES; I++)
+  {
+    TFatDirHint* const pDirHint = &pDirHints->Entries[I];
+
+    if ((pDirHint->LastUsed != 0) && (pDirHint->DirectoryCluster == DirectoryCluster))
+    {
+      pDirHint->LastUsed = ++pDirHints->Tick;
+      return pDirHint;
+    }
+  }
+  return NULL;
+}
+
+FAT_API uint8_t FAT_GetDirHint(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, TFatDirectoryLocation* pDirLocation)
+{
+  const TFatDirHint* pDirHint;
+
+  if (pPartition->pDirHints == NULL) return 0;
+
+  pDirHint = FAT_FindDirHint(pPartition->pDirHints, DirectoryCluster);
+  if (pDirHint == NULL) return 0;
+
+  *pDirLocation = pDirHint->Free;
+  return 1;
+}
+
+FAT_API void FAT_SetDirHint(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, const TFatDirectoryLocation* pDirLocation)
+{
+  TFatDirHints* const pDirHints = pPartition->pDirHints;
+  TFatDirHint* pDirHint;
+  uint8_t I;
+
+  if (pDirHints == NULL) return;
+
+  pDirHint = FAT_FindDirHint(pDirHints, DirectoryCluster);
+  if (pDirHint == NULL)
+  {
+    /* Unused hints have the lowest LastUsed, so they are taken first. */
+    pDirHint = &pDirHints->Entries[0];
+    for (I = 1; I < FAT_DIR_HINT_ENTRIES; I++)
+    {
+      if (pDirHints->Entries[I].LastUsed < pDirHint->LastUsed)
+      {
+        pDirHint = &pDirHints->Entries[I];
+      }
+    }
+    pDirHint->DirectoryCluster = DirectoryCluster;
+    pDirHint->LastUsed = ++pDirHints->Tick;
+  }
+  pDirHint->Free = *pDirLocation;
+}
+
+FAT_API void FAT_UpdateDirHints(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation)
+{
+  TFatDirHints* const pDirHints = pPartition->pDirHints;
+  const TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
+  const uint32_t Sector = pDirLocation->Location.Sector;
+  const uint32_t RootSector = FAT_GetRootOffset(pPartition);
+  /* Always 0 on FAT32, which has no fixed root directory. */
+  const uint8_t IsRootEntry = (uint8_t)((Sector >= RootSector) && 
+    (Sector < RootSector + pPartition->RootDirectoryEntries / FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR));
+  uint8_t I;
+
+  if (pDirHints == NULL) return;
+
+  for (I = 0; I < FAT_DIR_HINT_ENTRIES; I++)
+  {
+    TFatDirHint* const pDirHint = &pDirHints->Entries[I];
+    const TFatDirectoryLocation* pFree = &pDirHint->Free;
+
+    if (pDirHint->LastUsed == 0) continue;
+
+    if (FAT_IsDirectory(pDirEntry) && (pDirHint->DirectoryCluster == FAT_GetStartCluster(pDirEntry)))
+    {
+      /* The clusters of a deleted directory may be reused for anything. */
+      pDirHint->LastUsed = 0;
+    }
+    else if (IsRootEntry != (uint8_t)(pDirHint->DirectoryCluster == 0))
+    {
+      /* The entry is in the FAT16 root directory and the hint is not, or 
+       * the other way around.
+       */
+      continue;
+    }
+    else if (IsRootEntry || (pFree->Location.Cluster == pDirLocation->Location.Cluster))
+    {
+      /* The sectors of a cluster, and of the root directory, are in order. */
+      if ((Sector < pFree->Location.Sector) ||
+          ((Sector == pFree->Location.Sector) && (pDirLocation->EntryOffset < pFree->EntryOffset)))
+      {
+        pDirHint->Free = *pDirLocation;
+      }
+    }
+    else
+    {
+      D_(printf("Dropping free entry hint of directory %d\n", pDirHint->DirectoryCluster));
+      pDirHint->LastUsed = 0;
+    }
+  }
+}
+#endif
+#endif
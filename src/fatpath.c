@@ -0,0 +1,317 @@
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+/* The longest component that can be an 8.3 name: 8 + '.' + 3. */
+#define FAT_MAX_SHORT_NAME_LENGTH (12)
+
+#define FAT_IsPathSeparator(c) (((c) == '/') || ((c) == '\\'))
+
+FAT_API uint8_t FAT_MakeShortName(const char* pName, uint16_t Length, char* pShortName)
+{
+  uint16_t I;
+  uint8_t Pos = 0;
+  uint8_t End = 8;
+
+  memset((void*)pShortName, ' ', sizeof(((TFatDirEntry*)0)->Name));
+
+  /* The dot entries of a subdirectory. */
+  if (((Length == 1) || (Length == 2)) && (memcmp((const void*)pName, "..", Length) == 0))
+  {
+    memcpy((void*)pShortName, (const void*)pName, Length);
+    return 1;
+  }
+
+  for (I = 0; I < Length; I++)
+  {
+    char c = pName[I];
+
+    if (c == '.')
+    {
+      /* Only one dot, and not before the name. */
+      if ((Pos == 0) || (End == 11)) return 0;
+      Pos = 8;
+      End = 11;
+      continue;
+    }
+    if (Pos == End) return 0;
+
+    if ((c >= 'a') && (c <= 'z'))
+    {
+      c = (char)(c - 'a' + 'A');
+    }
+    else if (((unsigned char)c < 0x20) || (strchr("\"*+,/:;<=>?[\\]| ", c) != NULL))
+    {
+      return 0;
+    }
+    pShortName[Pos++] = c;
+  }
+  return (uint8_t)(Pos != 0);
+}
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+FAT_API void FAT_InitPathCache(TFatPathCache* pPathCache)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_PATH_CACHE_ENTRIES; I++)
+  {
+    pPathCache->Entries[I].Name[0] = 0;
+  }
+  pPathCache->Tick = 0;
+  pPathCache->Hits = 0;
+  pPathCache->Misses = 0;
+}
+
+static TFatDentry* FAT_FindDentry(TFatPathCache* pPathCache, TFatClusterNr ParentCluster, const char* pName)
+{
+  uint8_t I;
+
+  for (I = 0; I < FAT_PATH_CACHE_ENTRIES; I++)
+  {
+    TFatDentry* const pDentry = &pPathCache->Entries[I];
+
+    if ((pDentry->Name[0] != 0) &&
+        (pDentry->ParentCluster == ParentCluster) &&
+        (memcmp((const void*)pDentry->Name, (const void*)pName, sizeof(pDentry->Name)) == 0))
+    {
+      pDentry->LastUsed = ++pPathCache->Tick;
+      return pDentry;
+    }
+  }
+  return NULL;
+}
+
+static void FAT_AddDentry(TFatPathCache* pPathCache, TFatClusterNr ParentCluster, const TFatDirEntry* pDirEntry, const TFatDirectoryLocation* pDirLocation)
+{
+  TFatDentry* pDentry = &pPathCache->Entries[0];
+  uint8_t I;
+
+  /* Use an unused entry, or replace the least recently used one. */
+  for (I = 0; I < FAT_PATH_CACHE_ENTRIES; I++)
+  {
+    TFatDentry* const pCandidate = &pPathCache->Entries[I];
+
+    if (pCandidate->Name[0] == 0)
+    {
+      pDentry = pCandidate;
+      break;
+    }
+    if (pCandidate->LastUsed < pDentry->LastUsed)
+    {
+      pDentry = pCandidate;
+    }
+  }
+
+  memcpy((void*)pDentry->Name, (const void*)pDirEntry->Name, sizeof(pDentry->Name));
+  pDentry->ParentCluster = ParentCluster;
+  pDentry->StartCluster = FAT_GetStartCluster(pDirEntry);
+  pDentry->Attributes = pDirEntry->Attributes;
+  pDentry->DirLocation = *pDirLocation;
+  pDentry->LastUsed = ++pPathCache->Tick;
+}
+
+#ifdef FAT_ENABLE_WRITE
+FAT_API void FAT_ForgetPath(TFatPartition* pPartition, const TFatDirectoryLocation* pDirLocation)
+{
+  TFatPathCache* const pPathCache = pPartition->pPathCache;
+  const TFatDirEntry* pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
+  uint8_t I;
+
+  if (pPathCache == NULL) return;
+
+  if (FAT_IsDirectory(pDirEntry))
+  {
+    FAT_InitPathCache(pPathCache);
+    return;
+  }
+
+  for (I = 0; I < FAT_PATH_CACHE_ENTRIES; I++)
+  {
+    TFatDentry* const pDentry = &pPathCache->Entries[I];
+
+    if ((pDentry->DirLocation.Location.Sector == pDirLocation->Location.Sector) &&
+        (pDentry->DirLocation.EntryOffset == pDirLocation->EntryOffset))
+    {
+      pDentry->Name[0] = 0;
+    }
+  }
+}
+#endif
+#endif
+
+/* Finds pName in the directory starting at DirectoryCluster, or in the
+ * root directory if DirectoryCluster is zero (0). If Load is set, the
+ * sector holding the entry is loaded into pPartition->pBuffer.
+ */
+static uint8_t FAT_FindPathComponent(TFatPartition* pPartition, TFatClusterNr DirectoryCluster, char* pName, uint8_t Load,
+                                     TFatDirectoryLocation* pDirLocation, TFatClusterNr* pStartCluster, uint8_t* pAttributes)
+{
+  TFatDirEntry* pDirEntry;
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+  TFatPathCache* const pPathCache = pPartition->pPathCache;
+
+  if (pPathCache != NULL)
+  {
+    TFatDentry* const pDentry = FAT_FindDentry(pPathCache, DirectoryCluster, pName);
+
+    if (pDentry != NULL)
+    {
+      *pDirLocation = pDentry->DirLocation;
+      *pStartCluster = pDentry->StartCluster;
+      *pAttributes = pDentry->Attributes;
+      if (!Load)
+      {
+        pPathCache->Hits++;
+        return 1;
+      }
+
+      /* The entry is returned to the caller, so make sure that it is
+       * still there.
+       */
+      FAT_LoadSector(pPartition, pDirLocation->Location.Sector);
+      pDirEntry = FAT_GetDirEntry(pPartition, pDirLocation);
+      if (memcmp((const void*)pDirEntry->Name, (const void*)pName, sizeof(pDirEntry->Name)) == 0)
+      {
+        pPathCache->Hits++;
+        *pStartCluster = FAT_GetStartCluster(pDirEntry);
+        *pAttributes = pDirEntry->Attributes;
+        return 1;
+      }
+      pDentry->Name[0] = 0;
+    }
+    pPathCache->Misses++;
+  }
+#endif
+
+  if (DirectoryCluster == 0)
+  {
+    pDirEntry = FAT_FindRootDirEntry(pPartition, pName, pDirLocation);
+  }
+  else
+  {
+    pDirEntry = FAT_FindDirEntry(pPartition, DirectoryCluster, pName, pDirLocation);
+  }
+  if (pDirEntry == NULL) return 0;
+
+  *pStartCluster = FAT_GetStartCluster(pDirEntry);
+  *pAttributes = pDirEntry->Attributes;
+
+#ifdef FAT_PATH_CACHE_ENTRIES
+  if (pPathCache != NULL)
+  {
+    FAT_AddDentry(pPathCache, DirectoryCluster, pDirEntry, pDirLocation);
+  }
+#endif
+  return 1;
+}
+
+FAT_API TFatDirEntry* FAT_OpenPath(TFatPartition* pPartition, const char* pPath, TFatDirectoryLocation* pDirLocation)
+{
+  TFatClusterNr DirectoryCluster = 0;
+  TFatClusterNr StartCluster = 0;
+  uint8_t Attributes = ATTR_DIRECTORY;
+  uint8_t Found = 0;
+  char Name[sizeof(((TFatDirEntry*)0)->Name)];
+
+  D_(printf("Opening path %s\n", pPath));
+
+  while (FAT_IsPathSeparator(*pPath)) pPath++;
+
+  while (*pPath != '\0')
+  {
+    const char* pEnd = pPath;
+    const char* pNext;
+
+    while ((*pEnd != '\0') && !FAT_IsPathSeparator(*pEnd)) pEnd++;
+    pNext = pEnd;
+    while (FAT_IsPathSeparator(*pNext)) pNext++;
+
+    /* Only directories can be passed through. */
+    if (!(Attributes & ATTR_DIRECTORY)) return NULL;
+
+    if ((pEnd - pPath > FAT_MAX_SHORT_NAME_LENGTH) ||
+        !FAT_MakeShortName(pPath, (uint16_t)(pEnd - pPath), Name))
+    {
+      return NULL;
+    }
+
+    /* Only the sector of the last component is needed. */
+    if (!FAT_FindPathComponent(pPartition, DirectoryCluster, Name, (uint8_t)(*pNext == '\0'),
+                               pDirLocation, &StartCluster, &Attributes))
+    {
+      return NULL;
+    }
+
+    /* ".." entries of directories below the root directory hold cluster 0. */
+    DirectoryCluster = StartCluster;
+    Found = 1;
+    pPath = pNext;
+  }
+
+  if (!Found) return NULL;
+
+  return FAT_GetDirEntry(pPartition, pDirLocation);
+}
+
+FAT_API uint8_t FAT_LookupPath(TFatPartition* pPartition, const char* pPath, TFatDirEntry* pDirEntry, TFatDirectoryLocation* pDirLocation)
+{
+  const TFatDirEntry* pFound;
+
+  FAT_Lock(pPartition, FAT_LOCK_READ);
+  pFound = FAT_OpenPath(pPartition, pPath, pDirLocation);
+  if (pFound != NULL)
+  {
+    *pDirEntry = *pFound;
+  }
+  FAT_Unlock(pPartition, FAT_LOCK_READ);
+  return (uint8_t)(pFound != NULL);
+}
+
+FAT_API uint8_t FAT_OpenParentPath(TFatPartition* pPartition, const char* pPath, TFatClusterNr* pDirectoryCluster, char* pName)
+{
+  TFatDirectoryLocation DirLocation;
+  TFatClusterNr DirectoryCluster = 0;
+  TFatClusterNr StartCluster;
+  uint8_t Attributes = ATTR_DIRECTORY;
+
+  while (FAT_IsPathSeparator(*pPath)) pPath++;
+
+  while (*pPath != '\0')
+  {
+    const char* pEnd = pPath;
+    const char* pNext;
+
+    while ((*pEnd != '\0') && !FAT_IsPathSeparator(*pEnd)) pEnd++;
+    pNext = pEnd;
+    while (FAT_IsPathSeparator(*pNext)) pNext++;
+
+    if (!(Attributes & ATTR_DIRECTORY)) return 0;
+
+    if ((pEnd - pPath > FAT_MAX_SHORT_NAME_LENGTH) ||
+        !FAT_MakeShortName(pPath, (uint16_t)(pEnd - pPath), pName))
+    {
+      return 0;
+    }
+
+    if (*pNext == '\0')
+    {
+      *pDirectoryCluster = DirectoryCluster;
+      return 1;
+    }
+
+    if (!FAT_FindPathComponent(pPartition, DirectoryCluster, pName, 0, &DirLocation, &StartCluster, &Attributes))
+    {
+      return 0;
+    }
+    DirectoryCluster = StartCluster;
+    pPath = pNext;
+  }
+  return 0;
+}
@@ -0,0 +1,368 @@
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifndef FAT_DISABLE_SIMD
+#if defined(__AVX2__)
+#define FAT_USE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define FAT_USE_SSE2
+#include <emmintrin.h>
+#endif
+#endif
+
+FAT_API uint8_t FAT_GetLowestBit(uint32_t Mask)
+{
+#if defined(__GNUC__)
+  return (uint8_t)__builtin_ctz(Mask);
+#else
+  uint8_t Bit = 0;
+
+  while (!(Mask & 1))
+  {
+    Mask >>= 1;
+    Bit++;
+  }
+  return Bit;
+#endif
+}
+
+#if defined(FAT_USE_AVX2) || defined(FAT_USE_SSE2)
+
+#ifdef FAT_USE_AVX2
+typedef __m256i TFatVector;
+typedef uint32_t TFatVectorMask;
+#define FAT_VECTOR_SIZE (32)
+#define FAT_VectorLoad(p) _mm256_loadu_si256((const __m256i*)(p))
+#define FAT_VectorZero() _mm256_setzero_si256()
+#define FAT_VectorSet32(Value) _mm256_set1_epi32((int)(Value))
+#define FAT_VectorAnd(a, b) _mm256_and_si256(a, b)
+#define FAT_VectorAdd16(a, b) _mm256_add_epi16(a, b)
+#define FAT_VectorAdd32(a, b) _mm256_add_epi32(a, b)
+#define FAT_VectorEqual16(a, b) _mm256_cmpeq_epi16(a, b)
+#define FAT_VectorEqual32(a, b) _mm256_cmpeq_epi32(a, b)
+#define FAT_VectorMask(a) ((TFatVectorMask)_mm256_movemask_epi8(a))
+#define FAT_VectorStore(p, a) _mm256_storeu_si256((__m256i*)(p), a)
+#else
+typedef __m128i TFatVector;
+typedef uint16_t TFatVectorMask;
+#define FAT_VECTOR_SIZE (16)
+#define FAT_VectorLoad(p) _mm_loadu_si128((const __m128i*)(p))
+#define FAT_VectorZero() _mm_setzero_si128()
+#define FAT_VectorSet32(Value) _mm_set1_epi32((int)(Value))
+#define FAT_VectorAnd(a, b) _mm_and_si128(a, b)
+#define FAT_VectorAdd16(a, b) _mm_add_epi16(a, b)
+#define FAT_VectorAdd32(a, b) _mm_add_epi32(a, b)
+#define FAT_VectorEqual16(a, b) _mm_cmpeq_epi16(a, b)
+#define FAT_VectorEqual32(a, b) _mm_cmpeq_epi32(a, b)
+#define FAT_VectorMask(a) ((TFatVectorMask)_mm_movemask_epi8(a))
+#define FAT_VectorStore(p, a) _mm_storeu_si128((__m128i*)(p), a)
+#endif
+
+/* Adds up the lanes of a vector of counters. Each compare result is -1 for
+ * a free entry, so the counters are negative.
+ */
+#ifdef FAT_ENABLE_FAT16
+static uint32_t FAT_SumLanes16(TFatVector Sum)
+{
+  int16_t Lanes[FAT_VECTOR_SIZE / sizeof(int16_t)];
+  uint32_t Total = 0;
+  uint8_t I;
+
+  FAT_VectorStore(Lanes, Sum);
+  for (I = 0; I < FAT_VECTOR_SIZE / sizeof(int16_t); I++)
+  {
+    Total += (uint32_t)-Lanes[I];
+  }
+  return Total;
+}
+#endif
+
+#ifdef FAT_ENABLE_FAT32
+static uint32_t FAT_SumLanes32(TFatVector Sum)
+{
+  int32_t Lanes[FAT_VECTOR_SIZE / sizeof(int32_t)];
+  uint32_t Total = 0;
+  uint8_t I;
+
+  FAT_VectorStore(Lanes, Sum);
+  for (I = 0; I < FAT_VECTOR_SIZE / sizeof(int32_t); I++)
+  {
+    Total += (uint32_t)-Lanes[I];
+  }
+  return Total;
+}
+#endif
+#endif
+
+#ifdef FAT_ENABLE_FAT16
+FAT_API uint16_t FAT16_FindFreeEntry(const uint8_t* pEntries, uint16_t Count)
+{
+  uint16_t I = 0;
+
+#if defined(FAT_USE_AVX2) || defined(FAT_USE_SSE2)
+  const uint16_t Step = FAT_VECTOR_SIZE / sizeof(uint16_t);
+
+  for (; I + Step <= Count; I += Step)
+  {
+    const TFatVectorMask Mask = FAT_VectorMask(FAT_VectorEqual16(FAT_VectorLoad(pEntries + I * sizeof(uint16_t)), FAT_VectorZero()));
+
+    if (Mask != 0)
+    {
+      return (uint16_t)(I + FAT_GetLowestBit(Mask) / sizeof(uint16_t));
+    }
+  }
+#endif
+  for (; I < Count; I++)
+  {
+    if (((const uint16_t*)pEntries)[I] == 0)
+    {
+      break;
+    }
+  }
+  return I;
+}
+
+FAT_API uint16_t FAT16_CountFreeEntries(const uint8_t* pEntries, uint16_t Count)
+{
+  uint16_t I = 0;
+  uint32_t Free = 0;
+
+#if defined(FAT_USE_AVX2) || defined(FAT_USE_SSE2)
+  const uint16_t Step = FAT_VECTOR_SIZE / sizeof(uint16_t);
+  TFatVector Sum = FAT_VectorZero();
+
+  /* Each 16-bit lane counts at most Count / Step <= 8191 entries. */
+  for (; I + Step <= Count; I += Step)
+  {
+    Sum = FAT_VectorAdd16(Sum, FAT_VectorEqual16(FAT_VectorLoad(pEntries + I * sizeof(uint16_t)), FAT_VectorZero()));
+  }
+  Free = FAT_SumLanes16(Sum);
+#endif
+  for (; I < Count; I++)
+  {
+    if (((const uint16_t*)pEntries)[I] == 0)
+    {
+      Free++;
+    }
+  }
+  return (uint16_t)Free;
+}
+#endif
+
+#ifdef FAT_ENABLE_FAT32
+FAT_API uint16_t FAT32_FindFreeEntry(const uint8_t* pEntries, uint16_t Count)
+{
+  uint16_t I = 0;
+
+#if defined(FAT_USE_AVX2) || defined(FAT_USE_SSE2)
+  const uint16_t Step = FAT_VECTOR_SIZE / sizeof(uint32_t);
+  const TFatVector EntryMask = FAT_VectorSet32(0x0FFFFFFFUL);
+
+  for (; I + Step <= Count; I += Step)
+  {
+    const TFatVector Entries = FAT_VectorAnd(FAT_VectorLoad(pEntries + I * sizeof(uint32_t)), EntryMask);
+    const TFatVectorMask Mask = FAT_VectorMask(FAT_VectorEqual32(Entries, FAT_VectorZero()));
+
+    if (Mask != 0)
+    {
+      return (uint16_t)(I + FAT_GetLowestBit(Mask) / sizeof(uint32_t));
+    }
+  }
+#endif
+  for (; I < Count; I++)
+  {
+    if ((((const uint32_t*)pEntries)[I] & 0x0FFFFFFFUL) == 0)
+    {
+      break;
+    }
+  }
+  return I;
+}
+
+FAT_API uint16_t FAT32_CountFreeEntries(const uint8_t* pEntries, uint16_t Count)
+{
+  uint16_t I = 0;
+  uint32_t Free = 0;
+
+#if defined(FAT_USE_AVX2) || defined(FAT_USE_SSE2)
+  const uint16_t Step = FAT_VECTOR_SIZE / sizeof(uint32_t);
+  const TFatVector EntryMask = FAT_VectorSet32(0x0FFFFFFFUL);
+  TFatVector Sum = FAT_VectorZero();
+
+  for (; I + Step <= Count; I += Step)
+  {
+    const TFatVector Entries = FAT_VectorAnd(FAT_VectorLoad(pEntries + I * sizeof(uint32_t)), EntryMask);
+
+    Sum = FAT_VectorAdd32(Sum, FAT_VectorEqual32(Entries, FAT_VectorZero()));
+  }
+  Free = FAT_SumLanes32(Sum);
+#endif
+  for (; I < Count; I++)
+  {
+    if ((((const uint32_t*)pEntries)[I] & 0x0FFFFFFFUL) == 0)
+    {
+      Free++;
+    }
+  }
+  return (uint16_t)Free;
+}
+#endif
+
+FAT_API uint32_t FAT_CountFreeClusters(TFatPartition* pPartition)
+{
+  const uint16_t EntriesPerSector = (uint16_t)FAT_Cond(pPartition, FAT_NUMBER_OF_FAT16_ENTRIES_PER_SECTOR, FAT_NUMBER_OF_FAT32_ENTRIES_PER_SECTOR);
+  const uint32_t EndCluster = (uint32_t)pPartition->ClusterCount + 2;
+  uint32_t ClusterNr = 2;
+  uint32_t Free = 0;
+
+  /* Clusters 0 and 1 are reserved, and entries beyond the last cluster in
+   * the final FAT sector are not counted.
+   */
+  while (ClusterNr < EndCluster)
+  {
+    const uint32_t Sector = ClusterNr / EntriesPerSector;
+    const uint16_t First = (uint16_t)(ClusterNr % EntriesPerSector);
+    uint16_t Count = EntriesPerSector - First;
+    const uint8_t* pSector = FAT_LoadFATSector(pPartition, Sector);
+
+    if (Count > EndCluster - ClusterNr)
+    {
+      Count = (uint16_t)(EndCluster - ClusterNr);
+    }
+    Free += FAT_Cond(pPartition, FAT16_CountFreeEntries(pSector + First * sizeof(uint16_t), Count), 
+                                 FAT32_CountFreeEntries(pSector + First * sizeof(uint32_t), Count));
+    ClusterNr += Count;
+  }
+
+  D_(printf("Counted %d free clusters\n", Free));
+
+  pPartition->FreeClusters = Free;
+  return Free;
+}
+
+#if defined(FAT_USE_AVX2) || defined(FAT_USE_SSE2)
+/* Gathers the first name byte (byte 0) and the attributes (byte 11) of the
+ * 16 entries of a directory sector. Byte N of each vector belongs to 
+ * entry N.
+ */
+static void FAT_GatherDirBytes(const uint8_t* pSector, __m128i* pFirst, __m128i* pAttributes)
+{
+  const __m128i LowByte = _mm_set1_epi32(0xFF);
+  __m128i First[4];
+  __m128i Attributes[4];
+  uint8_t I;
+
+  for (I = 0; I < 4; I++)
+  {
+    const uint8_t* const pEntries = pSector + I * 4 * FAT_DIRECTORY_ENTRY_SIZE;
+    const __m128i Entry0 = _mm_loadu_si128((const __m128i*)pEntries);
+    const __m128i Entry1 = _mm_loadu_si128((const __m128i*)(pEntries + FAT_DIRECTORY_ENTRY_SIZE));
+    const __m128i Entry2 = _mm_loadu_si128((const __m128i*)(pEntries + 2 * FAT_DIRECTORY_ENTRY_SIZE));
+    const __m128i Entry3 = _mm_loadu_si128((const __m128i*)(pEntries + 3 * FAT_DIRECTORY_ENTRY_SIZE));
+
+    /* Bytes 0-3 of an entry are its first 32-bit lane, bytes 8-11 its third. */
+    First[I] = _mm_and_si128(_mm_unpacklo_epi64(_mm_unpacklo_epi32(Entry0, Entry1), _mm_unpacklo_epi32(Entry2, Entry3)), LowByte);
+    Attributes[I] = _mm_srli_epi32(_mm_unpacklo_epi64(_mm_unpackhi_epi32(Entry0, Entry1), _mm_unpackhi_epi32(Entry2, Entry3)), 24);
+  }
+
+  /* Every lane holds a single byte, so packing does not saturate. */
+  *pFirst = _mm_packus_epi16(_mm_packs_epi32(First[0], First[1]), _mm_packs_epi32(First[2], First[3]));
+  *pAttributes = _mm_packus_epi16(_mm_packs_epi32(Attributes[0], Attributes[1]), _mm_packs_epi32(Attributes[2], Attributes[3]));
+}
+#endif
+
+FAT_API void FAT_ScanDirSector(const uint8_t* pSector, const char* pName, TFatDirScan* pScan)
+{
+  uint16_t Match = 0;
+  uint16_t Deleted = 0;
+  uint16_t End = 0;
+  uint16_t LongName = 0;
+
+#if defined(FAT_USE_AVX2) || defined(FAT_USE_SSE2)
+  /* The status masks come from one compare over all entries each. The name
+   * is only compared in full for the entries whose first byte matches.
+   */
+  const __m128i LongNameMark = _mm_set1_epi8((char)ATTR_LONG_NAME);
+  __m128i First;
+  __m128i Attributes;
+
+  FAT_GatherDirBytes(pSector, &First, &Attributes);
+  End      = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(First, _mm_setzero_si128()));
+  Deleted  = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(First, _mm_set1_epi8((char)0xE5)));
+  LongName = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(Attributes, LongNameMark), LongNameMark));
+
+  if ((pName != NULL) && (pName[0] != 0x00))
+  {
+    uint8_t Target[16];
+    __m128i Name;
+    uint16_t Candidates;
+
+    memset((void*)Target, 0, sizeof(Target));
+    memcpy((void*)Target, (const void*)pName, sizeof(((TFatDirEntry*)0)->Name));
+    Name = _mm_loadu_si128((const __m128i*)Target);
+
+    Candidates = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(First, _mm_set1_epi8(pName[0])));
+    if (End != 0)
+    {
+      Candidates &= (uint16_t)((End & (uint16_t)(~End + 1)) - 1);
+    }
+    while (Candidates != 0)
+    {
+      const uint8_t I = FAT_GetLowestBit(Candidates);
+      const __m128i Entry = _mm_loadu_si128((const __m128i*)(pSector + I * FAT_DIRECTORY_ENTRY_SIZE));
+
+      if ((_mm_movemask_epi8(_mm_cmpeq_epi8(Entry, Name)) & 0x07FF) == 0x07FF)
+      {
+        Match |= (uint16_t)(1 << I);
+      }
+      Candidates &= (uint16_t)(Candidates - 1);
+    }
+  }
+#else
+  uint8_t I;
+
+  for (I = 0; I < FAT_NUMBER_OF_DIRECTORY_ENTRIES_PER_SECTOR; I++)
+  {
+    const uint8_t* pEntry = pSector + I * FAT_DIRECTORY_ENTRY_SIZE;
+
+    if ((pName != NULL) && (memcmp((const void*)pEntry, (const void*)pName, sizeof(((TFatDirEntry*)0)->Name)) == 0))
+    {
+      Match |= (uint16_t)(1 << I);
+    }
+    if (pEntry[0] == 0x00)
+    {
+      End |= (uint16_t)(1 << I);
+    }
+    if (pEntry[0] == 0xE5)
+    {
+      Deleted |= (uint16_t)(1 << I);
+    }
+    if ((pEntry[11] & ATTR_LONG_NAME) == ATTR_LONG_NAME)
+    {
+      LongName |= (uint16_t)(1 << I);
+    }
+  }
+#endif
+
+  /* Only the entries before the first end entry belong to the directory. */
+  if (End != 0)
+  {
+    const uint16_t Before = (uint16_t)((End & (uint16_t)(~End + 1)) - 1);
+
+    Match &= Before;
+    Deleted &= Before;
+    LongName &= Before;
+  }
+
+  pScan->Match = (uint16_t)(Match & ~LongName);
+  pScan->Deleted = Deleted;
+  pScan->End = End;
+  pScan->LongName = LongName;
+}
@@ -0,0 +1,224 @@
+#include "../include/fat.h"
+#include <string.h>
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_ENABLE_FAT_TABLE
+
+/* The largest number of sectors transferred with a single request. */
+#define FAT_TABLE_MAX_TRANSFER (0x8000)
+
+#define FAT_IsTableSectorDirty(pTable, Index) ((pTable)->pDirty[(Index) >> 3] & (uint8_t)(1 << ((Index) & 7)))
+
+#ifdef FAT_ENABLE_WRITE
+FAT_API void FAT_FlushTable(TFatPartition* pPartition)
+{
+  TFatTable* const pTable = pPartition->pTable;
+  uint32_t First = 0;
+  uint8_t Copy;
+
+  while (First < pTable->LoadedSectors)
+  {
+    uint32_t End;
+
+    if (!FAT_IsTableSectorDirty(pTable, First))
+    {
+      First++;
+      continue;
+    }
+
+    /* Write the run of modified sectors starting at First. */
+    End = First + 1;
+    while ((End < pTable->LoadedSectors) && (End - First < FAT_TABLE_MAX_TRANSFER) && 
+           FAT_IsTableSectorDirty(pTable, End))
+    {
+      End++;
+    }
+    for (Copy = 0; Copy < pPartition->MirroredFATs; Copy++)
+    {
+      FAT_StoreSectors(pPartition, FAT_GetFATSector(pPartition) + Copy * pPartition->SectorsPerFAT + pTable->FirstSector + First, 
+                       (uint16_t)(End - First), pTable->pData + First * FAT_BYTES_PER_SECTOR);
+    }
+    First = End;
+  }
+  memset((void*)pTable->pDirty, 0, FAT_TABLE_DIRTY_SIZE(pTable->SectorCount));
+}
+#endif
+
+/* Moves the window so that it holds SectorOffset. Modified sectors in the
+ * current window are written first.
+ */
+static void FAT_LoadTableWindow(TFatPartition* pPartition, uint32_t SectorOffset)
+{
+  TFatTable* const pTable = pPartition->pTable;
+  uint32_t Loaded;
+
+#ifdef FAT_ENABLE_WRITE
+  FAT_FlushTable(pPartition);
+#endif
+
+  pTable->FirstSector = SectorOffset - SectorOffset % pTable->SectorCount;
+  pTable->LoadedSectors = pPartition->SectorsPerFAT - pTable->FirstSector;
+  if (pTable->LoadedSectors > pTable->SectorCount)
+  {
+    pTable->LoadedSectors = pTable->SectorCount;
+  }
+  pTable->Loads++;
+
+  D_(printf("Loading FAT sectors %d-%d\n", pTable->FirstSector, pTable->FirstSector + pTable->LoadedSectors - 1));
+
+  for (Loaded = 0; Loaded < pTable->LoadedSectors; Loaded += FAT_TABLE_MAX_TRANSFER)
+  {
+    uint32_t Count = pTable->LoadedSectors - Loaded;
+
+    if (Count > FAT_TABLE_MAX_TRANSFER)
+    {
+      Count = FAT_TABLE_MAX_TRANSFER;
+    }
+    FAT_LoadSectors(pPartition, FAT_GetFATSector(pPartition) + pTable->FirstSector + Loaded, 
+                    (uint16_t)Count, pTable->pData + Loaded * FAT_BYTES_PER_SECTOR);
+  }
+}
+
+FAT_API void FAT_InitTable(TFatPartition* pPartition)
+{
+  TFatTable* const pTable = pPartition->pTable;
+
+  if (pTable == NULL) return;
+
+  pTable->FirstSector = 0;
+  pTable->LoadedSectors = 0;
+  pTable->Loads = 0;
+  memset((void*)pTable->pDirty, 0, FAT_TABLE_DIRTY_SIZE(pTable->SectorCount));
+
+  FAT_LoadTableWindow(pPartition, 0);
+}
+#endif
+
+FAT_API uint8_t* FAT_LoadFATSector(TFatPartition* pPartition, uint32_t SectorOffset)
+{
+#ifdef FAT_ENABLE_FAT_TABLE
+  TFatTable* const pTable = pPartition->pTable;
+
+  if (pTable != NULL)
+  {
+    /* Unsigned subtraction also catches sectors before the window. */
+    if (SectorOffset - pTable->FirstSector >= pTable->LoadedSectors)
+    {
+      FAT_LoadTableWindow(pPartition, SectorOffset);
+    }
+    return pTable->pData + (SectorOffset - pTable->FirstSector) * FAT_BYTES_PER_SECTOR;
+  }
+#endif
+  FAT_LoadSector(pPartition, FAT_GetFATSector(pPartition) + SectorOffset);
+  return pPartition->pBuffer;
+}
+
+#ifdef FAT_ENABLE_WRITE
+FAT_API void FAT_StoreFATSector(TFatPartition* pPartition, uint32_t SectorOffset)
+{
+#ifdef FAT_ENABLE_FAT_TABLE
+  TFatTable* const pTable = pPartition->pTable;
+
+  if (pTable != NULL)
+  {
+    const uint32_t Index = SectorOffset - pTable->FirstSector;
+
+    pTable->pDirty[Index >> 3] |= (uint8_t)(1 << (Index & 7));
+    return;
+  }
+#endif
+  FAT_StoreSector(pPartition, FAT_GetFATSector(pPartition) + SectorOffset);
+
+  if (pPartition->MirroredFATs < 2) return;
+
+  /* Remember the sector for FAT_MirrorFAT. The range is used instead of
+   * the list once more sectors have been modified than the list can hold.
+   */
+  if ((pPartition->EndDirtyFATSector == 0) || (SectorOffset < pPartition->FirstDirtyFATSector))
+  {
+    pPartition->FirstDirtyFATSector = SectorOffset;
+  }
+  if (SectorOffset >= pPartition->EndDirtyFATSector)
+  {
+    pPartition->EndDirtyFATSector = SectorOffset + 1;
+  }
+
+  if (pPartition->DirtyFATSectorCount <= FAT_DIRTY_FAT_SECTORS)
+  {
+    uint8_t Index = 0;
+    uint8_t I;
+
+    while ((Index < pPartition->DirtyFATSectorCount) && (pPartition->DirtyFATSectors[Index] < SectorOffset))
+    {
+      Index++;
+    }
+    if ((Index < pPartition->DirtyFATSectorCount) && (pPartition->DirtyFATSectors[Index] == SectorOffset))
+    {
+      return;
+    }
+    if (pPartition->DirtyFATSectorCount == FAT_DIRTY_FAT_SECTORS)
+    {
+      pPartition->DirtyFATSectorCount = FAT_DIRTY_FAT_SECTORS + 1;
+      return;
+    }
+    for (I = pPartition->DirtyFATSectorCount; I > Index; I--)
+    {
+      pPartition->DirtyFATSectors[I] = pPartition->DirtyFATSectors[I - 1];
+    }
+    pPartition->DirtyFATSectors[Index] = SectorOffset;
+    pPartition->DirtyFATSectorCount++;
+  }
+}
+
+/* Copies a sector of the first FAT to the other FAT tables. */
+static void FAT_MirrorFATSector(TFatPartition* pPartition, uint32_t SectorOffset)
+{
+  const uint32_t Sector = FAT_GetFATSector(pPartition) + SectorOffset;
+  uint8_t Copy;
+
+  /* The sector has just been stored, so a sector cache usually still 
+   * holds it. The copies are written past the cache, since they are not
+   * read again.
+   */
+  FAT_LoadSector(pPartition, Sector);
+  for (Copy = 1; Copy < pPartition->MirroredFATs; Copy++)
+  {
+    FAT_StoreSectors(pPartition, Sector + Copy * pPartition->SectorsPerFAT, 1, pPartition->pBuffer);
+  }
+}
+
+FAT_API void FAT_MirrorFAT(TFatPartition* pPartition)
+{
+  uint32_t SectorOffset;
+  uint8_t I;
+
+  if (pPartition->EndDirtyFATSector == 0) return;
+
+  if (pPartition->DirtyFATSectorCount > FAT_DIRTY_FAT_SECTORS)
+  {
+    D_(printf("Mirroring FAT sectors %d-%d\n", pPartition->FirstDirtyFATSector, pPartition->EndDirtyFATSector - 1));
+
+    for (SectorOffset = pPartition->FirstDirtyFATSector; SectorOffset < pPartition->EndDirtyFATSector; SectorOffset++)
+    {
+      FAT_MirrorFATSector(pPartition, SectorOffset);
+    }
+  }
+  else
+  {
+    for (I = 0; I < pPartition->DirtyFATSectorCount; I++)
+    {
+      D_(printf("Mirroring FAT sector %d\n", pPartition->DirtyFATSectors[I]));
+      FAT_MirrorFATSector(pPartition, pPartition->DirtyFATSectors[I]);
+    }
+  }
+
+  pPartition->DirtyFATSectorCount = 0;
+  pPartition->FirstDirtyFATSector = 0;
+  pPartition->EndDirtyFATSector = 0;
+}
+#endif
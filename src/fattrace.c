@@ -0,0 +1,65 @@
+#include "../include/fat.h"
+
+#ifdef FAT_DEBUG
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#endif
+
+#ifdef FAT_ENABLE_TRACE
+FAT_API void FAT_InitTrace(TFatTraceRecorder* pRecorder)
+{
+  uint8_t* const pHeader = pRecorder->pBuffer;
+
+  D_(assert(pRecorder->BufferSize >= FAT_TRACE_HEADER_SIZE));
+
+  pHeader[0] = 'F';
+  pHeader[1] = 'A';
+  pHeader[2] = 'T';
+  pHeader[3] = 'T';
+  pHeader[4] = FAT_TRACE_VERSION;
+  pHeader[5] = 0;
+  pHeader[6] = 0;
+  pHeader[7] = 0;
+  pRecorder->Length = FAT_TRACE_HEADER_SIZE;
+  pRecorder->Records = 0;
+}
+
+FAT_API void FAT_FlushTrace(TFatTraceRecorder* pRecorder)
+{
+  if (pRecorder->Length != 0)
+  {
+    pRecorder->Write(pRecorder->pContext, pRecorder->pBuffer, pRecorder->Length);
+    pRecorder->Length = 0;
+  }
+}
+
+FAT_API void FAT_RecordTrace(void* pContext, uint8_t Operation, uint8_t Region, uint32_t SectorNr, uint16_t Count)
+{
+  TFatTraceRecorder* const pRecorder = (TFatTraceRecorder*)pContext;
+  const uint8_t Flags = (uint8_t)(((Operation == FAT_STATS_WRITE) ? FAT_TRACE_WRITE : 0) | (Region & FAT_TRACE_REGION_MASK));
+
+  while (Count != 0)
+  {
+    const uint8_t Length = (uint8_t)((Count > 255) ? 255 : Count);
+    uint8_t* pRecord;
+
+    if (pRecorder->Length + FAT_TRACE_RECORD_SIZE > pRecorder->BufferSize)
+    {
+      FAT_FlushTrace(pRecorder);
+    }
+    pRecord = pRecorder->pBuffer + pRecorder->Length;
+    pRecord[0] = (uint8_t)SectorNr;
+    pRecord[1] = (uint8_t)(SectorNr >> 8);
+    pRecord[2] = (uint8_t)(SectorNr >> 16);
+    pRecord[3] = (uint8_t)(SectorNr >> 24);
+    pRecord[4] = Length;
+    pRecord[5] = Flags;
+    pRecorder->Length += FAT_TRACE_RECORD_SIZE;
+    pRecorder->Records++;
+
+    SectorNr += Length;
+    Count -= Length;
+  }
+}
+#endif